@@ -1,17 +1,32 @@
 #include "../../src/amg.hpp"
+#include "../../src/ca_chebyshev.hpp"
+#include "../../src/autotune.hpp"
+#include "../../src/block_cg.hpp"
 #include "../../src/cg.hpp"
 #include "../../src/chebyshev.hpp"
 #include "../../src/csr.hpp"
+#include "../../src/element_matrix.hpp"
+#include "../../src/fdm.hpp"
+#include "../../src/hmg.hpp"
+#include "../../src/lanczos.hpp"
 #include "../../src/laplacian.hpp"
+#include "../../src/lor.hpp"
 #include "../../src/mesh.hpp"
+#include "../../src/mixed_precision.hpp"
 #include "../../src/operators.hpp"
+#include "../../src/pipelined_cg.hpp"
 #include "../../src/pmg.hpp"
 #include "../../src/precompute.hpp"
+#include "../../src/relaxation.hpp"
+#include "../../src/schwarz.hpp"
+#include "../../src/smoother.hpp"
+#include "../../src/sstep_cg.hpp"
 #include "../../src/vector.hpp"
 #include "poisson.h"
 
 #include <thrust/device_vector.h>
 
+#include <algorithm>
 #include <array>
 #include <basix/e-lagrange.h>
 #include <boost/program_options.hpp>
@@ -24,35 +39,134 @@
 #include <iostream>
 #include <memory>
 #include <mpi.h>
+#include <tuple>
 
 using namespace dolfinx;
 using T = double;
 using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+using FloatVector = dolfinx::acc::Vector<float, acc::Device::HIP>;
 namespace po = boost::program_options;
 
+/// Degrees of the p-multigrid hierarchy for fine degree P, coarsest first.
+/// The degree is halved (rounding up) down to 1, e.g. 1, 2, 4, 8 for P = 8
+/// or 1, 2, 3 for P = 3.
+std::vector<int> degree_hierarchy(int P)
+{
+  if (P < 2 or P > acc::max_degree)
+    throw std::runtime_error("Unsupported fine degree: " + std::to_string(P));
+
+  std::vector<int> order = {P};
+  while (order.back() > 1)
+    order.push_back((order.back() + 1) / 2);
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
+/// Settings of the solver, from the command line
+struct SolverOptions
+{
+  /// Polynomial degree of the fine level
+  int degree = 3;
+  /// Solve the coarse level with AMG instead of its smoother
+  bool use_amg = false;
+  /// Write the solution to solution.bp
+  bool output_to_file = false;
+  /// Tune the smoother settings of each level before solving
+  bool autotune = false;
+  /// Run the multigrid preconditioner in single precision
+  bool mixed_precision = false;
+  acc::CycleType cycle = acc::CycleType::V;
+  /// Krylov-accelerated coarse-grid correction on intermediate levels
+  bool kcycle = false;
+  /// Log the residual norms of each phase of the cycle (diagnostics only)
+  bool monitor = false;
+  /// Use the matrix-free Interpolator between p-levels instead of assembled
+  /// transfer matrices
+  bool matfree_transfer = false;
+  /// If not 1, scale kappa by this factor after the first solve, update the
+  /// hierarchy in place and solve again with the same RHS
+  T kappa_update = 1;
+  /// Reuse and store eigenvalue estimates (eigenvalues.cache)
+  bool use_eig_cache = true;
+  /// Discard the stored eigenvalue estimates first
+  bool clear_eig_cache = false;
+  /// Smoother of every level: chebyshev, lor (Chebyshev on the
+  /// low-order-refined matrix), jacobi or gauss-seidel (csr operators only),
+  /// or schwarz, fdm or ca-chebyshev (matfree operators only)
+  std::string smoother = "chebyshev";
+  /// Number of ghost cell layers of the meshes
+  int ghost_layers = 1;
+  /// Outer Krylov solver: cg (flexible) or pipelined, preconditioned by one
+  /// PMG cycle, or sstep (Jacobi-preconditioned s-step CG, no multigrid) or
+  /// block (Jacobi-preconditioned block CG on several right-hand sides)
+  std::string krylov = "cg";
+  /// Block size of the s-step solver
+  int sstep = 4;
+  /// Number of right-hand sides of the block solver
+  int block_columns = 4;
+};
+
+/// @param meshes Meshes of the hierarchy, coarsest first. The last one is the
+/// mesh of the p-levels, the others are h-coarsened meshes with nested
+/// partitions, each used for one P1 level below the p-levels.
+/// @param options Solver settings
+/// @tparam FineOperator Operator type of every level. The hierarchy holds a
+/// single operator type, so e.g. element matrices cannot be combined with
+/// matrix-free operators on the higher degrees.
 template <typename FineOperator>
-void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_to_file)
+void solve(std::vector<std::shared_ptr<mesh::Mesh<double>>> meshes, const SolverOptions& options)
 {
   if constexpr (std::is_same_v<FineOperator, acc::MatFreeLaplacian<T>>)
   {
     spdlog::info("------- MatFree -------");
   }
+  else if constexpr (std::is_same_v<FineOperator, acc::ElementMatrixOperator<T>>)
+  {
+    spdlog::info("------- Element matrices -------");
+  }
   else
   {
     spdlog::info("------- CSR -------");
   }
 
+  auto mesh = meshes.back();
   int rank = dolfinx::MPI::rank(mesh->comm());
   int size = dolfinx::MPI::size(mesh->comm());
-  std::vector<int> order = {1, 3};
-  std::vector form_a = {form_poisson_a1, form_poisson_a3};
-  std::vector form_L = {form_poisson_L1, form_poisson_L3};
 
-  auto topology = mesh->topology_mutable();
-  int tdim = topology->dim();
+  // P1 levels on the h-coarsened meshes, followed by the p-levels
+  const int num_h_levels = meshes.size() - 1;
+  std::vector<int> order(num_h_levels, 1);
+  for (int p : degree_hierarchy(options.degree))
+    order.push_back(p);
+
+  // Mesh of each level (index into meshes)
+  auto mesh_index = [num_h_levels](std::size_t i) { return std::min<int>(i, num_h_levels); };
+
+  // Forms of each level, from those generated for degrees 1 to 8 (poisson.py)
+  std::vector form_a_all
+      = {form_poisson_a1, form_poisson_a2, form_poisson_a3, form_poisson_a4,
+         form_poisson_a5, form_poisson_a6, form_poisson_a7, form_poisson_a8};
+  std::vector form_L_all
+      = {form_poisson_L1, form_poisson_L2, form_poisson_L3, form_poisson_L4,
+         form_poisson_L5, form_poisson_L6, form_poisson_L7, form_poisson_L8};
+  decltype(form_a_all) form_a;
+  decltype(form_L_all) form_L;
+  for (int p : order)
+  {
+    form_a.push_back(form_a_all[p - 1]);
+    form_L.push_back(form_L_all[p - 1]);
+  }
+
+  int tdim = mesh->topology()->dim();
   int fdim = tdim - 1;
   spdlog::debug("Create facets");
-  topology->create_connectivity(fdim, tdim);
+  std::vector<std::vector<std::int32_t>> facets(meshes.size());
+  for (std::size_t m = 0; m < meshes.size(); m++)
+  {
+    auto topology = meshes[m]->topology_mutable();
+    topology->create_connectivity(fdim, tdim);
+    facets[m] = dolfinx::mesh::exterior_facet_indices(*topology);
+  }
 
   std::vector<std::shared_ptr<fem::FunctionSpace<T>>> V(form_a.size());
   std::vector<std::shared_ptr<fem::Form<T, T>>> a(V.size());
@@ -64,8 +178,6 @@ void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_t
 
   std::vector<std::shared_ptr<const common::IndexMap>> maps(V.size());
 
-  auto facets = dolfinx::mesh::exterior_facet_indices(*topology);
-
   std::vector<std::size_t> ndofs(V.size());
 
   // Prepare and set Constants for the bilinear form
@@ -77,7 +189,8 @@ void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_t
         basix::element::family::P, basix::cell::type::hexahedron, order[i],
         basix::element::lagrange_variant::gll_warped, basix::element::dpc_variant::unset, false);
 
-    V[i] = std::make_shared<fem::FunctionSpace<T>>(fem::create_functionspace(mesh, element, {}));
+    V[i] = std::make_shared<fem::FunctionSpace<T>>(
+        fem::create_functionspace(meshes[mesh_index(i)], element, {}));
 
     ndofs[i] = V[i]->dofmap()->index_map->size_global();
     a[i] = std::make_shared<fem::Form<T>>(
@@ -85,9 +198,12 @@ void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_t
   }
 
   spdlog::info("Compute boundary cells");
-  // Compute local and boundary cells (needed for MatFreeLaplacian)
-  // FIXME: Generalise to more levels
-  auto [lcells, bcells] = compute_boundary_cells(V.back());
+  // Compute local and boundary cells of each level (needed for
+  // MatFreeLaplacian and ElementMatrixOperator). Whether a cell has dofs
+  // shared with other processes depends on the degree.
+  std::vector<std::vector<int>> lcells(V.size()), bcells(V.size());
+  for (std::size_t i = 0; i < V.size(); i++)
+    std::tie(lcells[i], bcells[i]) = compute_boundary_cells(V[i]);
 
   // assemble RHS for each level
   for (std::size_t i = 0; i < V.size(); i++)
@@ -113,13 +229,14 @@ void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_t
         fem::create_form<T>(*form_L[i], {V[i]}, {}, {{"c0", kappa}}, {}));
 
     auto dofmap = V[i]->dofmap();
-    auto bdofs = fem::locate_dofs_topological(*topology, *dofmap, fdim, facets);
+    auto bdofs = fem::locate_dofs_topological(*V[i]->mesh()->topology(), *dofmap, fdim,
+                                              facets[mesh_index(i)]);
     bcs[i] = std::make_shared<const fem::DirichletBC<T, T>>(0.0, bdofs, V[i]);
   }
 
   // If not using AMG coarse_solver will be a nullptr, and operators[0] will be applied
   std::shared_ptr<CoarseSolverType<T>> coarse_solver;
-  if (use_amg)
+  if (options.use_amg)
     coarse_solver = std::make_shared<CoarseSolverType<T>>(a[0], bcs[0]);
 
   // RHS
@@ -148,11 +265,11 @@ void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_t
   std::vector<thrust::device_vector<std::int32_t>> dofmapV(V.size());
   std::vector<std::span<std::int32_t>> device_dofmaps;
 
-  // Geometry
-  thrust::device_vector<T> geomx_device;
-  std::span<T> geom_x;
-  thrust::device_vector<std::int32_t> geomx_dofmap_device;
-  std::span<std::int32_t> geom_x_dofmap;
+  // Geometry of each mesh
+  std::vector<thrust::device_vector<T>> geomx_device(meshes.size());
+  std::vector<std::span<T>> geom_x(meshes.size());
+  std::vector<thrust::device_vector<std::int32_t>> geomx_dofmap_device(meshes.size());
+  std::vector<std::span<std::int32_t>> geom_x_dofmap(meshes.size());
   std::vector<thrust::device_vector<T>> geometry_dphi_d(V.size());
   std::vector<std::span<const T>> geometry_dphi_d_span;
   std::vector<thrust::device_vector<T>> Gweights_d(V.size());
@@ -179,11 +296,19 @@ void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_t
 
   err_check(hipDeviceSynchronize());
 
-  // Copy constants to device (all same, one per cell, scalar)
-  thrust::device_vector<T> constants(mesh->topology()->index_map(tdim)->size_local()
-                                         + mesh->topology()->index_map(tdim)->num_ghosts(),
-                                     kappa->value[0]);
-  std::span<T> device_constants(thrust::raw_pointer_cast(constants.data()), constants.size());
+  // Constants (all same, one per cell of each mesh, scalar), on host and
+  // copied to device
+  std::vector<std::vector<T>> host_constants(meshes.size());
+  std::vector<thrust::device_vector<T>> constants(meshes.size());
+  std::vector<std::span<T>> device_constants(meshes.size());
+  for (std::size_t m = 0; m < meshes.size(); ++m)
+  {
+    auto cell_map = meshes[m]->topology()->index_map(tdim);
+    host_constants[m].assign(cell_map->size_local() + cell_map->num_ghosts(), kappa->value[0]);
+    constants[m] = thrust::device_vector<T>(host_constants[m].begin(), host_constants[m].end());
+    device_constants[m]
+        = std::span<T>(thrust::raw_pointer_cast(constants[m].data()), constants[m].size());
+  }
 
   if constexpr (std::is_same_v<FineOperator, acc::MatFreeLaplacian<T>>)
   {
@@ -206,7 +331,7 @@ void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_t
     {
       spdlog::debug("Copy geometry quadrature tables to device [{}]", i);
       // Quadrature points and weights on hex (3D)
-      std::vector<int> k_to_q{1, 3, 4};
+      std::vector<int> k_to_q{1, 3, 4, 6, 8, 10, 12, 14};
       auto [Gpoints, Gweights] = basix::quadrature::make_quadrature<T>(
           basix::quadrature::type::gll, basix::cell::type::hexahedron,
           basix::polyset::type::standard, k_to_q.at(order[i] - 1));
@@ -234,17 +359,22 @@ void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_t
     err_check(hipDeviceSynchronize());
 
     spdlog::debug("Copy geometry data to device");
-    geomx_device.resize(mesh->geometry().x().size());
-    spdlog::info("Copy geometry to device :{}", geomx_device.size());
-    thrust::copy(mesh->geometry().x().begin(), mesh->geometry().x().end(), geomx_device.begin());
-    geom_x = std::span<T>(thrust::raw_pointer_cast(geomx_device.data()), geomx_device.size());
-
-    geomx_dofmap_device.resize(mesh->geometry().dofmap().size());
-    thrust::copy(mesh->geometry().dofmap().data_handle(),
-                 mesh->geometry().dofmap().data_handle() + mesh->geometry().dofmap().size(),
-                 geomx_dofmap_device.begin());
-    geom_x_dofmap = std::span<std::int32_t>(thrust::raw_pointer_cast(geomx_dofmap_device.data()),
-                                            geomx_dofmap_device.size());
+    for (std::size_t m = 0; m < meshes.size(); ++m)
+    {
+      const mesh::Geometry<T>& geometry = meshes[m]->geometry();
+      geomx_device[m].resize(geometry.x().size());
+      spdlog::info("Copy geometry to device :{}", geomx_device[m].size());
+      thrust::copy(geometry.x().begin(), geometry.x().end(), geomx_device[m].begin());
+      geom_x[m]
+          = std::span<T>(thrust::raw_pointer_cast(geomx_device[m].data()), geomx_device[m].size());
+
+      geomx_dofmap_device[m].resize(geometry.dofmap().size());
+      thrust::copy(geometry.dofmap().data_handle(),
+                   geometry.dofmap().data_handle() + geometry.dofmap().size(),
+                   geomx_dofmap_device[m].begin());
+      geom_x_dofmap[m] = std::span<std::int32_t>(
+          thrust::raw_pointer_cast(geomx_dofmap_device[m].data()), geomx_dofmap_device[m].size());
+    }
 
     err_check(hipDeviceSynchronize());
   }
@@ -260,19 +390,23 @@ void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_t
       maps[i] = V[i]->dofmap()->index_map;
 
       spdlog::info("Create operator on V[{}]", i);
+      const int m = mesh_index(i);
       operators[i] = std::make_shared<acc::MatFreeLaplacian<T>>(
-          order[i], device_constants, device_dofmaps[i], geom_x, geom_x_dofmap,
-          geometry_dphi_d_span[i], Gweights_d_span[i], lcells, bcells, bc_marker_d_span[i]);
+          order[i], device_constants[m], device_dofmaps[i], geom_x[m], geom_x_dofmap[m],
+          geometry_dphi_d_span[i], Gweights_d_span[i], lcells[i], bcells[i],
+          bc_marker_d_span[i]);
 
-      // FIXME: do this better
-      // Compute CSR matrix, to get diagonal for MatFree
-      acc::MatrixOperator<T> A(a_i, bc_i);
-      DeviceVector diag_inv(maps[i], 1);
-      A.get_diag_inverse(diag_inv);
-      operators[i]->set_diag_inverse(diag_inv);
+      // Compute diagonal for MatFree on device (no matrix assembly)
+      operators[i]->compute_diag_inverse();
 
       err_check(hipDeviceSynchronize());
     }
+    else if constexpr (std::is_same_v<FineOperator, acc::ElementMatrixOperator<T>>)
+    {
+      maps[i] = V[i]->dofmap()->index_map;
+      operators[i]
+          = std::make_shared<acc::ElementMatrixOperator<T>>(a_i, bc_i, lcells[i], bcells[i]);
+    }
     else
     {
       operators[i] = std::make_shared<acc::MatrixOperator<T>>(a_i, bc_i);
@@ -295,70 +429,368 @@ void solve(std::shared_ptr<mesh::Mesh<double>> mesh, bool use_amg, bool output_t
 
   spdlog::info("Create Chebyshev smoothers");
 
-  // Create chebyshev smoother for each level
+  // Create chebyshev smoother for each level. Eigenvalue estimates are
+  // reused from previous runs of the same configuration if available.
+  const int lanczos_its = 20;
+  const T lanczos_tol = 1e-3;
+  std::unique_ptr<acc::EigenvalueCache<T>> eig_cache;
+  if (options.use_eig_cache)
+  {
+    eig_cache = std::make_unique<acc::EigenvalueCache<T>>(mesh->comm(), "eigenvalues.cache");
+    if (options.clear_eig_cache)
+      eig_cache->clear();
+  }
+  // Smoother degree and eigenvalue bounds, from a previous autotuning run if available
+  acc::SmootherSettingsFile<T> settings_file(mesh->comm(), "smoothers.settings");
+  std::vector<acc::ChebyshevSettings<T>> settings(V.size());
+  std::vector<std::string> settings_keys(V.size());
+  std::vector<T> lmax(V.size());
   std::vector<std::shared_ptr<acc::Chebyshev<DeviceVector>>> smoothers(V.size());
   for (std::size_t i = 0; i < V.size(); i++)
   {
-    dolfinx::acc::CGSolver<DeviceVector> cg(maps[i], 1);
-    cg.set_max_iterations(20);
-    cg.set_tolerance(1e-6);
-    cg.store_coefficients(true);
-
-    DeviceVector x(maps[i], 1);
-
-    spdlog::debug("map local size = {}, ghost size = {}", maps[i]->size_local(),
-                  maps[i]->num_ghosts());
-
-    x.set(T{0.0});
-    DeviceVector y(maps[i], 1);
-    y.set(T{1.0});
-
-    [[maybe_unused]] int its = cg.solve(*operators[i], x, y, false);
-    std::vector<T> eign = cg.compute_eigenvalues();
-    std::sort(eign.begin(), eign.end());
-    spdlog::info("Eigenvalues level {}: {} - {}", i, eign.front(), eign.back());
-    std::array<T, 2> eig_range = {0.1 * eign.back(), 1.1 * eign.back()};
-    smoothers[i] = std::make_shared<acc::Chebyshev<DeviceVector>>(maps[i], 1, eig_range);
-    smoothers[i]->set_max_iterations(2);
+    // The key covers the per-cell constants and the estimator settings
+    std::string key;
+    if (eig_cache)
+      key = eig_cache->key(ndofs[i], order[i], i, host_constants[mesh_index(i)], lanczos_its,
+                           lanczos_tol);
+    std::array<T, 2> eig;
+    if (!eig_cache or !eig_cache->find(key, eig))
+    {
+      acc::LanczosEstimator<DeviceVector> lanczos(maps[i], 1);
+      lanczos.set_max_iterations(lanczos_its);
+      lanczos.set_tolerance(lanczos_tol);
+
+      spdlog::debug("map local size = {}, ghost size = {}", maps[i]->size_local(),
+                    maps[i]->num_ghosts());
+
+      DeviceVector y(maps[i], 1);
+      y.set(T{1.0});
+      eig = lanczos.estimate(*operators[i], y);
+      if (eig_cache)
+        eig_cache->insert(key, eig);
+    }
+    spdlog::info("Eigenvalues level {}: {} - {}", i, eig[0], eig[1]);
+    lmax[i] = eig[1];
+    settings_keys[i] = settings_file.key(ndofs[i], order[i], i, "hip");
+    settings_file.find(settings_keys[i], settings[i]);
+    std::array<T, 2> eig_range = {settings[i].lower * eig[1], settings[i].upper * eig[1]};
+    smoothers[i]
+        = std::make_shared<acc::Chebyshev<DeviceVector>>(maps[i], 1, eig_range, *operators[i]);
+    smoothers[i]->set_max_iterations(settings[i].degree);
+  }
+
+  // Smoother of each level. The Chebyshev smoothers above are also used by
+  // the autotuning and the single precision hierarchy.
+  using SolverType = acc::Smoother<DeviceVector, FineOperator>;
+  std::vector<std::shared_ptr<SolverType>> solvers(V.size());
+  std::vector<thrust::device_vector<std::int8_t>> subdomain_marker(V.size());
+  for (std::size_t i = 0; i < V.size(); i++)
+  {
+    std::array<T, 2> eig_range = {settings[i].lower * lmax[i], settings[i].upper * lmax[i]};
+    if (options.smoother == "chebyshev")
+      solvers[i] = std::make_shared<SolverType>(smoothers[i]);
+    else if (options.smoother == "jacobi" or options.smoother == "gauss-seidel")
+    {
+      if constexpr (std::is_same_v<FineOperator, acc::MatrixOperator<T>>)
+      {
+        if (options.smoother == "jacobi")
+        {
+          auto jacobi = std::make_shared<acc::L1Jacobi<DeviceVector>>(maps[i], 1, *operators[i]);
+          jacobi->set_max_iterations(settings[i].degree);
+          solvers[i] = std::make_shared<SolverType>(jacobi);
+        }
+        else
+        {
+          auto gs = std::make_shared<acc::MulticolorGaussSeidel<DeviceVector>>(maps[i], 1,
+                                                                               *operators[i]);
+          gs->set_max_iterations(settings[i].degree);
+          solvers[i] = std::make_shared<SolverType>(gs);
+        }
+      }
+      else
+        throw std::runtime_error("--smoother " + options.smoother + " requires --operator csr");
+    }
+    else if (options.smoother == "schwarz")
+    {
+      if constexpr (std::is_same_v<FineOperator, acc::MatFreeLaplacian<T>>)
+      {
+        // Local problem on owned and ghost cells, with Dirichlet conditions
+        // on the subdomain interface
+        std::vector<std::int8_t> marker = compute_subdomain_interface(V[i]);
+        for (std::int32_t dof : bcs[i]->dof_indices().first)
+          marker[dof] = 1;
+        subdomain_marker[i] = thrust::device_vector<std::int8_t>(marker.begin(), marker.end());
+        auto schwarz = std::make_shared<acc::SchwarzSmoother<DeviceVector>>(
+            maps[i], 1, eig_range, *operators[i],
+            std::span<const std::int8_t>(thrust::raw_pointer_cast(subdomain_marker[i].data()),
+                                         subdomain_marker[i].size()));
+        schwarz->set_max_iterations(settings[i].degree);
+        solvers[i] = std::make_shared<SolverType>(schwarz);
+      }
+      else
+        throw std::runtime_error("--smoother schwarz requires --operator matfree");
+    }
+    else if (options.smoother == "fdm")
+    {
+      if constexpr (std::is_same_v<FineOperator, acc::MatFreeLaplacian<T>>)
+      {
+        auto fdm = std::make_shared<acc::FDMSmoother<DeviceVector>>(
+            V[i], device_constants[mesh_index(i)], bc_marker_d_span[i]);
+        fdm->set_max_iterations(settings[i].degree);
+        solvers[i] = std::make_shared<SolverType>(fdm);
+      }
+      else
+        throw std::runtime_error("--smoother fdm requires --operator matfree");
+    }
+    else if (options.smoother == "ca-chebyshev")
+    {
+      if constexpr (std::is_same_v<FineOperator, acc::MatFreeLaplacian<T>>)
+      {
+        // Post-smoothing starts from a nonzero guess, which takes one more layer
+        if (settings[i].degree + 1 > options.ghost_layers)
+        {
+          throw std::runtime_error("--smoother ca-chebyshev of degree "
+                                   + std::to_string(settings[i].degree) + " requires "
+                                   + std::to_string(settings[i].degree + 1) + " ghost layers");
+        }
+        auto ca = std::make_shared<acc::CAChebyshev<DeviceVector>>(
+            maps[i], 1, eig_range, *operators[i], bc_marker_d_span[i], options.ghost_layers);
+        ca->set_max_iterations(settings[i].degree);
+        solvers[i] = std::make_shared<SolverType>(ca);
+      }
+      else
+        throw std::runtime_error("--smoother ca-chebyshev requires --operator matfree");
+    }
+    else if (options.smoother == "lor")
+    {
+      // Chebyshev on the low-order-refined matrix of the level, with its own
+      // eigenvalue estimate
+      using LORSolver = acc::Chebyshev<DeviceVector>;
+      auto lor = std::make_shared<acc::MatrixOperator<T>>(
+          acc::create_lor_matrix<T>(*V[i], {bcs[i]}, host_constants[mesh_index(i)]),
+          mesh->comm());
+      acc::LanczosEstimator<DeviceVector> lanczos(maps[i], 1);
+      lanczos.set_max_iterations(lanczos_its);
+      lanczos.set_tolerance(lanczos_tol);
+      DeviceVector y(maps[i], 1);
+      y.set(T{1.0});
+      std::array<T, 2> eig_lor = lanczos.estimate(*lor, y);
+      auto inner = std::make_shared<LORSolver>(
+          maps[i], 1,
+          std::array<T, 2>{settings[i].lower * eig_lor[1], settings[i].upper * eig_lor[1]}, *lor);
+      inner->set_max_iterations(settings[i].degree);
+      solvers[i] = std::make_shared<SolverType>(
+          std::make_shared<acc::LORSmoother<DeviceVector, LORSolver>>(maps[i], 1, lor, inner));
+    }
+    else
+      throw std::runtime_error("Unknown smoother: " + options.smoother);
   }
 
-  // Create Prolongation operator
-  std::vector<std::shared_ptr<acc::MatrixOperator<T>>> prolongation(V.size() - 1);
+  using CSRType = acc::MatrixOperator<T>;
+  using TransferType = acc::TransferOperator<T, CSRType>;
+
+  // Create Prolongation operator. The assembled matrices are also needed by
+  // the single precision hierarchy.
+  std::vector<std::shared_ptr<CSRType>> prolongation(V.size() - 1);
+  std::vector<std::shared_ptr<TransferType>> transfers(V.size() - 1);
 
   // From V1 to V0
   spdlog::warn("Creating Prolongation Operators");
   for (int i = 0; i < V.size() - 1; ++i)
-    prolongation[i] = std::make_shared<acc::MatrixOperator<T>>(*V[i], *V[i + 1]);
+  {
+    const bool h_level = V[i]->mesh() != V[i + 1]->mesh();
+    if (h_level)
+    {
+      // h-levels: trilinear interpolation from the coarser mesh
+      prolongation[i] = std::make_shared<CSRType>(acc::create_h_prolongation(*V[i], *V[i + 1]),
+                                                  mesh->comm());
+    }
+    else if (!options.matfree_transfer or options.mixed_precision)
+      prolongation[i] = std::make_shared<CSRType>(*V[i], *V[i + 1]);
 
-  using CSRType = acc::MatrixOperator<T>;
-  using SolverType = acc::Chebyshev<DeviceVector>;
+    if (options.matfree_transfer and !h_level)
+    {
+      transfers[i] = std::make_shared<TransferType>(
+          std::make_shared<Interpolator<T>>(*V[i], *V[i + 1], lcells[i + 1], bcells[i + 1]));
+    }
+    else
+      transfers[i] = std::make_shared<TransferType>(prolongation[i]);
+  }
 
-  using PMG = acc::MultigridPreconditioner<DeviceVector, FineOperator, CSRType, CSRType, SolverType,
-                                           CoarseSolverType<T>>;
+  using PMG = acc::MultigridPreconditioner<DeviceVector, FineOperator, TransferType, TransferType,
+                                           SolverType, CoarseSolverType<T>>;
 
   spdlog::info("Create PMG");
   PMG pmg(maps, 1, bc_marker_d_span[0]);
-  pmg.set_solvers(smoothers);
+  pmg.set_solvers(solvers);
   pmg.set_operators(operators);
   spdlog::info("Set Coarse Solver");
   pmg.set_coarse_solver(coarse_solver);
 
   // Sets CSR matrices or matrix-free kernels to do interpolation
-  pmg.set_interpolators(prolongation);
+  pmg.set_interpolators(transfers);
+  pmg.set_cycle(options.cycle);
+
+  // Krylov acceleration of the coarse-grid correction on intermediate levels
+  std::vector<int> kcycle_levels;
+  if (options.kcycle)
+    for (std::size_t i = 1; i + 1 < V.size(); i++)
+      kcycle_levels.push_back(i);
+  pmg.set_kcycle_levels(kcycle_levels);
+  pmg.set_monitor(options.monitor);
+
+  if (options.autotune)
+  {
+    // Try a grid of smoother degrees and lower eigenvalue bounds on each level,
+    // and store the best settings for later runs
+    acc::tune_chebyshev(pmg, *operators.back(), smoothers, lmax, *bs.back(), settings,
+                        {1, 2, 3, 4}, {T(0.05), T(0.1), T(0.2), T(0.3)}, 3);
+    for (std::size_t i = 0; i < V.size(); i++)
+      settings_file.insert(settings_keys[i], settings[i]);
+  }
 
   // Create solution vector
   spdlog::info("Create x");
   DeviceVector x(maps.back(), 1);
   x.set(T{0.0});
 
-  int niter = 10;
-  for (int i = 0; i < niter; i++)
+  // Flexible CG preconditioned by one PMG cycle (from a zero initial guess)
+  pmg.set_zero_initial_guess(true);
+  acc::CGSolver<DeviceVector> cg(maps.back(), 1);
+  cg.set_max_iterations(50);
+  cg.set_tolerance(1e-8);
+  cg.set_flexible(true);
+  int its = 0;
+  if (options.krylov == "pipelined")
+  {
+    // Pipelined CG, with the PMG cycle overlapping the reduction of each
+    // iteration. The cycle is a fixed symmetric preconditioner (no K-cycle,
+    // see the option checks in main).
+    acc::PipelinedCGSolver<DeviceVector> pcg(maps.back(), 1);
+    pcg.set_max_iterations(50);
+    pcg.set_tolerance(1e-8);
+    its = pcg.solve(*operators.back(), pmg, x, *bs.back(), true);
+  }
+  else if (options.krylov == "sstep")
+  {
+    // Jacobi-preconditioned s-step CG, with the Chebyshev basis on the
+    // spectrum of D^-1 A of the fine level. It needs many more iterations
+    // than the PMG-preconditioned solvers.
+    acc::SStepCGSolver<DeviceVector> scg(maps.back(), 1, options.sstep,
+                                         {T(0), settings.back().upper * lmax.back()});
+    scg.set_max_iterations(2000 / options.sstep);
+    scg.set_tolerance(1e-8);
+    its = scg.solve(*operators.back(), x, *bs.back(), true);
+  }
+  else if (options.krylov == "block")
+  {
+    // Jacobi-preconditioned block CG on b and perturbed copies of it,
+    // b_j = b (1 + sin(j g) / 2) on dof g, stored as one multi-vector.
+    // Column 0 is the solution for b.
+    if constexpr (std::is_same_v<FineOperator, acc::ElementMatrixOperator<T>>)
+      throw std::runtime_error("--krylov block requires --operator matfree or csr");
+    else
+    {
+      const int ncols = options.block_columns;
+      const std::int32_t size_local = maps.back()->size_local();
+      const std::int64_t offset = maps.back()->local_range()[0];
+      std::vector<T> b_host = bs.back()->data_copy();
+      la::Vector<T> B_host(maps.back(), ncols);
+      B_host.set(T(0.0));
+      std::span<T> B_values = B_host.mutable_array();
+      for (std::int32_t i = 0; i < size_local; ++i)
+        for (int j = 0; j < ncols; ++j)
+          B_values[i * ncols + j] = b_host[i] * (1 + std::sin(T(j * (offset + i))) / 2);
+
+      DeviceVector B(maps.back(), ncols), X(maps.back(), ncols);
+      B.copy_from_host(B_host);
+      X.set(T{0.0});
+      acc::BlockCGSolver<DeviceVector> bcg(maps.back(), ncols);
+      bcg.set_max_iterations(2000);
+      bcg.set_tolerance(1e-8);
+      its = bcg.solve(*operators.back(), X, B, true);
+
+      std::vector<T> X_host = X.data_copy();
+      la::Vector<T> x_host(maps.back(), 1);
+      std::span<T> x_values = x_host.mutable_array();
+      for (std::int32_t i = 0; i < size_local; ++i)
+        x_values[i] = X_host[i * ncols];
+      x.copy_from_host(x_host);
+    }
+  }
+  else if (options.krylov != "cg")
+    throw std::runtime_error("Unknown Krylov solver: " + options.krylov);
+  else if (!options.mixed_precision)
+    its = cg.solve(*operators.back(), pmg, x, *bs.back(), true);
+  else if constexpr (std::is_same_v<FineOperator, acc::MatrixOperator<T>>)
+  {
+    // Single precision copy of the hierarchy (operators, transfers and
+    // smoothers), used as the preconditioner of the double precision CG. The
+    // coarse level is solved by its smoother.
+    if (options.use_amg)
+      spdlog::warn("Mixed precision: AMG coarse solver not available in single precision");
+
+    using FloatCSR = acc::MatrixOperator<float>;
+    using FloatSolver = acc::Chebyshev<FloatVector>;
+    using FloatPMG = acc::MultigridPreconditioner<FloatVector, FloatCSR, FloatCSR, FloatCSR,
+                                                  FloatSolver, void>;
+
+    std::vector<std::shared_ptr<FloatCSR>> operators_f(V.size());
+    std::vector<std::shared_ptr<FloatSolver>> smoothers_f(V.size());
+    for (std::size_t i = 0; i < V.size(); i++)
+    {
+      operators_f[i] = std::make_shared<FloatCSR>(*operators[i]);
+      std::array<float, 2> eig_range
+          = {float(settings[i].lower * lmax[i]), float(settings[i].upper * lmax[i])};
+      smoothers_f[i] = std::make_shared<FloatSolver>(maps[i], 1, eig_range, *operators_f[i]);
+      smoothers_f[i]->set_max_iterations(settings[i].degree);
+    }
+    std::vector<std::shared_ptr<FloatCSR>> prolongation_f(V.size() - 1);
+    for (std::size_t i = 0; i < V.size() - 1; ++i)
+      prolongation_f[i] = std::make_shared<FloatCSR>(*prolongation[i]);
+
+    auto pmg_f = std::make_shared<FloatPMG>(maps, 1, bc_marker_d_span[0]);
+    pmg_f->set_solvers(smoothers_f);
+    pmg_f->set_operators(operators_f);
+    pmg_f->set_interpolators(prolongation_f);
+    pmg_f->set_zero_initial_guess(true);
+    pmg_f->set_cycle(options.cycle);
+    pmg_f->set_kcycle_levels(kcycle_levels);
+    pmg_f->set_monitor(options.monitor);
+
+    acc::MixedPrecisionPreconditioner<DeviceVector, FloatVector, FloatPMG> M(maps.back(), 1,
+                                                                             pmg_f);
+    its = cg.solve(*operators.back(), M, x, *bs.back(), true);
+  }
+  else
+    throw std::runtime_error("Mixed precision is only supported with --operator csr");
+  spdlog::info("Number of PMG-CG iterations {}", its);
+
+  if (options.kappa_update != T(1))
   {
-    pmg.apply(*bs.back(), x, true);
-    // spdlog::info("------ end of iteration ------");
+    // Change kappa uniformly and update the hierarchy in place, without
+    // rebuilding operators, transfers, smoothers or the coarse solver. The
+    // RHS is kept, so the new solution is x / kappa_update. Non-uniform
+    // changes of the per-cell constants instead need update_coefficients()
+    // and update_diagonals(), and a new coarse solver (see
+    // test/test_coefficient_update.cpp).
+    spdlog::info("Update kappa by a factor {}", options.kappa_update);
+    kappa->value[0] *= options.kappa_update;
+    pmg.scale_coefficients(options.kappa_update);
+
+    DeviceVector x_new(maps.back(), 1);
+    x_new.set(T{0.0});
+    int its_new = cg.solve(*operators.back(), pmg, x_new, *bs.back(), true);
+    spdlog::info("Number of PMG-CG iterations after update {}", its_new);
+
+    // kappa_update * x_new - x should vanish (up to the solver tolerance)
+    T xnorm = acc::norm(x, dolfinx::la::Norm::l2);
+    acc::axpy(x_new, -options.kappa_update, x_new, x);
+    T err = acc::norm(x_new, dolfinx::la::Norm::l2) / xnorm;
+    spdlog::info("Relative difference of scaled solutions {}", err);
   }
 
-  if (output_to_file)
+  if (options.output_to_file)
   {
     auto u = std::make_shared<fem::Function<T>>(V.back());
     auto xv = x.thrust_vector();
@@ -374,8 +806,37 @@ int main(int argc, char* argv[])
   po::options_description desc("Allowed options");
   desc.add_options()("help,h", "print usage message")(
       "ndofs", po::value<std::size_t>()->default_value(50000), "number of dofs per rank")(
-      "amg", po::bool_switch()->default_value(false))("output",
-                                                      po::bool_switch()->default_value(false));
+      "amg", po::bool_switch()->default_value(false))(
+      "output", po::bool_switch()->default_value(false))(
+      "operator", po::value<std::string>()->default_value("matfree"),
+      "operator storage of all levels: matfree, csr or element")(
+      "ghost-layers", po::value<int>()->default_value(1), "number of layers of ghost cells")(
+      "autotune", po::bool_switch()->default_value(false), "tune the smoother settings")(
+      "mixed-precision", po::bool_switch()->default_value(false),
+      "run the multigrid preconditioner in single precision")(
+      "cycle", po::value<std::string>()->default_value("V"), "multigrid cycle: V, W or F")(
+      "kcycle", po::bool_switch()->default_value(false),
+      "Krylov-accelerated coarse-grid correction on intermediate levels")(
+      "monitor", po::bool_switch()->default_value(false),
+      "log the residual norm after each phase of the multigrid cycle")(
+      "degree", po::value<int>()->default_value(3), "polynomial degree of the fine level")(
+      "h-levels", po::value<int>()->default_value(0),
+      "number of h-coarsened P1 levels below the p-levels")(
+      "transfer", po::value<std::string>()->default_value("csr"),
+      "transfer between p-levels: csr or matfree")(
+      "kappa-update", po::value<T>()->default_value(1),
+      "scale kappa by this factor after the first solve and solve again")(
+      "no-eig-cache", po::bool_switch()->default_value(false),
+      "always estimate eigenvalues, without reading or writing eigenvalues.cache")(
+      "clear-eig-cache", po::bool_switch()->default_value(false),
+      "discard the estimates stored in eigenvalues.cache")(
+      "smoother", po::value<std::string>()->default_value("chebyshev"),
+      "smoother of all levels: chebyshev, lor, jacobi, gauss-seidel, schwarz, fdm or "
+      "ca-chebyshev")("krylov", po::value<std::string>()->default_value("cg"),
+                      "outer Krylov solver: cg, pipelined, sstep or block")(
+      "sstep", po::value<int>()->default_value(4), "block size of --krylov sstep")(
+      "block-columns", po::value<int>()->default_value(4),
+      "number of right-hand sides of --krylov block");
 
   po::variables_map vm;
   po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
@@ -387,8 +848,46 @@ int main(int argc, char* argv[])
     return 0;
   }
   const std::size_t ndofs = vm["ndofs"].as<std::size_t>();
-  bool use_amg = vm["amg"].as<bool>();
-  bool output_to_file = vm["output"].as<bool>();
+  const std::string operator_type = vm["operator"].as<std::string>();
+  const int ghost_layers = vm["ghost-layers"].as<int>();
+  const std::string cycle_name = vm["cycle"].as<std::string>();
+  const int h_levels = vm["h-levels"].as<int>();
+  const std::string transfer_type = vm["transfer"].as<std::string>();
+  if (transfer_type != "csr" and transfer_type != "matfree")
+    throw std::runtime_error("Unknown transfer type: " + transfer_type);
+
+  SolverOptions options;
+  options.degree = vm["degree"].as<int>();
+  options.use_amg = vm["amg"].as<bool>();
+  options.output_to_file = vm["output"].as<bool>();
+  options.autotune = vm["autotune"].as<bool>();
+  options.mixed_precision = vm["mixed-precision"].as<bool>();
+  options.kcycle = vm["kcycle"].as<bool>();
+  options.monitor = vm["monitor"].as<bool>();
+  options.matfree_transfer = transfer_type == "matfree";
+  options.kappa_update = vm["kappa-update"].as<T>();
+  options.use_eig_cache = !vm["no-eig-cache"].as<bool>();
+  options.clear_eig_cache = vm["clear-eig-cache"].as<bool>();
+  options.smoother = vm["smoother"].as<std::string>();
+  options.ghost_layers = ghost_layers;
+  options.krylov = vm["krylov"].as<std::string>();
+  options.sstep = vm["sstep"].as<int>();
+  options.block_columns = vm["block-columns"].as<int>();
+  if (options.kappa_update != T(1) and options.mixed_precision)
+    throw std::runtime_error("--kappa-update is not supported with --mixed-precision");
+  if (options.smoother != "chebyshev" and (options.autotune or options.mixed_precision))
+    throw std::runtime_error("--autotune and --mixed-precision use Chebyshev smoothers");
+  if (options.krylov != "cg" and (options.kappa_update != T(1) or options.mixed_precision))
+    throw std::runtime_error("--kappa-update and --mixed-precision use --krylov cg");
+  if (options.krylov == "pipelined" and options.kcycle)
+    throw std::runtime_error("--kcycle makes the preconditioner nonlinear, which --krylov "
+                             "pipelined does not support (use --krylov cg)");
+  if (cycle_name == "W")
+    options.cycle = acc::CycleType::W;
+  else if (cycle_name == "F")
+    options.cycle = acc::CycleType::F;
+  else if (cycle_name != "V")
+    throw std::runtime_error("Unknown cycle type: " + cycle_name);
 
   init_logging(argc, argv);
   PetscInitialize(&argc, &argv, nullptr, nullptr);
@@ -397,7 +896,7 @@ int main(int argc, char* argv[])
     int size = 0;
     MPI_Comm_size(comm, &size);
 
-    int max_order = 3; // FIXME
+    const int max_order = options.degree;
 
     double nx_approx = (std::pow(ndofs * size, 1.0 / 3.0) - 1) / max_order;
     std::int64_t n0 = static_cast<int>(nx_approx);
@@ -424,28 +923,51 @@ int main(int argc, char* argv[])
           }
     }
 
+    // The h-coarsened meshes halve the number of cells in each direction
+    if (h_levels > 0)
+    {
+      const std::int64_t m = std::int64_t(1) << h_levels;
+      for (auto& n : nx)
+        n = std::max<std::int64_t>(1, (n + m / 2) / m) * m;
+    }
+
     spdlog::info("Creating mesh of size: {}x{}x{}", nx[0], nx[1], nx[2]);
 
-    // Create mesh
-    std::shared_ptr<mesh::Mesh<T>> mesh;
+    // Create meshes, the h-coarsened meshes (if any) first. These and the fine
+    // mesh are partitioned in blocks of the coarsest grid, so that the
+    // partitions are nested.
+    std::vector<std::shared_ptr<mesh::Mesh<T>>> meshes;
     {
-      mesh::Mesh<T> base_mesh = mesh::create_box<T>(
-          comm, {{{0, 0, 0}, {1, 1, 1}}}, {nx[0], nx[1], nx[2]}, mesh::CellType::hexahedron);
-
       // First order coordinate element
       auto element_1 = std::make_shared<basix::FiniteElement<T>>(basix::create_tp_element<T>(
           basix::element::family::P, basix::cell::type::hexahedron, 1,
           basix::element::lagrange_variant::gll_warped, basix::element::dpc_variant::unset, false));
       dolfinx::fem::CoordinateElement<T> coord_element(element_1);
 
-      mesh = std::make_shared<mesh::Mesh<T>>(ghost_layer_mesh(base_mesh, coord_element));
+      for (int k = h_levels; k >= 0; --k)
+      {
+        std::array<std::int64_t, 3> n = {nx[0] >> k, nx[1] >> k, nx[2] >> k};
+        mesh::Mesh<T> base_mesh
+            = (h_levels == 0)
+                  ? mesh::create_box<T>(comm, {{{0, 0, 0}, {1, 1, 1}}}, n,
+                                        mesh::CellType::hexahedron)
+                  : build_hex<T>(comm, comm, {{{0, 0, 0}, {1, 1, 1}}}, n,
+                                 fem::CoordinateElement<T>(mesh::CellType::hexahedron, 1),
+                                 create_structured_partitioner(n, h_levels - k));
+
+        meshes.push_back(std::make_shared<mesh::Mesh<T>>(
+            ghost_layer_mesh(base_mesh, coord_element, ghost_layers)));
+      }
     }
 
-    // Solve using Matrix-free operators
-    solve<acc::MatFreeLaplacian<T>>(mesh, use_amg, output_to_file);
-
-    // Solve using CSR matrices
-    // solve<acc::MatrixOperator<T>>(mesh, use_amg, output_to_file);
+    if (operator_type == "matfree")
+      solve<acc::MatFreeLaplacian<T>>(meshes, options);
+    else if (operator_type == "csr")
+      solve<acc::MatrixOperator<T>>(meshes, options);
+    else if (operator_type == "element")
+      solve<acc::ElementMatrixOperator<T>>(meshes, options);
+    else
+      throw std::runtime_error("Unknown operator type: " + operator_type);
 
     // Display timings
     dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
@@ -10,7 +10,7 @@ kz = 4
 # Load namespace
 ns = vars()
 forms = []
-for degree in range(1, 4):
+for degree in range(1, 9):
 
     family = basix.ElementFamily.P
     cell_type = basix.CellType.hexahedron
@@ -32,7 +32,7 @@ for degree in range(1, 4):
     aname = 'a' + str(degree)
     Lname = 'L' + str(degree)
 
-    Qdegree = {1:1, 2:3, 3:4}
+    Qdegree = {1:1, 2:3, 3:4, 4:6, 5:8, 6:10, 7:12, 8:14}
 
     # Insert into namespace so that the forms will be named a1, a2, a3 etc.
     dx = Measure("dx", metadata={"quadrature_rule": "GLL", "quadrature_degree": Qdegree[degree]})
@@ -0,0 +1,189 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "vector.hpp"
+#include <cmath>
+#include <dolfinx/common/MPI.h>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+
+using namespace dolfinx;
+
+namespace dolfinx::acc
+{
+
+/// Chebyshev smoother settings for one level: polynomial degree and
+/// eigenvalue bounds as fractions of the estimated lambda_max
+template <typename T>
+struct ChebyshevSettings
+{
+  int degree = 2;
+  T lower = 0.1;
+  T upper = 1.1;
+};
+
+/// Persistent store of tuned smoother settings, as a text file with one line
+/// "key degree lower upper" per level. The file is read and written on rank 0
+/// only, and entries are broadcast to all ranks.
+template <typename T>
+class SmootherSettingsFile
+{
+public:
+  SmootherSettingsFile(MPI_Comm comm, std::string filename) : _comm(comm), _filename(filename)
+  {
+    if (dolfinx::MPI::rank(_comm) == 0)
+    {
+      std::ifstream file(_filename);
+      std::string key;
+      ChebyshevSettings<T> s;
+      while (file >> key >> s.degree >> s.lower >> s.upper)
+        _entries[key] = s;
+    }
+  }
+
+  /// Build a key for a level
+  /// @param num_dofs Global number of dofs on the level
+  /// @param degree Polynomial degree of the level
+  /// @param level Level in the hierarchy
+  /// @param device Name of the device the smoother runs on
+  std::string key(std::int64_t num_dofs, int degree, int level, std::string device) const
+  {
+    std::stringstream s;
+    s << "n" << num_dofs << "-p" << degree << "-l" << level << "-np" << dolfinx::MPI::size(_comm)
+      << "-" << device;
+    return s.str();
+  }
+
+  /// Look up an entry
+  /// @return True if the key was found, in which case `settings` is set
+  /// @note Collective MPI operation
+  bool find(const std::string& key, ChebyshevSettings<T>& settings) const
+  {
+    int found = 0;
+    std::array<T, 2> bounds;
+    if (dolfinx::MPI::rank(_comm) == 0)
+    {
+      if (auto it = _entries.find(key); it != _entries.end())
+      {
+        found = 1;
+        settings = it->second;
+        bounds = {settings.lower, settings.upper};
+      }
+    }
+    MPI_Bcast(&found, 1, MPI_INT, 0, _comm);
+    if (found)
+    {
+      MPI_Bcast(&settings.degree, 1, MPI_INT, 0, _comm);
+      MPI_Bcast(bounds.data(), 2, dolfinx::MPI::mpi_type<T>(), 0, _comm);
+      settings.lower = bounds[0];
+      settings.upper = bounds[1];
+    }
+    return found;
+  }
+
+  /// Add an entry, and append it to the file
+  void insert(const std::string& key, ChebyshevSettings<T> settings)
+  {
+    if (dolfinx::MPI::rank(_comm) == 0)
+    {
+      _entries[key] = settings;
+      std::ofstream file(_filename, std::ios::app);
+      file << key << " " << settings.degree << " " << settings.lower << " " << settings.upper
+           << "\n";
+    }
+  }
+
+private:
+  MPI_Comm _comm;
+  std::string _filename;
+  std::map<std::string, ChebyshevSettings<T>> _entries;
+};
+
+/// Tune the Chebyshev smoother of each level of a multigrid preconditioner.
+/// Levels are tuned one at a time, from the finest to the coarsest, keeping
+/// the others at their current settings. For each candidate degree and
+/// lower bound fraction, `num_cycles` cycles are run from a zero initial
+/// guess and the candidate with the lowest wall time per unit of residual
+/// reduction (time / ln(|r_0| / |r_n|)) is kept.
+/// @param pmg The preconditioner (with the smoothers already set)
+/// @param A Fine level operator (to compute residuals)
+/// @param smoothers The smoothers of each level
+/// @param lmax Estimated largest eigenvalue of D^-1 A on each level
+/// @param b Fine level right-hand side
+/// @param settings Initial settings, updated with the tuned values
+/// @param degrees Candidate polynomial degrees
+/// @param lower_fractions Candidate lower bounds (fractions of lambda_max)
+/// @param num_cycles Number of cycles per candidate
+template <typename Preconditioner, typename Operator, typename Smoother, typename Vector,
+          typename T = typename Vector::value_type>
+void tune_chebyshev(Preconditioner& pmg, Operator& A,
+                    std::vector<std::shared_ptr<Smoother>>& smoothers, const std::vector<T>& lmax,
+                    Vector& b, std::vector<ChebyshevSettings<T>>& settings,
+                    const std::vector<int>& degrees, const std::vector<T>& lower_fractions,
+                    int num_cycles)
+{
+  dolfinx::common::Timer t0("~autotune smoothers");
+
+  MPI_Comm comm = b.map()->comm();
+  Vector x(b.map(), b.bs());
+  Vector r(b.map(), b.bs());
+  const T bnorm = acc::norm(b);
+
+  auto apply = [&](std::size_t level, const ChebyshevSettings<T>& s)
+  {
+    smoothers[level]->set_max_iterations(s.degree);
+    smoothers[level]->set_eig_range({s.lower * lmax[level], s.upper * lmax[level]});
+  };
+
+  for (std::size_t i = 0; i < smoothers.size(); i++)
+    apply(i, settings[i]);
+
+  for (int level = smoothers.size() - 1; level >= 0; level--)
+  {
+    ChebyshevSettings<T> best = settings[level];
+    double best_cost = std::numeric_limits<double>::max();
+    for (int degree : degrees)
+    {
+      for (T lower : lower_fractions)
+      {
+        ChebyshevSettings<T> s = {degree, lower, settings[level].upper};
+        apply(level, s);
+
+        x.set(T{0.0});
+        err_check(hipDeviceSynchronize());
+        MPI_Barrier(comm);
+        double t = MPI_Wtime();
+        for (int c = 0; c < num_cycles; c++)
+          pmg.apply(b, x, false);
+        err_check(hipDeviceSynchronize());
+        double elapsed = MPI_Wtime() - t;
+        MPI_Allreduce(MPI_IN_PLACE, &elapsed, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+        A(x, r);
+        acc::axpy(r, T(-1), r, b);
+        const T rnorm = acc::norm(r);
+        double cost = (rnorm < bnorm) ? elapsed / std::log(bnorm / rnorm)
+                                      : std::numeric_limits<double>::max();
+        spdlog::info("Autotune level {}: degree {}, lower {}: time {}, reduction {}, cost {}",
+                     level, degree, lower, elapsed, rnorm / bnorm, cost);
+
+        if (cost < best_cost)
+        {
+          best_cost = cost;
+          best = s;
+        }
+      }
+    }
+
+    settings[level] = best;
+    apply(level, best);
+    spdlog::info("Autotune level {}: best degree {}, eig range [{}, {}] * lmax", level,
+                 best.degree, best.lower, best.upper);
+  }
+}
+} // namespace dolfinx::acc
@@ -0,0 +1,304 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "cg.hpp"
+#include "vector.hpp"
+#include <dolfinx/common/IndexMap.h>
+#include <dolfinx/common/MPI.h>
+
+#include "amd_gpu.hpp"
+
+using namespace dolfinx;
+
+namespace
+{
+/// Largest number of columns of a multi-vector in the block kernels
+constexpr int max_block_columns = 32;
+
+/// Number of rows loaded to shared memory at a time in block_gram
+constexpr int gram_chunk = 32;
+
+/// Gram matrix of two multi-vectors with `ncols` interleaved columns,
+/// out[a * ncols + b] += sum_i X(i, a) Y(i, b), over the first `num_rows`
+/// rows. Chunks of rows are staged in shared memory and each thread
+/// accumulates up to 4 entries of the (ncols x ncols) result.
+/// @note Launched with 256 threads per block and shared memory
+/// 2 * gram_chunk * ncols * sizeof(T)
+template <typename T>
+static __global__ void block_gram(int num_rows, int ncols, const T* __restrict__ X,
+                                  const T* __restrict__ Y, T* __restrict__ out)
+{
+  extern __shared__ T shm[];
+  T* xs = shm;
+  T* ys = shm + gram_chunk * ncols;
+
+  constexpr int pairs_per_thread = max_block_columns * max_block_columns / 256;
+  const int npairs = ncols * ncols;
+  T sum[pairs_per_thread] = {0};
+
+  for (int row0 = blockIdx.x * gram_chunk; row0 < num_rows; row0 += gridDim.x * gram_chunk)
+  {
+    const int nrows = min(gram_chunk, num_rows - row0);
+    for (int i = threadIdx.x; i < nrows * ncols; i += blockDim.x)
+    {
+      xs[i] = X[row0 * ncols + i];
+      ys[i] = Y[row0 * ncols + i];
+    }
+    __syncthreads();
+
+#pragma unroll
+    for (int k = 0; k < pairs_per_thread; ++k)
+    {
+      const int p = threadIdx.x + k * blockDim.x;
+      if (p < npairs)
+      {
+        const int a = p / ncols;
+        const int b = p % ncols;
+        for (int r = 0; r < nrows; ++r)
+          sum[k] += xs[r * ncols + a] * ys[r * ncols + b];
+      }
+    }
+    __syncthreads();
+  }
+
+#pragma unroll
+  for (int k = 0; k < pairs_per_thread; ++k)
+  {
+    const int p = threadIdx.x + k * blockDim.x;
+    if (p < npairs)
+      atomicAdd(&out[p], sum[k]);
+  }
+}
+
+/// Y += s * X C for multi-vectors with `ncols` interleaved columns and a
+/// small (ncols x ncols) row-major matrix C
+template <typename T>
+static __global__ void block_gemm_update(int num_rows, int ncols, const T* __restrict__ X,
+                                         const T* __restrict__ C, T* __restrict__ Y, T s)
+{
+  int t = blockIdx.x * blockDim.x + threadIdx.x;
+  int i = t / ncols;
+  int c = t % ncols;
+  if (i < num_rows)
+  {
+    T v = 0;
+    for (int k = 0; k < ncols; ++k)
+      v += X[i * ncols + k] * C[k * ncols + c];
+    Y[i * ncols + c] += s * v;
+  }
+}
+
+/// Z = D^-1 R for a multi-vector (the same diagonal for all columns)
+template <typename T>
+static __global__ void block_jacobi(int num_rows, int ncols, const T* __restrict__ dinv,
+                                    const T* __restrict__ R, T* __restrict__ Z)
+{
+  int t = blockIdx.x * blockDim.x + threadIdx.x;
+  if (t < num_rows * ncols)
+    Z[t] = dinv[t / ncols] * R[t];
+}
+} // namespace
+
+namespace dolfinx::acc
+{
+
+/// Jacobi-preconditioned block conjugate gradient method (O'Leary) for
+/// several right-hand sides. Multi-vectors are acc::Vector objects with
+/// block size equal to the number of columns (interleaved storage), so that
+/// operators that accept them (MatFreeLaplacian, MatrixOperator) load each
+/// geometry factor or matrix entry once for all columns. The search space is
+/// shared between the right-hand sides, and all inner products of an
+/// iteration are computed as two small Gram matrices.
+template <typename Vector>
+class BlockCGSolver
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  /// Create a solver
+  /// @param map Index map (of a single column)
+  /// @param ncols Number of right-hand sides (at most 32)
+  BlockCGSolver(std::shared_ptr<const common::IndexMap> map, int ncols)
+      : _map{map}, _ncols{ncols}
+  {
+    if (ncols < 1 or ncols > max_block_columns)
+      throw std::runtime_error("BlockCG: unsupported number of columns "
+                               + std::to_string(ncols));
+
+    _R = std::make_unique<Vector>(_map, _ncols);
+    _Z = std::make_unique<Vector>(_map, _ncols);
+    _P = std::make_unique<Vector>(_map, _ncols);
+    _Q = std::make_unique<Vector>(_map, _ncols);
+    _diag_inv = std::make_unique<Vector>(_map, 1);
+    _gram = thrust::device_vector<T>(_ncols * _ncols);
+    _coeffs = thrust::device_vector<T>(_ncols * _ncols);
+  }
+
+  void set_max_iterations(int max_iter) { _max_iter = max_iter; }
+  void set_tolerance(double tolerance) { _rtol = tolerance; }
+
+  /// Solve AX = B for all columns of B
+  /// @return Number of iterations
+  template <typename Operator>
+  int solve(Operator& A, Vector& X, const Vector& B, bool verbose = false)
+  {
+    dolfinx::common::Timer t0("~BlockCG solve");
+
+    const int rank = dolfinx::MPI::rank(_map->comm());
+    const int nc = _ncols;
+
+    A.get_diag_inverse(*_diag_inv);
+
+    // R = B - AX, Z = D^-1 R, P = Z
+    A(X, *_Q);
+    acc::axpy(*_R, T(-1), *_Q, B);
+    precondition();
+    acc::copy(*_P, *_Z);
+
+    // rho = Z^T R
+    std::vector<T> rho = gram(*_Z, *_R);
+    std::vector<T> rho0(nc);
+    for (int c = 0; c < nc; ++c)
+      rho0[c] = rho[c * nc + c];
+
+    const T rtol2 = _rtol * _rtol;
+    std::vector<T> L(nc * nc), coeffs(nc * nc);
+
+    int k = 0;
+    while (k < _max_iter)
+    {
+      ++k;
+
+      // Q = AP, alpha = (P^T Q)^-1 rho
+      A(*_P, *_Q);
+      L = gram(*_P, *_Q);
+      if (!cholesky(L, nc))
+      {
+        spdlog::warn("BlockCG: P^T A P is singular at iteration {} (converged columns?)", k);
+        break;
+      }
+      coeffs = rho;
+      solve_columns(L, coeffs);
+
+      // X += P alpha, R -= Q alpha
+      gemm_update(*_P, coeffs, X, T(1));
+      gemm_update(*_Q, coeffs, *_R, T(-1));
+
+      // Z = D^-1 R, rho_new = Z^T R
+      precondition();
+      std::vector<T> rho_new = gram(*_Z, *_R);
+
+      T ratio = 0;
+      for (int c = 0; c < nc; ++c)
+        ratio = std::max(ratio, rho_new[c * nc + c] / rho0[c]);
+      if (rank == 0 and verbose)
+        std::cout << "Iteration " << k << " max relative residual " << std::sqrt(ratio)
+                  << std::endl;
+      if (ratio < rtol2)
+        break;
+
+      // beta = rho^-1 rho_new, P = Z + P beta (computed in Z, then swapped)
+      L = rho;
+      if (!cholesky(L, nc))
+      {
+        spdlog::warn("BlockCG: Z^T R is singular at iteration {} (converged columns?)", k);
+        break;
+      }
+      coeffs = rho_new;
+      solve_columns(L, coeffs);
+      gemm_update(*_P, coeffs, *_Z, T(1));
+      std::swap(_P, _Z);
+
+      rho = rho_new;
+    }
+
+    return k;
+  }
+
+private:
+  /// C <- (L L^T)^-1 C, column by column
+  void solve_columns(const std::vector<T>& L, std::vector<T>& C)
+  {
+    const int nc = _ncols;
+    std::vector<T> col(nc);
+    for (int c = 0; c < nc; ++c)
+    {
+      for (int i = 0; i < nc; ++i)
+        col[i] = C[i * nc + c];
+      cholesky_solve(L, nc, col.data());
+      for (int i = 0; i < nc; ++i)
+        C[i * nc + c] = col[i];
+    }
+  }
+
+  /// Z = D^-1 R
+  void precondition()
+  {
+    const int N = _map->size_local() * _ncols;
+    dim3 block_size(512);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+    hipLaunchKernelGGL(block_jacobi<T>, grid_size, block_size, 0, 0, _map->size_local(), _ncols,
+                       _diag_inv->array().data(), _R->array().data(),
+                       _Z->mutable_array().data());
+    err_check(hipGetLastError());
+  }
+
+  /// Gram matrix X^T Y of two multi-vectors (owned rows)
+  /// @note Collective MPI operation
+  std::vector<T> gram(const Vector& X, const Vector& Y)
+  {
+    const int num_rows = _map->size_local();
+    thrust::fill(thrust::device, _gram.begin(), _gram.end(), T{0.0});
+    dim3 block_size(256);
+    dim3 grid_size(std::max(1, std::min((num_rows + gram_chunk - 1) / gram_chunk, 256)));
+    std::size_t shm_size = 2 * gram_chunk * _ncols * sizeof(T);
+    hipLaunchKernelGGL(block_gram<T>, grid_size, block_size, shm_size, 0, num_rows, _ncols,
+                       X.array().data(), Y.array().data(), thrust::raw_pointer_cast(_gram.data()));
+    err_check(hipGetLastError());
+
+    std::vector<T> out(_ncols * _ncols);
+    thrust::copy(_gram.begin(), _gram.end(), out.begin());
+    MPI_Allreduce(MPI_IN_PLACE, out.data(), out.size(), dolfinx::MPI::mpi_type<T>(), MPI_SUM,
+                  _map->comm());
+    return out;
+  }
+
+  /// Y += s * X C
+  void gemm_update(const Vector& X, const std::vector<T>& C, Vector& Y, T s)
+  {
+    thrust::copy(C.begin(), C.end(), _coeffs.begin());
+    const int N = _map->size_local() * _ncols;
+    dim3 block_size(256);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+    hipLaunchKernelGGL(block_gemm_update<T>, grid_size, block_size, 0, 0, _map->size_local(),
+                       _ncols, X.array().data(), thrust::raw_pointer_cast(_coeffs.data()),
+                       Y.mutable_array().data(), s);
+    err_check(hipGetLastError());
+  }
+
+  /// Limit for the number of iterations the solver is allowed to do
+  int _max_iter = 100;
+
+  /// Relative tolerance (for every column)
+  T _rtol = 1e-8;
+
+  // Map describing the data layout of one column
+  std::shared_ptr<const common::IndexMap> _map;
+
+  /// Number of columns
+  int _ncols;
+
+  /// Working multi-vectors
+  std::unique_ptr<Vector> _R, _Z, _P, _Q;
+
+  /// Inverse diagonal (one column)
+  std::unique_ptr<Vector> _diag_inv;
+
+  /// Gram matrix and coefficients on device
+  thrust::device_vector<T> _gram;
+  thrust::device_vector<T> _coeffs;
+};
+} // namespace dolfinx::acc
@@ -0,0 +1,153 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "chebyshev.hpp"
+#include "vector.hpp"
+#include <dolfinx/common/IndexMap.h>
+
+using namespace dolfinx;
+
+namespace dolfinx::acc
+{
+
+/// Communication-avoiding Jacobi-Chebyshev smoother. After a single
+/// exchange of x and b, all iterations are computed redundantly on owned and
+/// ghost dofs with the process-local operator (apply_local), without further
+/// communication. Each operator application invalidates the outermost layer
+/// of ghost cells, so the mesh must have at least max_iter + 1 ghost layers
+/// (max_iter with a zero initial guess), see ghost_layer_mesh.
+template <typename Vector>
+class CAChebyshev
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  /// Create a smoother
+  /// @param map Index map of the level
+  /// @param bs Block size
+  /// @param eig_range Eigenvalue bounds of D^-1 A
+  /// @param A The operator (must provide apply_local)
+  /// @param bc_marker Marker for Dirichlet dofs (on device, owned and ghost)
+  /// @param num_layers Number of ghost cell layers of the mesh
+  template <typename Operator>
+  CAChebyshev(std::shared_ptr<const common::IndexMap> map, int bs, std::array<T, 2> eig_range,
+              Operator& A, std::span<const std::int8_t> bc_marker, int num_layers)
+      : _eig_range(eig_range), _bc_marker(bc_marker), _num_layers(num_layers)
+  {
+    _b = std::make_unique<Vector>(map, bs);
+    _z = std::make_unique<Vector>(map, bs);
+    _q = std::make_unique<Vector>(map, bs);
+    _r = std::make_unique<Vector>(map, bs);
+    _diag_inv = std::make_unique<Vector>(map, bs);
+    update_diagonal(A);
+  }
+
+  void set_max_iterations(int max_iter) { _max_iter = max_iter; }
+
+  /// Fetch the inverse diagonal from the operator. Ghost entries are taken
+  /// from their owners, as the local diagonal is incomplete on the outermost
+  /// ghost layer.
+  template <typename Operator>
+  void update_diagonal(Operator& A)
+  {
+    A.get_diag_inverse(*_diag_inv);
+    _diag_inv->scatter_fwd();
+  }
+
+  /// Update the smoother after the operator has been scaled uniformly by alpha
+  void rescale(T alpha)
+  {
+    std::span<T> d = _diag_inv->mutable_array();
+    thrust::transform(thrust::device, d.begin(), d.end(), _bc_marker.begin(), d.begin(),
+                      [alpha] __host__ __device__(const T& di, const std::int8_t& bc)
+                      { return bc ? di : di / alpha; });
+  }
+
+  /// Solve Ax = b
+  /// @param zero_guess If true, the initial value of x is ignored and
+  /// taken to be zero, which saves one application of A and one layer
+  template <typename Operator>
+  void solve(Operator& A, Vector& x, const Vector& b, bool verbose, bool zero_guess = false)
+  {
+    dolfinx::common::Timer t0("~CAChebyshev solve");
+
+    if (_max_iter + (zero_guess ? 0 : 1) > _num_layers)
+      throw std::runtime_error("CAChebyshev: not enough ghost layers for the number of iterations");
+
+    T lmax = _eig_range[1];
+    const bool optimized = _max_iter <= max_optimized_degree;
+
+    // Owned and ghost entries
+    const int N = _r->array().size();
+    dim3 block_size(512);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+    const T* dinv = _diag_inv->array().data();
+
+    // Single (deep) halo exchange of b and x
+    acc::copy(*_b, b);
+    _b->scatter_fwd_begin();
+    if (!zero_guess)
+      x.scatter_fwd_begin();
+    _b->scatter_fwd_end();
+    if (!zero_guess)
+      x.scatter_fwd_end();
+
+    if (zero_guess)
+    {
+      hipLaunchKernelGGL(chebyshev_init_zero<T>, grid_size, block_size, 0, 0, N,
+                         _b->array().data(), dinv, x.mutable_array().data(),
+                         _r->mutable_array().data(), _z->mutable_array().data(),
+                         T(4.0 / (3.0 * lmax)));
+    }
+    else
+    {
+      A.apply_local(x, *_q, _bc_marker);
+      hipLaunchKernelGGL(chebyshev_init<T>, grid_size, block_size, 0, 0, N, _b->array().data(),
+                         _q->array().data(), dinv, _r->mutable_array().data(),
+                         _z->mutable_array().data(), T(4.0 / (3.0 * lmax)));
+    }
+    err_check(hipGetLastError());
+
+    for (int i = 1; i < _max_iter + 1; i++)
+    {
+      A.apply_local(*_z, *_q, _bc_marker);
+      T beta = optimized ? T(optimized_weights[_max_iter - 1][i - 1]) : T(1.0);
+      hipLaunchKernelGGL(chebyshev_update<T>, grid_size, block_size, 0, 0, N,
+                         _q->array().data(), dinv, x.mutable_array().data(),
+                         _r->mutable_array().data(), _z->mutable_array().data(), beta,
+                         T(2 * i - 1) / T(2 * i + 3), T(8 * i + 4) / T(2 * i + 3) / lmax);
+      err_check(hipGetLastError());
+    }
+
+    if (verbose)
+    {
+      A(x, *_q);
+      acc::axpy(*_q, T(-1), *_q, b);
+      spdlog::info("CAChebyshev: UNPRECONDITIONED residual norm = {}", acc::norm(*_q));
+    }
+  }
+
+private:
+  /// Number of iterations
+  int _max_iter = 2;
+
+  /// Eigenvalues
+  std::array<T, 2> _eig_range;
+
+  /// Marker for Dirichlet dofs
+  std::span<const std::int8_t> _bc_marker;
+
+  /// Number of ghost cell layers
+  int _num_layers;
+
+  /// Working vectors (owned and ghost entries are used)
+  std::unique_ptr<Vector> _b;
+  std::unique_ptr<Vector> _z;
+  std::unique_ptr<Vector> _q;
+  std::unique_ptr<Vector> _r;
+  std::unique_ptr<Vector> _diag_inv;
+};
+} // namespace dolfinx::acc
@@ -1,8 +1,11 @@
 // Copyright (C) 2023 Igor A. Baratta
 // SPDX-License-Identifier:    MIT
 
+#pragma once
+
 #include "vector.hpp"
 #include <algorithm>
+#include <basix/math.h>
 #include <dolfinx/common/IndexMap.h>
 #include <dolfinx/common/MPI.h>
 
@@ -83,6 +86,47 @@ int tqli(T* d, T* e, int n)
   return 0;
 }
 
+/// In-place Cholesky factorisation of a small dense SPD matrix (row-major)
+/// @return False if the matrix is not numerically positive definite
+template <typename T>
+bool cholesky(std::vector<T>& A, int n)
+{
+  for (int j = 0; j < n; ++j)
+  {
+    T d = A[j * n + j];
+    for (int k = 0; k < j; ++k)
+      d -= A[j * n + k] * A[j * n + k];
+    if (d <= 0)
+      return false;
+    A[j * n + j] = std::sqrt(d);
+    for (int i = j + 1; i < n; ++i)
+    {
+      T v = A[i * n + j];
+      for (int k = 0; k < j; ++k)
+        v -= A[i * n + k] * A[j * n + k];
+      A[i * n + j] = v / A[j * n + j];
+    }
+  }
+  return true;
+}
+
+/// Solve L L^T x = b in place, with L from cholesky
+template <typename T>
+void cholesky_solve(const std::vector<T>& L, int n, T* b)
+{
+  for (int i = 0; i < n; ++i)
+  {
+    for (int k = 0; k < i; ++k)
+      b[i] -= L[i * n + k] * b[k];
+    b[i] /= L[i * n + i];
+  }
+  for (int i = n - 1; i >= 0; --i)
+  {
+    for (int k = i + 1; k < n; ++k)
+      b[i] -= L[k * n + i] * b[k];
+    b[i] /= L[i * n + i];
+  }
+}
 } // namespace
 
 namespace dolfinx::acc
@@ -101,6 +145,7 @@ public:
     _r = std::make_unique<Vector>(_map, _bs);
     _y = std::make_unique<Vector>(_map, _bs);
     _p = std::make_unique<Vector>(_map, _bs);
+    _z = std::make_unique<Vector>(_map, _bs);
     _diag_inv = std::make_unique<Vector>(_map, _bs);
   }
 
@@ -113,6 +158,42 @@ public:
   }
   void set_tolerance(double tolerance) { _rtol = tolerance; }
 
+  /// Use the flexible (Polak-Ribiere) variant, which tolerates a
+  /// preconditioner that changes between iterations or is not symmetric
+  void set_flexible(bool flexible) { _flexible = flexible; }
+
+  /// Recycle approximate eigenvectors of M^-1 A across solves with the same
+  /// operator (deflated CG). The Ritz vectors of the `num_vectors` smallest
+  /// eigenvalues are computed from the Lanczos coefficients and preconditioned
+  /// residuals of the first `num_harvest` iterations of a solve, and are
+  /// projected out of the following solves.
+  /// @note Harvesting assumes a fixed symmetric preconditioner (not flexible)
+  void set_deflation(int num_vectors, int num_harvest)
+  {
+    if (num_harvest <= num_vectors)
+      throw std::runtime_error("CG deflation: num_harvest must exceed num_vectors");
+    _num_deflation = num_vectors;
+    _num_harvest = num_harvest;
+    clear_deflation_space();
+
+    // Lanczos basis of the harvest iterations, allocated once
+    _lanczos.clear();
+    for (int i = 0; i < num_harvest; ++i)
+      _lanczos.push_back(std::make_unique<Vector>(_map, _bs));
+  }
+
+  /// Discard the deflation vectors (e.g. after the operator has changed). A
+  /// new set is harvested from the next solve.
+  void clear_deflation_space()
+  {
+    _W.clear();
+    _AW.clear();
+    _E.clear();
+  }
+
+  /// Number of vectors currently deflated
+  int num_deflation_vectors() const { return _W.size(); }
+
   void store_coefficients(bool val) { _store_coeffs = val; }
 
   std::vector<T> alphas() { return _alphas; }
@@ -143,26 +224,85 @@ public:
 
   T residual() const { return _residuals.back(); }
 
-  // Solve Ax = b
+  /// Solve Ax = b with Jacobi preconditioning
   template <typename Operator>
   int solve(Operator& A, Vector& x, const Vector& b, bool verbose = false)
+  {
+    A.get_diag_inverse(*_diag_inv);
+    return solve_impl(
+        A, [&](const Vector& in, Vector& out) { acc::pointwise_mult(out, in, *_diag_inv); }, x,
+        b, verbose);
+  }
+
+  /// Solve Ax = b with preconditioner M, which must provide
+  /// `apply(const Vector& r, Vector& z)` computing z = M^-1 r, e.g. a
+  /// MultigridPreconditioner set to use a zero initial guess. Use the
+  /// flexible variant if M is not a fixed symmetric operator.
+  template <typename Operator, typename Preconditioner>
+  int solve(Operator& A, Preconditioner& M, Vector& x, const Vector& b, bool verbose = false)
+  {
+    return solve_impl(
+        A, [&](const Vector& in, Vector& out) { M.apply(in, out); }, x, b, verbose);
+  }
+
+private:
+  template <typename Operator, typename Precondition>
+  int solve_impl(Operator& A, Precondition&& precondition, Vector& x, const Vector& b,
+                 bool verbose)
   {
     MPI_Comm comm = _map->comm();
     int rank;
     MPI_Comm_rank(comm, &rank);
 
-    A.get_diag_inverse(*_diag_inv);
-
     // TODO: check sizes
 
     // Compute initial residual r0 = b - Ax0
     A(x, *_y);
     axpy(*_r, T(-1), *_y, b);
-    acc::pointwise_mult(*_p, *_r, *_diag_inv);
 
-    T rnorm0 = inner_product(*_p, *_r);
+    // With deflation, x0 <- x0 + W E^-1 W^T r0 and r0 <- r0 - AW E^-1 W^T r0,
+    // so that W^T r0 = 0
+    const int nw = _W.size();
+    std::vector<T> mu(nw);
+    if (nw > 0)
+    {
+      for (int i = 0; i < nw; ++i)
+        mu[i] = inner_product_local(*_W[i], *_r);
+      MPI_Allreduce(MPI_IN_PLACE, mu.data(), nw, dolfinx::MPI::mpi_type<T>(), MPI_SUM, comm);
+      cholesky_solve(_E, nw, mu.data());
+      for (int i = 0; i < nw; ++i)
+      {
+        acc::axpy(x, mu[i], *_W[i], x);
+        acc::axpy(*_r, -mu[i], *_AW[i], *_r);
+      }
+    }
+
+    // Project p = z - W E^-1 (AW)^T z, with a single reduction
+    auto deflate = [&](Vector& p)
+    {
+      if (nw == 0)
+        return;
+      for (int i = 0; i < nw; ++i)
+        mu[i] = inner_product_local(*_AW[i], *_z);
+      MPI_Allreduce(MPI_IN_PLACE, mu.data(), nw, dolfinx::MPI::mpi_type<T>(), MPI_SUM, comm);
+      cholesky_solve(_E, nw, mu.data());
+      for (int i = 0; i < nw; ++i)
+        acc::axpy(p, -mu[i], *_W[i], p);
+    };
+
+    precondition(*_r, *_z);
+    acc::copy(*_p, *_z);
+    deflate(*_p);
+
+    T rnorm0 = inner_product(*_z, *_r);
     T rnorm = rnorm0;
 
+    // Number of Lanczos vectors and coefficients for harvesting deflation
+    // vectors
+    const bool harvest = (_num_deflation > 0 and nw == 0);
+    int num_lanczos = 0;
+    std::vector<T> h_alphas, h_betas;
+
     spdlog::info("CG: rnorm0 = {}", rnorm0);
 
     // Iterations of CG
@@ -174,6 +314,15 @@ public:
       add_profiling_annotation("cg solver iteration");
       ++k;
 
+      // Lanczos vector (-1)^j z_j / sqrt(r_j.z_j)
+      if (harvest and k <= _num_harvest)
+      {
+        Vector& v = *_lanczos[num_lanczos++];
+        const T sign = (k % 2 == 1) ? 1 : -1;
+        acc::copy(v, *_z);
+        acc::scale(v, sign / std::sqrt(rnorm));
+      }
+
       // MatVec
       // y = A.p;
       A(*_p, *_y);
@@ -188,14 +337,21 @@ public:
       // Update r (r <- r - alpha*y)
       acc::axpy(*_r, -alpha, *_y, *_r);
 
-      // Using y as a temporary for M^-1(r)
-      acc::pointwise_mult(*_y, *_r, *_diag_inv);
+      // z = M^-1(r)
+      precondition(*_r, *_z);
 
-      // Update residual norm
-      const T rnorm_new = inner_product(*_r, *_y);
-      const T beta = rnorm_new / rnorm;
+      // Update residual norm. The flexible (Polak-Ribiere) beta is
+      // z_new.(r_new - r_old) / z_old.r_old, with r_new - r_old = -alpha*y.
+      const T rnorm_new = inner_product(*_r, *_z);
+      const T beta = _flexible ? -alpha * inner_product(*_z, *_y) / rnorm : rnorm_new / rnorm;
       rnorm = rnorm_new;
 
+      if (harvest and k <= _num_harvest)
+      {
+        h_alphas.push_back(alpha);
+        h_betas.push_back(beta);
+      }
+
       if (rank == 0 and verbose)
       {
         std::cout << "Iteration " << k << " residual " << std::sqrt(rnorm) << std::endl;
@@ -208,7 +364,8 @@ public:
 
       // Update p.
       // Update p (p <- beta*p + M^-1(r))
-      axpy(*_p, beta, *_p, *_y);
+      axpy(*_p, beta, *_p, *_z);
+      deflate(*_p);
 
       if (_store_coeffs)
       {
@@ -218,15 +375,74 @@ public:
       }
       remove_profiling_annotation("cg solver iteration");
     }
+
+    if (harvest)
+      compute_deflation_space(A, num_lanczos, h_alphas, h_betas);
+
     return k;
   }
 
-private:
+  /// Compute the deflation vectors W (Ritz vectors of the smallest
+  /// eigenvalues of the Lanczos tridiagonal matrix), AW and the Cholesky
+  /// factor of E = W^T A W, from the first `num_lanczos` vectors of the
+  /// Lanczos basis
+  template <typename Operator>
+  void compute_deflation_space(Operator& A, int num_lanczos, const std::vector<T>& alphas,
+                               const std::vector<T>& betas)
+  {
+    dolfinx::common::Timer t0("~CG deflation space");
+
+    const int m = std::min<int>(num_lanczos, alphas.size());
+    const int nw = std::min(_num_deflation, m - 1);
+    if (nw < 1)
+      return;
+
+    // Lanczos tridiagonal matrix (dense)
+    std::vector<T> Tm(m * m, 0);
+    for (int i = 0; i < m; ++i)
+      Tm[i * m + i] = 1.0 / alphas[i];
+    for (int i = 0; i < m - 1; ++i)
+    {
+      Tm[(i + 1) * m + i + 1] += betas[i] / alphas[i];
+      Tm[i * m + i + 1] = Tm[(i + 1) * m + i] = std::sqrt(betas[i]) / alphas[i];
+    }
+    auto [evals, evecs] = basix::math::eigh<T>(Tm, m);
+
+    // Ritz vectors, one eigenvector of Tm per column of evecs
+    for (int a = 0; a < nw; ++a)
+    {
+      _W.push_back(std::make_unique<Vector>(_map, _bs));
+      _AW.push_back(std::make_unique<Vector>(_map, _bs));
+      _W.back()->set(T{0.0});
+      for (int j = 0; j < m; ++j)
+        acc::axpy(*_W.back(), evecs[a * m + j], *_lanczos[j], *_W.back());
+      A(*_W.back(), *_AW.back());
+    }
+
+    // E = W^T A W, with a single reduction
+    _E.resize(nw * nw);
+    for (int i = 0; i < nw; ++i)
+      for (int j = 0; j < nw; ++j)
+        _E[i * nw + j] = inner_product_local(*_W[i], *_AW[j]);
+    MPI_Allreduce(MPI_IN_PLACE, _E.data(), _E.size(), dolfinx::MPI::mpi_type<T>(), MPI_SUM,
+                  _map->comm());
+    if (!cholesky(_E, nw))
+    {
+      spdlog::warn("CG deflation: W^T A W is not positive definite, deflation disabled");
+      clear_deflation_space();
+      return;
+    }
+    spdlog::info("CG deflation: {} vectors, Ritz values {} - {}", nw, evals[0], evals[nw - 1]);
+  }
+
   /// Limit for the number of iterations the solver is allowed to do
-  int _max_iter;
+  int _max_iter = 100;
 
   /// Relative tolerance.
-  T _rtol;
+  T _rtol = 1e-8;
+
+  /// Use the flexible (Polak-Ribiere) formula for beta
+  bool _flexible = false;
 
   /// Store coefficients of CG iterations
   bool _store_coeffs = false;
@@ -242,6 +458,19 @@ private:
   std::unique_ptr<Vector> _diag_inv;
   std::unique_ptr<Vector> _y;
   std::unique_ptr<Vector> _p;
+  std::unique_ptr<Vector> _z;
+
+  /// Number of deflation vectors, and of iterations to harvest them from
+  int _num_deflation = 0;
+  int _num_harvest = 0;
+
+  /// Deflation vectors W, AW and the Cholesky factor of W^T A W
+  std::vector<std::unique_ptr<Vector>> _W;
+  std::vector<std::unique_ptr<Vector>> _AW;
+  std::vector<T> _E;
+
+  /// Lanczos basis of the harvest iterations
+  std::vector<std::unique_ptr<Vector>> _lanczos;
 
   // Storage for coefficients of CG iterations (if required)
   std::vector<T> _alphas;
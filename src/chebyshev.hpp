@@ -1,6 +1,8 @@
 // Copyright (C) 2023 Igor A. Baratta
 // SPDX-License-Identifier:    MIT
 
+#pragma once
+
 #include "amd_gpu.hpp"
 #include "vector.hpp"
 #include <algorithm>
@@ -11,10 +13,94 @@
 
 using namespace dolfinx;
 
+namespace
+{
+/// Start of the Chebyshev iteration: r = b - q, z = c0 * D^-1 r
+template <typename T>
+static __global__ void chebyshev_init(int N, const T* __restrict__ b, const T* __restrict__ q,
+                                      const T* __restrict__ dinv, T* __restrict__ r,
+                                      T* __restrict__ z, T c0)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+  {
+    T ri = b[i] - q[i];
+    r[i] = ri;
+    z[i] = c0 * dinv[i] * ri;
+  }
+}
+
+/// Start of the Chebyshev iteration with zero initial guess:
+/// x = 0, r = b, z = c0 * D^-1 b
+template <typename T>
+static __global__ void chebyshev_init_zero(int N, const T* __restrict__ b,
+                                           const T* __restrict__ dinv, T* __restrict__ x,
+                                           T* __restrict__ r, T* __restrict__ z, T c0)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+  {
+    T bi = b[i];
+    x[i] = 0;
+    r[i] = bi;
+    z[i] = c0 * dinv[i] * bi;
+  }
+}
+
+/// One step of the Chebyshev recurrence, with q = A z:
+/// x += beta * z, r -= q, z = c1 * z + c2 * D^-1 r
+template <typename T>
+static __global__ void chebyshev_update(int N, const T* __restrict__ q,
+                                        const T* __restrict__ dinv, T* __restrict__ x,
+                                        T* __restrict__ r, T* __restrict__ z, T beta, T c1,
+                                        T c2)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+  {
+    T zi = z[i];
+    T ri = r[i] - q[i];
+    x[i] += beta * zi;
+    r[i] = ri;
+    z[i] = c1 * zi + c2 * dinv[i] * ri;
+  }
+}
+
+/// chebyshev_update that also updates the residual of x, rt -= beta * q
+template <typename T>
+static __global__ void chebyshev_update_residual(int N, const T* __restrict__ q,
+                                                 const T* __restrict__ dinv, T* __restrict__ x,
+                                                 T* __restrict__ r, T* __restrict__ z,
+                                                 T* __restrict__ rt, T beta, T c1, T c2)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+  {
+    T zi = z[i];
+    T qi = q[i];
+    T ri = r[i] - qi;
+    x[i] += beta * zi;
+    r[i] = ri;
+    rt[i] -= beta * qi;
+    z[i] = c1 * zi + c2 * dinv[i] * ri;
+  }
+}
+
+/// Weights beta_i (i = 1, ..., k) of the optimised fourth kind Chebyshev
+/// smoother of degree k, from Lottes (2022) https://arxiv.org/abs/2202.08830.
+/// Row k - 1 holds the k weights for degree k.
+constexpr int max_optimized_degree = 4;
+constexpr double optimized_weights[max_optimized_degree][max_optimized_degree]
+    = {{1.12500000000000, 0, 0, 0},
+       {1.02387287570313, 1.26408905371085, 0, 0},
+       {1.00842544782028, 1.08867839208730, 1.33753125909618, 0},
+       {1.00391310427285, 1.04035811188593, 1.14863498546254, 1.38268869241000}};
+} // namespace
+
 namespace dolfinx::acc
 {
 
-/// Conjugate gradient method
+/// Jacobi preconditioned Chebyshev smoother
 template <typename Vector>
 class Chebyshev
 {
@@ -22,18 +108,52 @@ class Chebyshev
   using T = typename Vector::value_type;
 
 public:
+  /// Create a smoother. The inverse diagonal is fetched from the operator on
+  /// the first solve and cached.
   Chebyshev(std::shared_ptr<const common::IndexMap> map, int bs, std::array<T, 2> eig_range)
       : _eig_range(eig_range)
   {
-    _p = std::make_unique<Vector>(map, bs);
     _z = std::make_unique<Vector>(map, bs);
     _q = std::make_unique<Vector>(map, bs);
     _r = std::make_unique<Vector>(map, bs);
     _diag_inv = std::make_unique<Vector>(map, bs);
   }
 
+  /// Create a smoother bound to the inverse diagonal of the operator A
+  template <typename Operator>
+  Chebyshev(std::shared_ptr<const common::IndexMap> map, int bs, std::array<T, 2> eig_range,
+            Operator& A)
+      : Chebyshev(map, bs, eig_range)
+  {
+    update_diagonal(A);
+  }
+
   void set_max_iterations(int max_iter) { _max_iter = max_iter; }
 
+  /// Set the eigenvalue bounds of D^-1 A targeted by the smoother
+  void set_eig_range(std::array<T, 2> eig_range) { _eig_range = eig_range; }
+
+  /// Use the optimised fourth kind weights of Lottes, which improve the
+  /// smoothing factor at the same degree (default). They are tabulated for
+  /// up to max_optimized_degree iterations, and the plain fourth kind
+  /// recurrence is used for higher degrees.
+  void set_optimized_weights(bool optimized) { _optimized = optimized; }
+
+  /// Fetch the inverse diagonal from the operator, e.g. after its
+  /// coefficients have been changed
+  template <typename Operator>
+  void update_diagonal(Operator& A)
+  {
+    A.get_diag_inverse(*_diag_inv);
+    _diag_valid = true;
+  }
+
+  /// Update the smoother after the operator has been scaled uniformly by alpha.
+  /// The spectrum of the Jacobi preconditioned operator D^-1 A is invariant under
+  /// this scaling, so the eigenvalue bounds are kept. The cached diagonal is
+  /// fetched again from the operator on the next solve.
+  void rescale(T /*alpha*/) { _diag_valid = false; }
+
   template <typename Operator>
   T residual(Operator& A, Vector& x, const Vector& b)
   {
@@ -42,19 +162,52 @@ public:
     return acc::norm(*_r, dolfinx::la::Norm::l2);
   }
 
-  // Solve Ax = b
+  /// Solve Ax = b
+  /// @param zero_guess If true, the initial value of x is ignored and
+  /// taken to be zero, which saves one application of A
+  /// @param r If not null, set to the residual b - Ax of the returned x
+  /// (owned entries), which saves the caller one application of A
   template <typename Operator>
-  void solve(Operator& A, Vector& x, const Vector& b, bool verbose)
+  void solve(Operator& A, Vector& x, const Vector& b, bool verbose, bool zero_guess = false,
+             Vector* r = nullptr)
   {
     spdlog::info("Chebyshev solve");
     // Using "fourth kind" Chebyshev from Phillips and Fischer https://arxiv.org/pdf/2210.03179
+    // optionally with the optimised weights of Lottes. The weights only enter the
+    // update of x, so with optimised weights r is the residual of the plain
+    // fourth kind iterate, not of x.
     T lmax = _eig_range[1];
+    const bool optimized = _optimized and _max_iter <= max_optimized_degree;
 
-    A.get_diag_inverse(*_diag_inv);
+    if (!_diag_valid)
+      update_diagonal(A);
 
-    // r = b - Ax
-    A(x, *_q);
-    acc::axpy(*_r, T(-1.0), *_q, b);
+    const int N = _r->bs() * _r->map()->size_local();
+    dim3 block_size(512);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+    const T* dinv = _diag_inv->array().data();
+
+    // r = b - Ax, z = M^-1(r) * 4/(3*lmax), using M^-1 is Jacobi
+    if (zero_guess)
+    {
+      hipLaunchKernelGGL(chebyshev_init_zero<T>, grid_size, block_size, 0, 0, N,
+                         b.array().data(), dinv, x.mutable_array().data(),
+                         _r->mutable_array().data(), _z->mutable_array().data(),
+                         T(4.0 / (3.0 * lmax)));
+    }
+    else
+    {
+      A(x, *_q);
+      hipLaunchKernelGGL(chebyshev_init<T>, grid_size, block_size, 0, 0, N, b.array().data(),
+                         _q->array().data(), dinv, _r->mutable_array().data(),
+                         _z->mutable_array().data(), T(4.0 / (3.0 * lmax)));
+    }
+    err_check(hipGetLastError());
+
+    // With optimised weights the residual of x is tracked separately,
+    // starting from the common initial residual
+    if (r and optimized)
+      acc::copy(*r, *_r);
 
     if (verbose)
     {
@@ -62,25 +215,29 @@ public:
       spdlog::info("Iteration {}, UNPRECONDITIONED residual norm = {}", 0, rnorm);
     }
 
-    // z = M^-1(r) * 4/(3*lmax)
-    // Using M^-1 is Jacobi
-    acc::pointwise_mult(*_z, *_r, *_diag_inv);
-    acc::scale(*_z, T(4.0 / (3.0 * lmax)));
-
     for (int i = 1; i < _max_iter + 1; i++)
     {
-      // x += z
-      acc::axpy(x, T(1.0), *_z, x);
-
-      // r -= Az
       A(*_z, *_q);
-      acc::axpy(*_r, T(-1.0), *_q, *_r);
 
-      // z = z * (2i-1)/(2i+3) + M^-1(r) * (8i+4)/(2i+3)/lmax
-      acc::scale(*_z, T(2 * i - 1) / T(2 * i + 3));
-      // Using M^-1 is Jacobi
-      acc::pointwise_mult(*_q, *_r, *_diag_inv);
-      acc::axpy(*_z, T(8 * i + 4) / T(2 * i + 3) / lmax, *_q, *_z);
+      // x += beta_i z, r -= Az, z = z * (2i-1)/(2i+3) + M^-1(r) * (8i+4)/(2i+3)/lmax
+      T beta = optimized ? T(optimized_weights[_max_iter - 1][i - 1]) : T(1.0);
+      const T c1 = T(2 * i - 1) / T(2 * i + 3);
+      const T c2 = T(8 * i + 4) / T(2 * i + 3) / lmax;
+      if (r and optimized)
+      {
+        hipLaunchKernelGGL(chebyshev_update_residual<T>, grid_size, block_size, 0, 0, N,
+                           _q->array().data(), dinv, x.mutable_array().data(),
+                           _r->mutable_array().data(), _z->mutable_array().data(),
+                           r->mutable_array().data(), beta, c1, c2);
+      }
+      else
+      {
+        hipLaunchKernelGGL(chebyshev_update<T>, grid_size, block_size, 0, 0, N,
+                           _q->array().data(), dinv, x.mutable_array().data(),
+                           _r->mutable_array().data(), _z->mutable_array().data(), beta, c1,
+                           c2);
+      }
+      err_check(hipGetLastError());
 
       if (verbose)
       {
@@ -88,6 +245,10 @@ public:
         spdlog::info("Iteration {}, UNPRECONDITIONED residual norm = {}", i, rnorm);
       }
     }
+
+    // Without optimised weights r is the residual of x
+    if (r and !optimized)
+      acc::copy(*r, *_r);
   }
 
 private:
@@ -97,8 +258,13 @@ private:
   /// Eigenvalues
   std::array<T, 2> _eig_range;
 
+  /// Use optimised fourth kind weights
+  bool _optimized = true;
+
+  /// True if the cached inverse diagonal is up to date
+  bool _diag_valid = false;
+
   /// Working vectors
-  std::unique_ptr<Vector> _p;
   std::unique_ptr<Vector> _z;
   std::unique_ptr<Vector> _q;
   std::unique_ptr<Vector> _r;
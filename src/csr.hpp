@@ -1,3 +1,5 @@
+#pragma once
+
 #include <dolfinx.h>
 #include <dolfinx/fem/dolfinx_fem.h>
 #include <dolfinx/fem/petsc.h>
@@ -61,6 +63,27 @@ __global__ void spmvT_impl(int N, const T* values, const std::int32_t* row_begin
   }
 }
 
+/// Computes Y += A*X for a local CSR matrix A and a multi-vector X with
+/// `ncols` interleaved columns (entry (i, c) at i * ncols + c). One thread
+/// per (row, column), so that the threads of a row share each matrix entry
+/// and read consecutive entries of X.
+template <typename T>
+__global__ void spmv_block_impl(int N, int ncols, const T* values, const std::int32_t* row_begin,
+                                const std::int32_t* row_end, const std::int32_t* indices,
+                                const T* x, T* y)
+{
+  int t = blockIdx.x * blockDim.x + threadIdx.x;
+  int i = t / ncols;
+  int c = t % ncols;
+  if (i < N)
+  {
+    T vi{0};
+    for (std::int32_t j = row_begin[i]; j < row_end[i]; j++)
+      vi += values[j] * x[indices[j] * ncols + c];
+    y[i * ncols + c] += vi;
+  }
+}
+
 } // namespace
 
 namespace dolfinx::acc
@@ -98,46 +121,36 @@ public:
     // Get communicator from mesh
     _comm = V->mesh()->comm();
 
-    std::int32_t num_rows = _row_map->size_local();
-    std::int32_t nnz = _A->row_ptr()[num_rows];
-    _nnz = nnz;
-
-    T norm = 0.0;
-    for (T v : _A->values())
-      norm += v * v;
-
-    spdlog::info("A norm = {}", std::sqrt(norm));
-
-    // Get inverse diagonal entries (for Jacobi preconditioning)
-    std::vector<T> diag_inv(num_rows);
-    for (int i = 0; i < num_rows; ++i)
-    {
-      for (int j = _A->row_ptr()[i]; j < _A->row_ptr()[i + 1]; ++j)
-      {
-        if (_A->cols()[j] == i)
-          diag_inv[i] = 1.0 / _A->values()[j];
-      }
-    }
-    _diag_inv = thrust::device_vector<T>(diag_inv.size());
-    thrust::copy(diag_inv.begin(), diag_inv.end(), _diag_inv.begin());
+    copy_to_device();
+  }
 
-    _row_ptr = thrust::device_vector<std::int32_t>(num_rows + 1);
-    _off_diag_offset = thrust::device_vector<std::int32_t>(num_rows);
-    _cols = thrust::device_vector<std::int32_t>(nnz);
-    _values = thrust::device_vector<T>(nnz);
+  /// Create an operator from a matrix assembled on the host, e.g. a
+  /// low-order-refined matrix (see create_lor_matrix). Contributions to ghost
+  /// rows must have been accumulated (scatter_rev) and Dirichlet rows set.
+  MatrixOperator(
+      std::unique_ptr<
+          la::MatrixCSR<T, std::vector<T>, std::vector<std::int32_t>, std::vector<std::int32_t>>>
+          A,
+      MPI_Comm comm)
+  {
+    dolfinx::common::Timer t0("~setup phase MatrixOperator");
+    _A = std::move(A);
+    _comm = comm;
+    _row_map = _A->index_map(0);
+    _col_map = _A->index_map(1);
+    copy_to_device();
+  }
 
-    // Copy data from host to device
-    spdlog::warn("Creating Device matrix with {} non zeros", _nnz);
-    spdlog::warn("Creating row_ptr with {} to {}", num_rows + 1, _row_ptr.size());
-    thrust::copy(_A->row_ptr().begin(), _A->row_ptr().begin() + num_rows + 1, _row_ptr.begin());
-    spdlog::warn("Creating off_diag with {} to {}", _A->off_diag_offset().size(),
-                 _off_diag_offset.size());
-    thrust::copy(_A->off_diag_offset().begin(), _A->off_diag_offset().begin() + num_rows,
-                 _off_diag_offset.begin());
-    spdlog::warn("Creating cols with {} to {}", nnz, _cols.size());
-    thrust::copy(_A->cols().begin(), _A->cols().begin() + nnz, _cols.begin());
-    spdlog::warn("Creating values with {} to {}", nnz, _values.size());
-    thrust::copy(_A->values().begin(), _A->values().begin() + nnz, _values.begin());
+  /// Create a copy of an operator in another precision, e.g. a single
+  /// precision copy of a double precision level. Only the device data is
+  /// copied (and converted).
+  template <typename U>
+  explicit MatrixOperator(const MatrixOperator<U>& A)
+      : _nnz(A._nnz), _values(A._values.begin(), A._values.end()),
+        _diag_inv(A._diag_inv.begin(), A._diag_inv.end()), _row_ptr(A._row_ptr),
+        _cols(A._cols), _off_diag_offset(A._off_diag_offset), _col_map(A._col_map),
+        _row_map(A._row_map), _comm(A._comm)
+  {
   }
 
   MatrixOperator(const fem::FunctionSpace<T>& V0, const fem::FunctionSpace<T>& V1)
@@ -217,13 +230,24 @@ public:
     thrust::copy(_diag_inv.begin(), _diag_inv.end(), diag_inv.mutable_array().begin());
   }
 
+  /// Scale the matrix uniformly on device, A <- alpha * A, and update the
+  /// inverse diagonal. The sparsity pattern and communication data are unchanged.
+  void scale(T alpha)
+  {
+    thrust::transform(thrust::device, _values.begin(), _values.end(), _values.begin(),
+                      [alpha] __host__ __device__(const T& v) { return alpha * v; });
+    thrust::transform(thrust::device, _diag_inv.begin(), _diag_inv.end(), _diag_inv.begin(),
+                      [alpha] __host__ __device__(const T& d) { return d / alpha; });
+  }
+
   /**
    * @brief The matrix-vector multiplication operator, which multiplies the
    * matrix with the input vector and stores the result in the output vector.
    *
    * @tparam Vector  The type of the input and output vector.
    *
-   * @param x        The input vector.
+   * @param x        The input vector. If the block size is greater than one,
+   *                 x and y are multi-vectors with one column per block entry.
    * @param y        The output vector.
    */
   template <typename Vector>
@@ -235,7 +259,33 @@ public:
     T* _x = x.mutable_array().data();
     T* _y = y.mutable_array().data();
 
-    if (transpose)
+    if (x.bs() > 1)
+    {
+      // Multi-vector, one column per block entry
+      if (transpose)
+        throw std::runtime_error("MatrixOperator: transpose not supported for multi-vectors");
+
+      int num_rows = _row_map->size_local();
+      int ncols = x.bs();
+      dim3 block_size(256);
+      dim3 grid_size((num_rows * ncols + block_size.x - 1) / block_size.x);
+      x.scatter_fwd_begin();
+      hipLaunchKernelGGL(spmv_block_impl<T>, grid_size, block_size, 0, 0, num_rows, ncols,
+                         thrust::raw_pointer_cast(_values.data()),
+                         thrust::raw_pointer_cast(_row_ptr.data()),
+                         thrust::raw_pointer_cast(_off_diag_offset.data()),
+                         thrust::raw_pointer_cast(_cols.data()), _x, _y);
+      err_check(hipGetLastError());
+      x.scatter_fwd_end();
+
+      hipLaunchKernelGGL(spmv_block_impl<T>, grid_size, block_size, 0, 0, num_rows, ncols,
+                         thrust::raw_pointer_cast(_values.data()),
+                         thrust::raw_pointer_cast(_off_diag_offset.data()),
+                         thrust::raw_pointer_cast(_row_ptr.data()) + 1,
+                         thrust::raw_pointer_cast(_cols.data()), _x, _y);
+      err_check(hipGetLastError());
+    }
+    else if (transpose)
     {
       int num_rows = _row_map->size_local();
       dim3 block_size(256);
@@ -255,6 +305,9 @@ public:
                          thrust::raw_pointer_cast(_row_ptr.data()) + 1,
                          thrust::raw_pointer_cast(_cols.data()), _x, _y);
       err_check(hipGetLastError());
+
+      // Contributions to ghost columns belong to other processes
+      y.scatter_rev();
     }
     else
     {
@@ -279,6 +332,14 @@ public:
     }
   }
 
+  /// Device CSR data of the owned rows. Entries [row_ptr[i], off_diag_offset[i])
+  /// of row i have owned columns, and entries [off_diag_offset[i], row_ptr[i + 1])
+  /// have ghost columns.
+  const thrust::device_vector<T>& values() const { return _values; }
+  const thrust::device_vector<std::int32_t>& row_ptr() const { return _row_ptr; }
+  const thrust::device_vector<std::int32_t>& cols() const { return _cols; }
+  const thrust::device_vector<std::int32_t>& off_diag_offset() const { return _off_diag_offset; }
+
   std::shared_ptr<const common::IndexMap> column_index_map() { return _col_map; }
 
   std::shared_ptr<const common::IndexMap> row_index_map() { return _row_map; }
@@ -288,6 +349,54 @@ public:
   ~MatrixOperator() {}
 
 private:
+  template <typename U>
+  friend class MatrixOperator;
+
+  // Compute the inverse diagonal and copy the owned rows of the host matrix to device
+  void copy_to_device()
+  {
+    std::int32_t num_rows = _row_map->size_local();
+    std::int32_t nnz = _A->row_ptr()[num_rows];
+    _nnz = nnz;
+
+    T norm = 0.0;
+    for (T v : _A->values())
+      norm += v * v;
+
+    spdlog::info("A norm = {}", std::sqrt(norm));
+
+    // Get inverse diagonal entries (for Jacobi preconditioning)
+    std::vector<T> diag_inv(num_rows);
+    for (int i = 0; i < num_rows; ++i)
+    {
+      for (int j = _A->row_ptr()[i]; j < _A->row_ptr()[i + 1]; ++j)
+      {
+        if (_A->cols()[j] == i)
+          diag_inv[i] = 1.0 / _A->values()[j];
+      }
+    }
+    _diag_inv = thrust::device_vector<T>(diag_inv.size());
+    thrust::copy(diag_inv.begin(), diag_inv.end(), _diag_inv.begin());
+
+    _row_ptr = thrust::device_vector<std::int32_t>(num_rows + 1);
+    _off_diag_offset = thrust::device_vector<std::int32_t>(num_rows);
+    _cols = thrust::device_vector<std::int32_t>(nnz);
+    _values = thrust::device_vector<T>(nnz);
+
+    // Copy data from host to device
+    spdlog::warn("Creating Device matrix with {} non zeros", _nnz);
+    spdlog::warn("Creating row_ptr with {} to {}", num_rows + 1, _row_ptr.size());
+    thrust::copy(_A->row_ptr().begin(), _A->row_ptr().begin() + num_rows + 1, _row_ptr.begin());
+    spdlog::warn("Creating off_diag with {} to {}", _A->off_diag_offset().size(),
+                 _off_diag_offset.size());
+    thrust::copy(_A->off_diag_offset().begin(), _A->off_diag_offset().begin() + num_rows,
+                 _off_diag_offset.begin());
+    spdlog::warn("Creating cols with {} to {}", nnz, _cols.size());
+    thrust::copy(_A->cols().begin(), _A->cols().begin() + nnz, _cols.begin());
+    spdlog::warn("Creating values with {} to {}", nnz, _values.size());
+    thrust::copy(_A->values().begin(), _A->values().begin() + nnz, _values.begin());
+  }
+
   std::size_t _nnz;
   thrust::device_vector<T> _values;
   thrust::device_vector<T> _diag_inv;
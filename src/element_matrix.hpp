@@ -0,0 +1,373 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "vector.hpp"
+#include <dolfinx.h>
+#include <dolfinx/fem/dolfinx_fem.h>
+
+#include "hip/hip_runtime.h"
+#include <thrust/device_vector.h>
+
+namespace
+{
+/// Index of entry (i, j), i <= j, in a packed upper triangular n x n matrix
+__host__ __device__ inline int packed_index(int i, int j, int n)
+{
+  return i * n - (i * (i - 1)) / 2 + (j - i);
+}
+
+/// Compute y += A_e * x for a set of cells, where A_e is a dense symmetric
+/// element matrix stored as a packed upper triangle. Each thread computes one
+/// row of one cell, and a block handles blockDim.x / n cells.
+/// @param[in] n Number of dofs per cell
+/// @param[in] num_cells Number of cells in `cells`
+/// @param[in] cells List of cells to compute on
+/// @param[in] dofmap Cell dofmap (num_cells_all, n)
+/// @param[in] A Packed element matrices (num_cells_all, n(n+1)/2), or a single
+/// reference matrix if `scales` is not null
+/// @param[in] scales Per-cell scaling of the reference matrix (may be null)
+/// @param[in] bc_marker Marker for Dirichlet dofs (rows/columns replaced by the identity)
+/// @param[in] x Input vector
+/// @param[in, out] y Output vector
+/// @note Shared memory size is blockDim.x * sizeof(T)
+template <typename T>
+__global__ void element_matrix_apply(int n, int num_cells, const int* cells,
+                                     const std::int32_t* dofmap, const T* A, const T* scales,
+                                     const std::int8_t* bc_marker, const T* x, T* y)
+{
+  extern __shared__ T xe[];
+
+  const int cells_per_block = blockDim.x / n;
+  const int lc = threadIdx.x / n;
+  const int row = threadIdx.x % n;
+  const int c = blockIdx.x * cells_per_block + lc;
+  const bool active = lc < cells_per_block and c < num_cells;
+
+  int cell = 0;
+  int dof = 0;
+  if (active)
+  {
+    cell = cells[c];
+    dof = dofmap[cell * n + row];
+    xe[lc * n + row] = bc_marker[dof] ? T(0.0) : x[dof];
+  }
+  __syncthreads();
+
+  if (!active)
+    return;
+
+  const std::size_t packed_size = (n * (n + 1)) / 2;
+  const T* Ae = scales ? A : A + cell * packed_size;
+  const T s = scales ? scales[cell] : T(1.0);
+
+  T val = 0.0;
+  for (int j = 0; j < n; ++j)
+  {
+    int i0 = min(row, j);
+    int j0 = max(row, j);
+    val += Ae[packed_index(i0, j0, n)] * xe[lc * n + j];
+  }
+
+  if (bc_marker[dof])
+    y[dof] = x[dof];
+  else
+    atomicAdd(&y[dof], s * val);
+}
+} // namespace
+
+namespace dolfinx::acc
+{
+/// Operator storing a dense symmetric element matrix per cell (partial
+/// assembly), applied by gather, small dense matrix-vector product, and
+/// scatter through the dofmap. Intended for low degree (P1, P2) levels, where
+/// the element matrices are small (8x8, 27x27) and neither CSR nor sum
+/// factorisation is efficient.
+///
+/// If all element matrices are multiples of the first one (e.g. affine
+/// cells of the same shape), only the reference matrix and one scaling per
+/// cell are stored.
+template <typename T>
+class ElementMatrixOperator
+{
+public:
+  /// The value type
+  using value_type = T;
+
+  /// Compute and store element matrices of the bilinear form `a` for all cells
+  /// (owned and ghost) on this process.
+  /// @param a Bilinear form (cell integrals only, constants but no coefficients)
+  /// @param bcs Dirichlet boundary conditions
+  /// @param lcells Cells which have no shared dofs
+  /// @param bcells Cells which have dofs shared with other processes
+  /// @param tol Relative tolerance used to detect scaled copies of the reference matrix
+  ElementMatrixOperator(std::shared_ptr<fem::Form<T, T>> a,
+                        const std::vector<std::shared_ptr<const fem::DirichletBC<T, T>>>& bcs,
+                        const std::vector<int>& lcells, const std::vector<int>& bcells,
+                        T tol = 1e-10)
+      : _lcells(lcells), _bcells(bcells)
+  {
+    dolfinx::common::Timer t0("~setup phase ElementMatrixOperator");
+
+    if (a->rank() != 2)
+      throw std::runtime_error("Form should have rank be 2.");
+    if (!a->coefficients().empty())
+      throw std::runtime_error("ElementMatrixOperator: coefficients are not supported.");
+
+    auto V = a->function_spaces()[0];
+    auto mesh = a->mesh();
+    const int tdim = mesh->topology()->dim();
+    auto cell_map = mesh->topology()->index_map(tdim);
+    const std::int32_t num_cells = cell_map->size_local() + cell_map->num_ghosts();
+
+    _map = V->dofmap()->index_map;
+    auto dofmap = V->dofmap()->map();
+    _ndofs = dofmap.extent(1);
+    const int n = _ndofs;
+    const std::size_t packed_size = (n * (n + 1)) / 2;
+
+    // Dirichlet marker (owned and ghost dofs)
+    const std::int32_t size = _map->size_local() + _map->num_ghosts();
+    std::vector<std::int8_t> bc_marker(size, 0);
+    for (auto& bc : bcs)
+      bc->mark_dofs(bc_marker);
+
+    // Geometry
+    auto x_dofmap = mesh->geometry().dofmap();
+    std::span<const T> x_g = mesh->geometry().x();
+    std::vector<T> coordinate_dofs(3 * x_dofmap.extent(1));
+
+    // Kernel and constants
+    auto ids = a->integral_ids(fem::IntegralType::cell);
+    if (ids.size() != 1)
+      throw std::runtime_error("ElementMatrixOperator: expected a single cell integral.");
+    auto kernel = a->kernel(fem::IntegralType::cell, ids.front());
+    std::vector<T> constants = fem::pack_constants(*a);
+
+    // Compute packed element matrices
+    std::vector<T> Ae(n * n);
+    std::vector<T> packed(num_cells * packed_size);
+    for (std::int32_t c = 0; c < num_cells; ++c)
+    {
+      auto x_dofs = std::submdspan(x_dofmap, c, std::full_extent);
+      for (std::size_t i = 0; i < x_dofs.size(); ++i)
+        std::copy_n(std::next(x_g.begin(), 3 * x_dofs[i]), 3,
+                    std::next(coordinate_dofs.begin(), 3 * i));
+
+      std::fill(Ae.begin(), Ae.end(), 0);
+      kernel(Ae.data(), nullptr, constants.data(), coordinate_dofs.data(), nullptr, nullptr);
+
+      T* Ap = packed.data() + c * packed_size;
+      for (int i = 0; i < n; ++i)
+        for (int j = i; j < n; ++j)
+          Ap[packed_index(i, j, n)] = Ae[i * n + j];
+    }
+
+    // Inverse diagonal (Dirichlet rows are the identity)
+    std::vector<T> diag(size, 0);
+    for (std::int32_t c = 0; c < num_cells; ++c)
+    {
+      const T* Ap = packed.data() + c * packed_size;
+      for (int i = 0; i < n; ++i)
+        diag[dofmap(c, i)] += Ap[packed_index(i, i, n)];
+    }
+    for (std::int32_t i = 0; i < size; ++i)
+    {
+      if (bc_marker[i])
+        diag[i] = 1.0;
+      diag[i] = (diag[i] == 0.0) ? 0.0 : 1.0 / diag[i];
+    }
+
+    // Check if all element matrices are scaled copies of the first one
+    _compact = num_cells > 0;
+    std::vector<T> scales(num_cells, 1.0);
+    if (_compact)
+    {
+      std::span<const T> ref(packed.data(), packed_size);
+      const T ref_norm2 = std::transform_reduce(ref.begin(), ref.end(), ref.begin(), T(0.0));
+      for (std::int32_t c = 0; c < num_cells and _compact; ++c)
+      {
+        std::span<const T> Ac(packed.data() + c * packed_size, packed_size);
+        T s = std::transform_reduce(Ac.begin(), Ac.end(), ref.begin(), T(0.0)) / ref_norm2;
+        T err = 0.0, norm = 0.0;
+        for (std::size_t k = 0; k < packed_size; ++k)
+        {
+          err += (Ac[k] - s * ref[k]) * (Ac[k] - s * ref[k]);
+          norm += Ac[k] * Ac[k];
+        }
+        scales[c] = s;
+        _compact = err <= tol * tol * norm;
+      }
+    }
+
+    if (_compact)
+    {
+      packed.resize(packed_size);
+      _scales_h = scales;
+      _scales = thrust::device_vector<T>(scales.begin(), scales.end());
+    }
+
+    spdlog::info("ElementMatrixOperator: {} cells, {} dofs/cell, {} storage", num_cells, n,
+                 _compact ? "reference matrix + scaling" : "per-cell matrices");
+
+    // Copy data to device (and keep host copies for CPU execution)
+    _values_h = packed;
+    _values = thrust::device_vector<T>(packed.begin(), packed.end());
+    _dofmap_h.assign(dofmap.data_handle(), dofmap.data_handle() + dofmap.size());
+    _dofmap = thrust::device_vector<std::int32_t>(_dofmap_h.begin(), _dofmap_h.end());
+    _bc_marker_h = bc_marker;
+    _bc_marker = thrust::device_vector<std::int8_t>(bc_marker.begin(), bc_marker.end());
+    _diag_inv = thrust::device_vector<T>(diag.begin(), diag.end());
+    _lcells_d = thrust::device_vector<int>(lcells.begin(), lcells.end());
+    _bcells_d = thrust::device_vector<int>(bcells.begin(), bcells.end());
+  }
+
+  /**
+   * @brief Apply the operator, y = A x. Cells with only owned dofs are
+   * computed while the ghost update of x is in flight.
+   *
+   * @tparam Vector  The type of the input and output vector.
+   *
+   * @param x        The input vector.
+   * @param y        The output vector.
+   */
+  template <typename Vector>
+  void operator()(Vector& x, Vector& y)
+  {
+    dolfinx::common::Timer t0("% ElementMatrixOperator application");
+    y.set(T{0});
+
+    x.scatter_fwd_begin();
+    if constexpr (Vector::device == Device::CPP)
+      apply_host(_lcells, x.array(), y.mutable_array());
+    else
+      apply_device(_lcells_d, x.array(), y.mutable_array());
+    x.scatter_fwd_end();
+
+    if constexpr (Vector::device == Device::CPP)
+      apply_host(_bcells, x.array(), y.mutable_array());
+    else
+    {
+      apply_device(_bcells_d, x.array(), y.mutable_array());
+      err_check(hipDeviceSynchronize());
+    }
+  }
+
+  template <typename Vector>
+  void get_diag_inverse(Vector& diag_inv)
+  {
+    thrust::copy(_diag_inv.begin(), _diag_inv.end(), diag_inv.mutable_array().begin());
+  }
+
+  /// Scale the operator uniformly, A <- alpha * A. Dirichlet rows are unchanged.
+  void scale(T alpha)
+  {
+    auto& v = _compact ? _scales : _values;
+    auto& vh = _compact ? _scales_h : _values_h;
+    thrust::transform(thrust::device, v.begin(), v.end(), v.begin(),
+                      [alpha] __host__ __device__(const T& a) { return alpha * a; });
+    std::transform(vh.begin(), vh.end(), vh.begin(), [alpha](T a) { return alpha * a; });
+    thrust::transform(thrust::device, _diag_inv.begin(), _diag_inv.end(), _bc_marker.begin(),
+                      _diag_inv.begin(),
+                      [alpha] __host__ __device__(const T& d, const std::int8_t& bc)
+                      { return bc ? d : d / alpha; });
+  }
+
+  /// True if a single reference matrix with per-cell scaling is stored
+  bool compact() const { return _compact; }
+
+  std::shared_ptr<const common::IndexMap> index_map() const { return _map; }
+
+private:
+  // Apply to a list of cells on device
+  void apply_device(const thrust::device_vector<int>& cells, std::span<const T> x, std::span<T> y)
+  {
+    if (cells.empty())
+      return;
+
+    const int n = _ndofs;
+    const int cells_per_block = std::max(1, 256 / n);
+    dim3 block_size(cells_per_block * n);
+    dim3 grid_size((cells.size() + cells_per_block - 1) / cells_per_block);
+    std::size_t shm_size = block_size.x * sizeof(T);
+    const T* scales = _compact ? thrust::raw_pointer_cast(_scales.data()) : nullptr;
+    hipLaunchKernelGGL(element_matrix_apply<T>, grid_size, block_size, shm_size, 0, n,
+                       cells.size(), thrust::raw_pointer_cast(cells.data()),
+                       thrust::raw_pointer_cast(_dofmap.data()),
+                       thrust::raw_pointer_cast(_values.data()), scales,
+                       thrust::raw_pointer_cast(_bc_marker.data()), x.data(), y.data());
+    err_check(hipGetLastError());
+  }
+
+  // Apply to a list of cells on host. The packed matrix is expanded to a
+  // dense n x n buffer (once for compact storage, otherwise per cell) so that
+  // each row is a contiguous dot product the compiler can vectorise.
+  void apply_host(const std::vector<int>& cells, std::span<const T> x, std::span<T> y)
+  {
+    const int n = _ndofs;
+    const std::size_t packed_size = (n * (n + 1)) / 2;
+    std::vector<T> xe(n), ye(n), Ad(n * n);
+    auto unpack = [&](const T* Ap)
+    {
+      for (int i = 0; i < n; ++i)
+        for (int j = i; j < n; ++j)
+          Ad[i * n + j] = Ad[j * n + i] = Ap[packed_index(i, j, n)];
+    };
+
+    if (_compact)
+      unpack(_values_h.data());
+    for (int cell : cells)
+    {
+      const std::int32_t* dofs = _dofmap_h.data() + cell * n;
+      if (!_compact)
+        unpack(_values_h.data() + cell * packed_size);
+      const T s = _compact ? _scales_h[cell] : T(1.0);
+
+      for (int i = 0; i < n; ++i)
+        xe[i] = _bc_marker_h[dofs[i]] ? T(0.0) : x[dofs[i]];
+
+      for (int i = 0; i < n; ++i)
+      {
+        const T* Ai = Ad.data() + i * n;
+        T val = 0.0;
+        for (int j = 0; j < n; ++j)
+          val += Ai[j] * xe[j];
+        ye[i] = s * val;
+      }
+
+      for (int i = 0; i < n; ++i)
+      {
+        if (_bc_marker_h[dofs[i]])
+          y[dofs[i]] = x[dofs[i]];
+        else
+          y[dofs[i]] += ye[i];
+      }
+    }
+  }
+
+  // Number of dofs per cell
+  int _ndofs;
+
+  // Single reference matrix with per-cell scaling
+  bool _compact;
+
+  std::shared_ptr<const common::IndexMap> _map;
+
+  // Packed element matrices, per-cell scaling (compact storage only),
+  // dofmap and Dirichlet marker. Device storage and host copies.
+  thrust::device_vector<T> _values, _scales;
+  thrust::device_vector<std::int32_t> _dofmap;
+  thrust::device_vector<std::int8_t> _bc_marker;
+  std::vector<T> _values_h, _scales_h;
+  std::vector<std::int32_t> _dofmap_h;
+  std::vector<std::int8_t> _bc_marker_h;
+
+  // Inverse diagonal, for Jacobi preconditioning
+  thrust::device_vector<T> _diag_inv;
+
+  // Lists of cells which are local (lcells) and boundary (bcells)
+  std::vector<int> _lcells, _bcells;
+  thrust::device_vector<int> _lcells_d, _bcells_d;
+};
+} // namespace dolfinx::acc
@@ -0,0 +1,353 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "laplacian.hpp"
+#include "vector.hpp"
+#include <basix/math.h>
+#include <dolfinx/fem/FunctionSpace.h>
+#include <dolfinx/la/Vector.h>
+
+using namespace dolfinx;
+
+namespace
+{
+/// Residual with Dirichlet dofs removed: r = (b - q), zero on Dirichlet dofs
+template <typename T>
+static __global__ void fdm_residual(int N, const T* __restrict__ b, const T* __restrict__ q,
+                                    const std::int8_t* __restrict__ bc_marker,
+                                    T* __restrict__ r)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+    r[i] = bc_marker[i] ? T(0.0) : b[i] - q[i];
+}
+
+/// Apply the fast diagonalisation inverse of the cell stiffness matrices,
+/// y += w * (S x S x S) Lambda^-1 (S x S x S)^T r, for each cell.
+/// @param[in] r Residual (owned and ghost entries, zero on Dirichlet dofs)
+/// @param[in] entity_constants Constant coefficient for each cell
+/// @param[in, out] y Output vector
+/// @param[in] cell_h Cell sizes (hx, hy, hz) in the three tensor directions
+/// @param[in] S 1D generalised eigenvectors, S[i * nd + a] (node i, mode a)
+/// @param[in] lambda 1D generalised eigenvalues
+/// @param[in] weights Inverse multiplicity of each dof
+/// @param[in] entity_dofmap Cell dofmap
+/// @param[in] n_entities Number of cells
+/// @param[in] bc_marker Marker for Dirichlet dofs (no correction applied)
+/// @param[in] scale Uniform scaling applied to all entity constants
+/// @note The block size is (P+1, P+1, P+1) and the shared memory 2 * (P+1)^3 * sizeof(T)
+template <typename T, int P>
+__global__ void fdm_apply(const T* r, const T* entity_constants, T* y, const T* cell_h,
+                          const T* S, const T* lambda, const T* weights,
+                          const std::int32_t* entity_dofmap, int n_entities,
+                          const std::int8_t* bc_marker, T scale)
+{
+  constexpr int nd = P + 1;
+  constexpr int square_nd = nd * nd;
+  constexpr int cube_nd = nd * nd * nd;
+
+  extern __shared__ T shared_mem[];
+  T* u = shared_mem;
+  T* v = shared_mem + cube_nd;
+
+  int tx = threadIdx.x;
+  int ty = threadIdx.y;
+  int tz = threadIdx.z;
+  int thread_id = tx * square_nd + ty * nd + tz;
+  int cell = blockIdx.x;
+  if (cell >= n_entities)
+    return;
+
+  int dof = entity_dofmap[cell * cube_nd + thread_id];
+  u[thread_id] = r[dof];
+  __syncthreads();
+
+  // v = (S^T x S^T x S^T) u, one direction at a time
+  T val = 0.0;
+#pragma unroll
+  for (int i = 0; i < nd; ++i)
+    val += S[i * nd + tx] * u[i * square_nd + ty * nd + tz];
+  v[thread_id] = val;
+  __syncthreads();
+
+  val = 0.0;
+#pragma unroll
+  for (int i = 0; i < nd; ++i)
+    val += S[i * nd + ty] * v[tx * square_nd + i * nd + tz];
+  u[thread_id] = val;
+  __syncthreads();
+
+  val = 0.0;
+#pragma unroll
+  for (int i = 0; i < nd; ++i)
+    val += S[i * nd + tz] * u[tx * square_nd + ty * nd + i];
+
+  // Scale by the inverse eigenvalues of the cell operator. The constant mode
+  // (zero eigenvalue) is not corrected.
+  T hx = cell_h[cell * 3 + 0];
+  T hy = cell_h[cell * 3 + 1];
+  T hz = cell_h[cell * 3 + 2];
+  T coeff = scale * entity_constants[cell];
+  T d = coeff
+        * (hy * hz / hx * lambda[tx] + hx * hz / hy * lambda[ty] + hx * hy / hz * lambda[tz]);
+  v[thread_id] = (d == 0.0) ? T(0.0) : val / d;
+  __syncthreads();
+
+  // u = (S x S x S) v
+  val = 0.0;
+#pragma unroll
+  for (int a = 0; a < nd; ++a)
+    val += S[tx * nd + a] * v[a * square_nd + ty * nd + tz];
+  u[thread_id] = val;
+  __syncthreads();
+
+  val = 0.0;
+#pragma unroll
+  for (int a = 0; a < nd; ++a)
+    val += S[ty * nd + a] * u[tx * square_nd + a * nd + tz];
+  v[thread_id] = val;
+  __syncthreads();
+
+  val = 0.0;
+#pragma unroll
+  for (int a = 0; a < nd; ++a)
+    val += S[tz * nd + a] * v[tx * square_nd + ty * nd + a];
+
+  if (!bc_marker[dof])
+    atomicAdd(&y[dof], weights[dof] * val);
+}
+
+/// Fast diagonalisation update, x += omega * y (owned entries)
+template <typename T>
+static __global__ void fdm_update(int N, const T* __restrict__ y, T* __restrict__ x, T omega)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+    x[i] += omega * y[i];
+}
+} // namespace
+
+namespace dolfinx::acc
+{
+
+/// Cell-wise additive smoother using the fast diagonalisation method. Each
+/// cell stiffness matrix is approximated by that of an axis-aligned box with
+/// the cell's edge lengths, whose inverse is three 1D transforms with the
+/// generalised eigenvectors of the 1D GLL stiffness and (diagonal) mass
+/// matrices and a diagonal scaling. Cell corrections are summed with inverse
+/// multiplicity weights.
+template <typename Vector>
+class FDMSmoother
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  /// Create a smoother
+  /// @param V Function space of the level (tensor product Lagrange, GLL points)
+  /// @param coefficients Per-cell constants (on device)
+  /// @param bc_marker Marker for Dirichlet dofs (on device, owned and ghost)
+  FDMSmoother(std::shared_ptr<fem::FunctionSpace<T>> V, std::span<const T> coefficients,
+              std::span<const std::int8_t> bc_marker)
+      : _cell_constants(coefficients), _bc_marker(bc_marker)
+  {
+    dolfinx::common::Timer t0("~setup phase FDMSmoother");
+
+    auto map = V->dofmap()->index_map;
+    _degree = V->element()->basix_element().degree();
+    _r = std::make_unique<Vector>(map, 1);
+    _q = std::make_unique<Vector>(map, 1);
+    _y = std::make_unique<Vector>(map, 1);
+
+    // 1D generalised eigenproblem K s = lambda M s, with K = D^T W D and M = W
+    dispatch_degree(_degree, [&]<int P>() { compute_eigenvectors<P>(); });
+
+    auto mesh = V->mesh();
+    const int tdim = mesh->topology()->dim();
+    auto cell_map = mesh->topology()->index_map(tdim);
+    const std::int32_t ncells_local = cell_map->size_local();
+    _num_cells = ncells_local + cell_map->num_ghosts();
+
+    // Cell sizes in the three tensor directions (vertices 0-4, 0-2, 0-1)
+    auto x_dofmap = mesh->geometry().dofmap();
+    std::span<const T> x = mesh->geometry().x();
+    std::vector<T> cell_h(3 * _num_cells);
+    auto dist = [&](std::int32_t c, int v0, int v1)
+    {
+      T d2 = 0;
+      for (int j = 0; j < 3; ++j)
+      {
+        T dx = x[3 * x_dofmap(c, v1) + j] - x[3 * x_dofmap(c, v0) + j];
+        d2 += dx * dx;
+      }
+      return std::sqrt(d2);
+    };
+    for (std::int32_t c = 0; c < _num_cells; ++c)
+    {
+      cell_h[3 * c + 0] = dist(c, 0, 4);
+      cell_h[3 * c + 1] = dist(c, 0, 2);
+      cell_h[3 * c + 2] = dist(c, 0, 1);
+    }
+
+    // Inverse multiplicity of each dof (number of cells, over all processes)
+    auto dofmap = V->dofmap();
+    la::Vector<T> count(map, 1);
+    count.set(0);
+    std::span<T> cnt = count.mutable_array();
+    for (std::int32_t c = 0; c < ncells_local; ++c)
+      for (auto dof : dofmap->cell_dofs(c))
+        cnt[dof] += 1;
+    count.scatter_rev(std::plus<T>());
+    count.scatter_fwd();
+    std::vector<T> weights(cnt.size());
+    std::transform(cnt.begin(), cnt.end(), weights.begin(),
+                   [](T m) { return m > 0 ? 1 / m : 0; });
+
+    auto dm = dofmap->map();
+    _dofmap = thrust::device_vector<std::int32_t>(dm.data_handle(), dm.data_handle() + dm.size());
+    _cell_h = thrust::device_vector<T>(cell_h.begin(), cell_h.end());
+    _weights = thrust::device_vector<T>(weights.begin(), weights.end());
+  }
+
+  void set_max_iterations(int max_iter) { _max_iter = max_iter; }
+
+  /// Set the damping parameter (default 1)
+  void set_omega(T omega) { _omega = omega; }
+
+  /// Replace the (on device) per-cell constants
+  void update_coefficients(std::span<const T> coefficients) { _cell_constants = coefficients; }
+
+  /// The smoother does not use the operator diagonal
+  template <typename Operator>
+  void update_diagonal(Operator&)
+  {
+  }
+
+  /// Update the smoother after the operator has been scaled uniformly by alpha
+  void rescale(T alpha) { _scale *= alpha; }
+
+  /// Apply max_iter smoothing steps to Ax = b
+  /// @param zero_guess If true, the initial value of x is ignored and
+  /// taken to be zero, which saves one application of A
+  template <typename Operator>
+  void solve(Operator& A, Vector& x, const Vector& b, bool verbose, bool zero_guess = false)
+  {
+    dolfinx::common::Timer t0("~FDMSmoother solve");
+
+    const int N = _r->map()->size_local();
+    dim3 block_size(512);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+
+    for (int k = 0; k < _max_iter; k++)
+    {
+      // r = b - A x
+      if (k == 0 and zero_guess)
+        _q->set(T{0.0});
+      else
+        A(x, *_q);
+      hipLaunchKernelGGL(fdm_residual<T>, grid_size, block_size, 0, 0, N, b.array().data(),
+                         _q->array().data(), _bc_marker.data(), _r->mutable_array().data());
+      err_check(hipGetLastError());
+      _r->scatter_fwd();
+
+      // y = sum_cells w A_cell^-1 r
+      _y->set(T{0.0});
+      dispatch_degree(_degree, [&]<int P>() { impl_apply<P>(); });
+
+      if (k == 0 and zero_guess)
+        x.set(T{0.0});
+      hipLaunchKernelGGL(fdm_update<T>, grid_size, block_size, 0, 0, N, _y->array().data(),
+                         x.mutable_array().data(), _omega);
+      err_check(hipGetLastError());
+
+      if (verbose)
+      {
+        A(x, *_q);
+        acc::axpy(*_q, T(-1), *_q, b);
+        spdlog::info("Iteration {}, UNPRECONDITIONED residual norm = {}", k + 1,
+                     acc::norm(*_q));
+      }
+    }
+  }
+
+private:
+  template <int P>
+  void compute_eigenvectors()
+  {
+    using table = dolfinx::acc::tables::gll<T, P>;
+    constexpr int nd = P + 1;
+
+    // M^-1/2 K M^-1/2 = Q Lambda Q^T, and S = M^-1/2 Q
+    std::vector<T> K(nd * nd, 0);
+    for (int i = 0; i < nd; ++i)
+      for (int j = 0; j < nd; ++j)
+        for (int q = 0; q < nd; ++q)
+          K[i * nd + j] += table::weights[q] * table::dphi[q * nd + i] * table::dphi[q * nd + j]
+                           / std::sqrt(table::weights[i] * table::weights[j]);
+
+    auto [lambda, Q] = basix::math::eigh<T>(K, nd);
+
+    // Q is column-major (one eigenvector per column)
+    std::vector<T> S(nd * nd);
+    for (int i = 0; i < nd; ++i)
+      for (int a = 0; a < nd; ++a)
+        S[i * nd + a] = Q[a * nd + i] / std::sqrt(table::weights[i]);
+
+    // Remove round-off in the constant mode
+    for (T& l : lambda)
+      if (std::abs(l) < 1e-12 * lambda.back())
+        l = 0.0;
+
+    _S = thrust::device_vector<T>(S.begin(), S.end());
+    _lambda = thrust::device_vector<T>(lambda.begin(), lambda.end());
+  }
+
+  template <int P>
+  void impl_apply()
+  {
+    dim3 block_size(P + 1, P + 1, P + 1);
+    dim3 grid_size(_num_cells);
+    std::size_t shm_size = 2 * (P + 1) * (P + 1) * (P + 1) * sizeof(T);
+    hipLaunchKernelGGL(HIP_KERNEL_NAME(fdm_apply<T, P>), grid_size, block_size, shm_size, 0,
+                       _r->array().data(), _cell_constants.data(), _y->mutable_array().data(),
+                       thrust::raw_pointer_cast(_cell_h.data()),
+                       thrust::raw_pointer_cast(_S.data()),
+                       thrust::raw_pointer_cast(_lambda.data()),
+                       thrust::raw_pointer_cast(_weights.data()),
+                       thrust::raw_pointer_cast(_dofmap.data()), _num_cells, _bc_marker.data(),
+                       _scale);
+    err_check(hipGetLastError());
+  }
+
+  /// Polynomial degree
+  int _degree;
+
+  /// Number of cells (owned and ghost)
+  std::int32_t _num_cells;
+
+  /// Number of smoothing steps
+  int _max_iter = 1;
+
+  /// Damping parameter
+  T _omega = 1.0;
+
+  /// Uniform scaling of the cell constants
+  T _scale = 1.0;
+
+  // Reference to on-device storage for constants and Dirichlet marker
+  std::span<const T> _cell_constants;
+  std::span<const std::int8_t> _bc_marker;
+
+  // On-device 1D eigenvectors and eigenvalues, cell sizes, dofmap and
+  // inverse multiplicity
+  thrust::device_vector<T> _S, _lambda, _cell_h, _weights;
+  thrust::device_vector<std::int32_t> _dofmap;
+
+  /// Working vectors
+  std::unique_ptr<Vector> _r;
+  std::unique_ptr<Vector> _q;
+  std::unique_ptr<Vector> _y;
+};
+} // namespace dolfinx::acc
@@ -0,0 +1,60 @@
+# Copyright (C) 2023 Igor A. Baratta
+# SPDX-License-Identifier:    MIT
+#
+# Generate 1D basis function tables for the GLL-warped Lagrange element on
+# an interval, at the GLL quadrature points, for degrees 1..8. The output is
+# a C++ header with constexpr arrays consumed by the matrix-free kernels.
+#
+# Usage: python3 gll_tables.py <output header>
+
+import sys
+
+import basix
+import numpy as np
+
+max_degree = 8
+
+# Quadrature degree giving (P + 1) GLL points for degree P
+Qdegree = {1: 0, 2: 3, 3: 4, 4: 6, 5: 8, 6: 10, 7: 12, 8: 14}
+
+
+def format_array(name, values):
+    vals = ", ".join(f"T({v:.17e})" for v in values.flatten())
+    return f"  static constexpr T {name}[{values.size}] = {{{vals}}};\n"
+
+
+out = """// Generated by gll_tables.py using Basix {version}. Do not edit.
+#pragma once
+
+namespace dolfinx::acc::tables
+{{
+/// Tables of the 1D GLL-warped Lagrange element of degree P at the
+/// (P + 1) GLL quadrature points: phi[q * nd + i], dphi[q * nd + i]
+template <typename T, int P>
+struct gll;
+""".format(version=basix.__version__)
+
+for P in range(1, max_degree + 1):
+    element = basix.create_element(
+        basix.ElementFamily.P, basix.CellType.interval, P, basix.LagrangeVariant.gll_warped
+    )
+    points, weights = basix.make_quadrature(
+        basix.CellType.interval, Qdegree[P], rule=basix.QuadratureType.gll
+    )
+    table = element.tabulate(1, points)
+    nd = element.dim
+    assert len(weights) == nd, "Number of quadrature points must match number of dofs"
+
+    out += "\ntemplate <typename T>\n"
+    out += f"struct gll<T, {P}>\n{{\n"
+    out += f"  static constexpr int nd = {nd};\n"
+    out += format_array("points", points[:, 0])
+    out += format_array("weights", weights)
+    out += format_array("phi", table[0, :, :, 0])
+    out += format_array("dphi", table[1, :, :, 0])
+    out += "};\n"
+
+out += "} // namespace dolfinx::acc::tables\n"
+
+with open(sys.argv[1], "w") as f:
+    f.write(out)
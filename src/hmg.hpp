@@ -0,0 +1,153 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <dolfinx/common/MPI.h>
+#include <dolfinx/common/Timer.h>
+#include <dolfinx/fem/FunctionSpace.h>
+#include <dolfinx/la/MatrixCSR.h>
+#include <dolfinx/la/SparsityPattern.h>
+#include <limits>
+#include <unordered_map>
+
+using namespace dolfinx;
+
+namespace dolfinx::acc
+{
+
+/// Assemble the trilinear prolongation between P1 spaces on two structured
+/// hexahedral meshes of the same box, where the fine mesh is the factor-2
+/// refinement of the coarse one (e.g. build_hex with n and n / 2 cells). The
+/// partitions must be nested (see create_structured_partitioner), so that
+/// the parent of each owned fine cell is available on the same process and
+/// no geometric search or communication is needed.
+/// @param Vc P1 space on the coarse mesh
+/// @param Vf P1 space on the fine mesh
+/// @return Host matrix with rows in the layout of Vf and columns in the layout
+/// of Vc, ready to create a MatrixOperator
+template <typename T>
+std::unique_ptr<
+    la::MatrixCSR<T, std::vector<T>, std::vector<std::int32_t>, std::vector<std::int32_t>>>
+create_h_prolongation(const fem::FunctionSpace<T>& Vc, const fem::FunctionSpace<T>& Vf)
+{
+  dolfinx::common::Timer t0("~setup phase h-prolongation");
+
+  auto dofmapc = Vc.dofmap();
+  auto dofmapf = Vf.dofmap();
+  MPI_Comm comm = Vf.mesh()->comm();
+  const int tdim = Vf.mesh()->topology()->dim();
+
+  // Dof coordinates, x[dof * 3 + i]
+  const std::vector<T> xc = Vc.tabulate_dof_coordinates(false);
+  const std::vector<T> xf = Vf.tabulate_dof_coordinates(false);
+
+  // Origin and coarse grid spacing (uniform, from the first local cell)
+  std::array<T, 3> x0, h = {0, 0, 0};
+  x0.fill(std::numeric_limits<T>::max());
+  for (std::size_t i = 0; i < xc.size(); i += 3)
+    for (int d = 0; d < 3; ++d)
+      x0[d] = std::min(x0[d], xc[i + d]);
+  auto cmap = Vc.mesh()->topology()->index_map(tdim);
+  const std::int32_t num_coarse_cells = cmap->size_local() + cmap->num_ghosts();
+  if (num_coarse_cells > 0)
+  {
+    for (std::int32_t dof : dofmapc->cell_dofs(0))
+      for (int d = 0; d < 3; ++d)
+        h[d] = std::max(h[d], std::abs(xc[dof * 3 + d] - xc[dofmapc->cell_dofs(0)[0] * 3 + d]));
+  }
+  MPI_Allreduce(MPI_IN_PLACE, x0.data(), 3, dolfinx::MPI::mpi_type<T>(), MPI_MIN, comm);
+  MPI_Allreduce(MPI_IN_PLACE, h.data(), 3, dolfinx::MPI::mpi_type<T>(), MPI_MAX, comm);
+
+  // Coarse grid index of the cell containing the midpoint of a cell
+  auto cell_key = [&](const std::vector<T>& x, std::span<const std::int32_t> dofs)
+  {
+    std::array<T, 3> mid = {0, 0, 0};
+    for (std::int32_t dof : dofs)
+      for (int d = 0; d < 3; ++d)
+        mid[d] += x[dof * 3 + d] / dofs.size();
+    std::array<std::int64_t, 3> index;
+    for (int d = 0; d < 3; ++d)
+      index[d] = static_cast<std::int64_t>(std::floor((mid[d] - x0[d]) / h[d]));
+    return index[0] + (index[1] << 21) + (index[2] << 42);
+  };
+
+  std::unordered_map<std::int64_t, std::int32_t> coarse_cell;
+  for (std::int32_t c = 0; c < num_coarse_cells; ++c)
+    coarse_cell[cell_key(xc, dofmapc->cell_dofs(c))] = c;
+
+  // Trilinear weights of the (vertex) dofs of a coarse cell at a point
+  auto weights = [&](std::int32_t fdof, std::span<const std::int32_t> cdofs,
+                     std::vector<std::int32_t>& cols, std::vector<T>& vals)
+  {
+    cols.clear();
+    vals.clear();
+    for (std::int32_t cdof : cdofs)
+    {
+      T w = 1;
+      for (int d = 0; d < 3; ++d)
+        w *= std::max(T(0), 1 - std::abs(xf[fdof * 3 + d] - xc[cdof * 3 + d]) / h[d]);
+      if (w > 1e-12)
+      {
+        cols.push_back(cdof);
+        vals.push_back(w);
+      }
+    }
+  };
+
+  // Rows of owned fine dofs, each computed once from the parent of a cell
+  // containing it
+  auto fmap = Vf.mesh()->topology()->index_map(tdim);
+  const std::int32_t num_fine_cells = fmap->size_local() + fmap->num_ghosts();
+  const std::int32_t num_owned = dofmapf->index_map->size_local();
+  std::vector<std::int32_t> parent(num_fine_cells, -1);
+  for (std::int32_t c = 0; c < num_fine_cells; ++c)
+  {
+    if (auto it = coarse_cell.find(cell_key(xf, dofmapf->cell_dofs(c))); it != coarse_cell.end())
+      parent[c] = it->second;
+    else if (c < fmap->size_local())
+      throw std::runtime_error("h-prolongation: parent cell not found (partitions not nested?)");
+  }
+
+  // Call f(row, cols, vals) once for each owned fine dof
+  std::vector<std::int32_t> cols;
+  std::vector<T> vals;
+  auto for_each_row = [&](auto&& f)
+  {
+    std::vector<std::int8_t> done(num_owned, 0);
+    for (std::int32_t c = 0; c < num_fine_cells; ++c)
+    {
+      if (parent[c] < 0)
+        continue;
+      auto cdofs = dofmapc->cell_dofs(parent[c]);
+      for (std::int32_t fdof : dofmapf->cell_dofs(c))
+      {
+        if (fdof >= num_owned or done[fdof])
+          continue;
+        done[fdof] = 1;
+        weights(fdof, cdofs, cols, vals);
+        std::array<std::int32_t, 1> row = {fdof};
+        f(std::span<const std::int32_t>(row), std::span<const std::int32_t>(cols),
+          std::span<const T>(vals));
+      }
+    }
+  };
+
+  la::SparsityPattern pattern(comm, {dofmapf->index_map, dofmapc->index_map}, {1, 1});
+  for_each_row([&](auto row, auto col, auto) { pattern.insert(row, col); });
+  pattern.finalize();
+
+  auto A = std::make_unique<
+      la::MatrixCSR<T, std::vector<T>, std::vector<std::int32_t>, std::vector<std::int32_t>>>(
+      pattern);
+  auto mat_set = A->mat_set_values();
+  for_each_row([&](auto row, auto col, auto val) { mat_set(row, col, val); });
+  A->scatter_rev();
+
+  return A;
+}
+
+} // namespace dolfinx::acc
@@ -1,8 +1,14 @@
+#pragma once
+
 #include "small-csr.hpp"
+#include <algorithm>
 #include <basix/finite-element.h>
 #include <basix/interpolation.h>
 #include <cstdint>
+#include <dolfinx/fem/FunctionSpace.h>
+#include <dolfinx/la/Vector.h>
 #include <hip/hip_runtime.h>
+#include <memory>
 #include <thrust/device_vector.h>
 
 namespace
@@ -38,50 +44,145 @@ __global__ void interpolate_Q1Q2(int N, const std::int32_t* cell_list, const std
   }
 }
 
+// Transpose of the interpolation from Q1 to Q2 (restriction), accumulated
+// into valuesQ1. Each Q2 value is scaled by Q2weights, the inverse of the
+// number of cells sharing the dof, so that it is counted once over all cells.
+// mat is the transpose of the local interpolation matrix.
+template <typename T>
+__global__ void restrict_Q2Q1(int N, const std::int32_t* cell_list, const std::int32_t* Q1dofmap,
+                              int Q1_dofs_per_cell, const std::int32_t* Q2dofmap,
+                              int Q2_dofs_per_cell, const T* Q2weights, const T* valuesQ2,
+                              T* valuesQ1, const SmallCSRDevice<T>* mat)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+  {
+    const std::int32_t cell = cell_list[i];
+    const std::int32_t* cellQ1 = Q1dofmap + cell * Q1_dofs_per_cell;
+    const std::int32_t* cellQ2 = Q2dofmap + cell * Q2_dofs_per_cell;
+    mat->apply_indirect_add(cellQ2, cellQ1, Q2weights, valuesQ2, valuesQ1);
+  }
+}
+
 } // namespace
 
+/// Matrix-free interpolation between two Lagrange spaces on the same mesh
+/// (e.g. two levels of a p-multigrid hierarchy), and its transpose, applied
+/// cell by cell with the local interpolation matrix. Provides the
+/// Prolongation interface of MultigridPreconditioner.
 template <typename T>
 class Interpolator
 {
 public:
-  // Set up interpolation from Q1 to Q2
-  // inp_element - element of input space
-  // out_element - element of output space
-  // inp_dofmap - dofmap of input space (on device)
-  // out_dofmap - dofmap of output space (on device)
-  // b_cells - boundary cells, to interpolate after vector update
-  // l_cells - local cells, to interpolate immediately
-  Interpolator(const basix::FiniteElement<T>& inp_element,
-               const basix::FiniteElement<T>& out_element, std::span<const std::int32_t> inp_dofmap,
-               std::span<const std::int32_t> out_dofmap, std::span<const std::int32_t> b_cells,
-               std::span<const std::int32_t> l_cells, bool use_transpose)
-      : input_dofmap(inp_dofmap), output_dofmap(out_dofmap), boundary_cells(b_cells),
-        local_cells(l_cells)
+  /// Set up interpolation from V0 (coarse) to V1 (fine)
+  /// @param V0 Input space of the interpolation
+  /// @param V1 Output space of the interpolation
+  /// @param l_cells Local cells, which have no shared dofs (processed while
+  /// the vector update is in progress)
+  /// @param b_cells Boundary cells (owned, with shared dofs, followed by
+  /// ghost cells), processed after the vector update
+  Interpolator(const dolfinx::fem::FunctionSpace<T>& V0, const dolfinx::fem::FunctionSpace<T>& V1,
+               const std::vector<int>& l_cells, const std::vector<int>& b_cells)
   {
-    // Local CSR data to be copied to device
-    std::vector<std::int32_t> _cols;
-    std::vector<std::int32_t> _row_offset;
-    std::vector<T> _vals;
+    dolfinx::common::Timer t0("~setup phase Interpolator");
 
+    const basix::FiniteElement<T>& inp_element = V0.element()->basix_element();
+    const basix::FiniteElement<T>& out_element = V1.element()->basix_element();
     num_cell_dofs_Q1 = inp_element.dim();
     num_cell_dofs_Q2 = out_element.dim();
 
-    // Checks on dofmap shapes and sizes
-    assert(input_dofmap.size() % num_cell_dofs_Q1 == 0);
-    assert(output_dofmap.size() % num_cell_dofs_Q2 == 0);
+    // Local interpolation matrix and its transpose
+    auto [mat, shape] = basix::compute_interpolation_operator(inp_element, out_element);
+    _mat_csr = std::make_unique<SmallCSR<T>>(mat, shape, false);
+    _mat_csr_t = std::make_unique<SmallCSR<T>>(mat, shape, true);
+
+    // Dofmaps (the only mesh data needed)
+    auto dofmap0 = V0.dofmap()->map();
+    auto dofmap1 = V1.dofmap()->map();
+    input_dofmap.assign(dofmap0.data_handle(), dofmap0.data_handle() + dofmap0.size());
+    output_dofmap.assign(dofmap1.data_handle(), dofmap1.data_handle() + dofmap1.size());
     assert(output_dofmap.size() / num_cell_dofs_Q2 == input_dofmap.size() / num_cell_dofs_Q1);
-    assert(_row_offset.size() == num_cell_dofs_Q2 + 1);
 
-    if (use_transpose)
-    {
-      auto [mat, shape] = basix::compute_interpolation_operator(out_element, inp_element);
-      _mat_csr = std::make_unique<SmallCSR<T>>(mat, shape, true);
-    }
+    local_cells.assign(l_cells.begin(), l_cells.end());
+    boundary_cells.assign(b_cells.begin(), b_cells.end());
+
+    // The transpose is only accumulated over owned cells (the boundary cells
+    // are sorted, with the ghost cells last)
+    auto topology = V1.mesh()->topology();
+    const int num_owned_cells = topology->index_map(topology->dim())->size_local();
+    num_owned_boundary_cells
+        = std::lower_bound(b_cells.begin(), b_cells.end(), num_owned_cells) - b_cells.begin();
+
+    // Inverse of the number of (owned, on any process) cells sharing each
+    // output dof
+    auto map1 = V1.dofmap()->index_map;
+    dolfinx::la::Vector<T> multiplicity(map1, 1);
+    std::span<T> m = multiplicity.mutable_array();
+    std::fill(m.begin(), m.end(), T(0));
+    for (int c = 0; c < num_owned_cells; ++c)
+      for (std::int32_t dof : V1.dofmap()->cell_dofs(c))
+        m[dof] += 1;
+    multiplicity.scatter_rev(std::plus<T>());
+    multiplicity.scatter_fwd();
+    std::vector<T> inv(m.begin(), m.end());
+    for (T& w : inv)
+      w = (w > 0) ? 1 / w : 0;
+    inv_multiplicity.assign(inv.begin(), inv.end());
+  }
+
+  /// Interpolate x (on V0) to y (on V1), or apply the transpose, y (on V0)
+  /// = I^T x (x on V1), with the same signature as MatrixOperator
+  template <typename Vector>
+  void operator()(Vector& x, Vector& y, bool transpose = false)
+  {
+    if (transpose)
+      apply_transpose(x, y);
     else
+      interpolate(x, y);
+  }
+
+  /// Apply the transpose of the interpolation, output_vector = I^T
+  /// input_vector. Contributions of owned cells are accumulated locally, and
+  /// those to ghost dofs are sent to their owners (scatter_rev).
+  template <typename Vector>
+  void apply_transpose(Vector& input_vector, Vector& output_vector)
+  {
+    dolfinx::common::Timer tt("% Restrict Kernel");
+
+    T* input_values = input_vector.mutable_array().data();
+    T* output_values = output_vector.mutable_array().data();
+    output_vector.set(T{0});
+
+    dim3 block_size(256);
+    int ncells = local_cells.size();
+    dim3 grid_size((ncells + block_size.x - 1) / block_size.x);
+
+    // The input is on V1 (output_dofmap) and the output on V0 (input_dofmap).
+    // Ghost values of the input are only needed on the boundary cells.
+    input_vector.scatter_fwd_begin();
+    hipLaunchKernelGGL(restrict_Q2Q1<T>, grid_size, block_size, 0, 0, ncells,
+                       thrust::raw_pointer_cast(local_cells.data()),
+                       thrust::raw_pointer_cast(input_dofmap.data()), num_cell_dofs_Q1,
+                       thrust::raw_pointer_cast(output_dofmap.data()), num_cell_dofs_Q2,
+                       thrust::raw_pointer_cast(inv_multiplicity.data()), input_values,
+                       output_values, _mat_csr_t->device_matrix());
+    err_check(hipGetLastError());
+    input_vector.scatter_fwd_end();
+
+    ncells = num_owned_boundary_cells;
+    grid_size = dim3((ncells + block_size.x - 1) / block_size.x);
+    if (ncells > 0)
     {
-      auto [mat, shape] = basix::compute_interpolation_operator(inp_element, out_element);
-      _mat_csr = std::make_unique<SmallCSR<T>>(mat, shape, false);
+      hipLaunchKernelGGL(restrict_Q2Q1<T>, grid_size, block_size, 0, 0, ncells,
+                         thrust::raw_pointer_cast(boundary_cells.data()),
+                         thrust::raw_pointer_cast(input_dofmap.data()), num_cell_dofs_Q1,
+                         thrust::raw_pointer_cast(output_dofmap.data()), num_cell_dofs_Q2,
+                         thrust::raw_pointer_cast(inv_multiplicity.data()), input_values,
+                         output_values, _mat_csr_t->device_matrix());
+      err_check(hipGetLastError());
     }
+
+    output_vector.scatter_rev();
   }
 
   // Interpolate from input_values to output_values (both on device)
@@ -95,7 +196,7 @@ public:
     T* output_values = output_vector.mutable_array().data();
 
     int ncells = local_cells.size();
-    const std::int32_t* cell_list = local_cells.data();
+    const std::int32_t* cell_list = thrust::raw_pointer_cast(local_cells.data());
     assert(ncells <= output_dofmap.size() / num_cell_dofs_Q2);
 
     dim3 block_size(256);
@@ -107,25 +208,29 @@ public:
     spdlog::info("From {} to {} on {} cells", num_cell_dofs_Q1, num_cell_dofs_Q2, ncells);
 
     hipLaunchKernelGGL(interpolate_Q1Q2<T>, grid_size, block_size, 0, 0, ncells, cell_list,
-                       input_dofmap.data(), num_cell_dofs_Q1, output_dofmap.data(),
-                       num_cell_dofs_Q2, input_values, output_values, _mat_csr->device_matrix());
+                       thrust::raw_pointer_cast(input_dofmap.data()), num_cell_dofs_Q1,
+                       thrust::raw_pointer_cast(output_dofmap.data()), num_cell_dofs_Q2,
+                       input_values, output_values, _mat_csr->device_matrix());
 
     err_check(hipGetLastError());
 
     // Wait for vector update of input_vector to complete
     input_vector.scatter_fwd_end();
 
-    const std::int32_t* b_cell_list = boundary_cells.data();
+    const std::int32_t* b_cell_list = thrust::raw_pointer_cast(boundary_cells.data());
     ncells = boundary_cells.size();
+    grid_size = dim3((ncells + block_size.x - 1) / block_size.x);
     spdlog::info("From {} dofs/cell to {} on {} (boundary) cells", num_cell_dofs_Q1,
                  num_cell_dofs_Q2, ncells);
 
-    hipLaunchKernelGGL(interpolate_Q1Q2<T>, grid_size, block_size, 0, 0, ncells, b_cell_list,
-                       input_dofmap.data(), num_cell_dofs_Q1, output_dofmap.data(),
-                       num_cell_dofs_Q2, input_values, output_values, _mat_csr->device_matrix());
-
-    err_check(hipDeviceSynchronize());
-    err_check(hipGetLastError());
+    if (ncells > 0)
+    {
+      hipLaunchKernelGGL(interpolate_Q1Q2<T>, grid_size, block_size, 0, 0, ncells, b_cell_list,
+                         thrust::raw_pointer_cast(input_dofmap.data()), num_cell_dofs_Q1,
+                         thrust::raw_pointer_cast(output_dofmap.data()), num_cell_dofs_Q2,
+                         input_values, output_values, _mat_csr->device_matrix());
+      err_check(hipGetLastError());
+    }
   }
 
 private:
@@ -133,17 +238,53 @@ private:
   int num_cell_dofs_Q1;
   int num_cell_dofs_Q2;
 
-  // Per-cell CSR interpolation matrix
+  // Per-cell CSR interpolation matrix and its transpose
   std::unique_ptr<SmallCSR<T>> _mat_csr;
+  std::unique_ptr<SmallCSR<T>> _mat_csr_t;
 
   // Dofmaps (on device).
-  std::span<const std::int32_t> input_dofmap;
-  std::span<const std::int32_t> output_dofmap;
+  thrust::device_vector<std::int32_t> input_dofmap;
+  thrust::device_vector<std::int32_t> output_dofmap;
 
   // List of cells which are in the "boundary region" which need to wait for a Vector update
   // before interpolation (on device)
-  std::span<const std::int32_t> boundary_cells;
+  thrust::device_vector<std::int32_t> boundary_cells;
+
+  // Number of owned cells at the start of boundary_cells
+  int num_owned_boundary_cells;
 
   // List of local cells, which can be updated before a Vector update
-  std::span<const std::int32_t> local_cells;
+  thrust::device_vector<std::int32_t> local_cells;
+
+  // Inverse multiplicity of the output dofs (on device)
+  thrust::device_vector<T> inv_multiplicity;
+};
+
+namespace dolfinx::acc
+{
+/// Transfer operator between two levels of a multigrid hierarchy: either a
+/// matrix-free Interpolator (levels on the same mesh) or an assembled matrix,
+/// e.g. between h-levels. Provides the Prolongation interface of
+/// MultigridPreconditioner.
+template <typename T, typename Matrix>
+class TransferOperator
+{
+public:
+  TransferOperator(std::shared_ptr<Interpolator<T>> interpolator) : _interpolator(interpolator) {}
+  TransferOperator(std::shared_ptr<Matrix> matrix) : _matrix(matrix) {}
+
+  /// Prolongation y = P x, or restriction y = P^T x if transpose is true
+  template <typename Vector>
+  void operator()(Vector& x, Vector& y, bool transpose = false)
+  {
+    if (_interpolator)
+      (*_interpolator)(x, y, transpose);
+    else
+      (*_matrix)(x, y, transpose);
+  }
+
+private:
+  std::shared_ptr<Interpolator<T>> _interpolator;
+  std::shared_ptr<Matrix> _matrix;
 };
+} // namespace dolfinx::acc
@@ -0,0 +1,235 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "cg.hpp"
+#include "vector.hpp"
+#include <algorithm>
+#include <cmath>
+#include <dolfinx/common/IndexMap.h>
+#include <dolfinx/common/MPI.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+using namespace dolfinx;
+
+namespace dolfinx::acc
+{
+
+/// Estimate the extreme eigenvalues of the Jacobi preconditioned operator
+/// D^-1 A with the Lanczos method in the D inner product, for which D^-1 A is
+/// self-adjoint. Iterations stop when the estimate of the largest eigenvalue
+/// has converged to the requested relative tolerance.
+template <typename Vector>
+class LanczosEstimator
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  LanczosEstimator(std::shared_ptr<const common::IndexMap> map, int bs)
+  {
+    _v = std::make_unique<Vector>(map, bs);
+    _w = std::make_unique<Vector>(map, bs);
+    _p = std::make_unique<Vector>(map, bs);
+    _p_prev = std::make_unique<Vector>(map, bs);
+    _r = std::make_unique<Vector>(map, bs);
+    _diag_inv = std::make_unique<Vector>(map, bs);
+  }
+
+  void set_max_iterations(int max_iter) { _max_iter = max_iter; }
+  void set_tolerance(T tolerance) { _rtol = tolerance; }
+
+  /// Number of iterations in the last call to estimate()
+  int iterations() const { return _its; }
+
+  /// Estimate the smallest and largest eigenvalue of D^-1 A
+  /// @param A The operator
+  /// @param x0 Starting vector (must not be zero)
+  /// @return Estimates of {lambda_min, lambda_max}
+  template <typename Operator>
+  std::array<T, 2> estimate(Operator& A, const Vector& x0)
+  {
+    dolfinx::common::Timer t0("~Lanczos eigenvalue estimate");
+
+    A.get_diag_inverse(*_diag_inv);
+
+    // Lanczos vectors are v_j = D^-1 p_j, with v_j D v_j = p_j . D^-1 p_j = 1
+    acc::copy(*_r, x0);
+    _p_prev->set(T{0.0});
+
+    std::vector<T> alphas, betas;
+    acc::pointwise_mult(*_v, *_r, *_diag_inv);
+    T beta = std::sqrt(acc::inner_product(*_r, *_v));
+
+    std::array<T, 2> eig = {0, 0};
+    _its = 0;
+    while (_its < _max_iter)
+    {
+      ++_its;
+
+      // p = r / beta, v = D^-1 p
+      acc::scale(*_v, T(1.0) / beta);
+      acc::copy(*_p, *_r);
+      acc::scale(*_p, T(1.0) / beta);
+
+      // w = A v, alpha = v.A v
+      A(*_v, *_w);
+      T alpha = acc::inner_product(*_v, *_w);
+      alphas.push_back(alpha);
+
+      // r = A v - alpha p - beta p_prev
+      acc::axpy(*_r, -alpha, *_p, *_w);
+      acc::axpy(*_r, -beta, *_p_prev, *_r);
+      std::swap(_p, _p_prev);
+
+      std::array<T, 2> eig_new = tridiagonal_eigenvalues(alphas, betas);
+      spdlog::info("Lanczos iteration {}: eigenvalues {} - {}", _its, eig_new[0], eig_new[1]);
+      bool converged = _its > 2 and std::abs(eig_new[1] - eig[1]) < _rtol * eig_new[1];
+      eig = eig_new;
+      if (converged)
+        break;
+
+      // beta = |r|_{D^-1}, v = D^-1 r
+      acc::pointwise_mult(*_v, *_r, *_diag_inv);
+      beta = std::sqrt(acc::inner_product(*_r, *_v));
+      if (beta == 0.0)
+        break;
+      betas.push_back(beta);
+    }
+
+    return eig;
+  }
+
+private:
+  // Extreme eigenvalues of the symmetric tridiagonal matrix with diagonal
+  // alphas and off-diagonal betas
+  static std::array<T, 2> tridiagonal_eigenvalues(const std::vector<T>& alphas,
+                                                  const std::vector<T>& betas)
+  {
+    const int n = alphas.size();
+    std::vector<T> d(alphas.begin(), alphas.end());
+    std::vector<T> e(n, 0);
+    std::copy_n(betas.begin(), n - 1, e.begin());
+    if (tqli(d.data(), e.data(), n) == -1)
+      throw std::runtime_error("Eigenvalue estimate failed");
+    auto [min, max] = std::minmax_element(d.begin(), d.end());
+    return {*min, *max};
+  }
+
+  /// Limit for the number of iterations
+  int _max_iter = 20;
+
+  /// Relative tolerance on the largest eigenvalue
+  T _rtol = 1e-3;
+
+  /// Number of iterations performed
+  int _its = 0;
+
+  /// Working vectors
+  std::unique_ptr<Vector> _v;
+  std::unique_ptr<Vector> _w;
+  std::unique_ptr<Vector> _p;
+  std::unique_ptr<Vector> _p_prev;
+  std::unique_ptr<Vector> _r;
+  std::unique_ptr<Vector> _diag_inv;
+};
+
+/// Persistent cache of eigenvalue estimates, stored as a text file with
+/// one line "key lambda_min lambda_max" per entry. The file is read and
+/// written on rank 0 only, and entries are broadcast to all ranks.
+template <typename T>
+class EigenvalueCache
+{
+public:
+  EigenvalueCache(MPI_Comm comm, std::string filename) : _comm(comm), _filename(filename)
+  {
+    if (dolfinx::MPI::rank(_comm) == 0)
+    {
+      std::ifstream file(_filename);
+      std::string key;
+      std::array<T, 2> eig;
+      while (file >> key >> eig[0] >> eig[1])
+        _entries[key] = eig;
+      spdlog::info("Read {} eigenvalue estimates from {}", _entries.size(), _filename);
+    }
+  }
+
+  /// Build a key from the problem description
+  /// @param num_dofs Global number of dofs on the level
+  /// @param degree Polynomial degree of the level
+  /// @param level Level in the hierarchy
+  /// @param coefficients Coefficient values (local to this rank), e.g. the
+  /// per-cell constants of the operator
+  /// @param max_iter Iterations of the estimator
+  /// @param tol Tolerance of the estimator
+  /// @note Collective MPI operation
+  std::string key(std::int64_t num_dofs, int degree, int level, std::span<const T> coefficients,
+                  int max_iter, T tol) const
+  {
+    // FNV-1a hash of the coefficient data, summed over ranks
+    std::uint64_t hash = 14695981039346656037ull;
+    auto bytes = std::as_bytes(coefficients);
+    for (std::byte b : bytes)
+      hash = (hash ^ static_cast<std::uint64_t>(b)) * 1099511628211ull;
+    std::uint64_t global_hash = 0;
+    MPI_Allreduce(&hash, &global_hash, 1, MPI_UINT64_T, MPI_SUM, _comm);
+
+    std::stringstream s;
+    s << "n" << num_dofs << "-p" << degree << "-l" << level << "-np"
+      << dolfinx::MPI::size(_comm) << "-k" << max_iter << "-t" << tol << "-" << std::hex
+      << global_hash;
+    return s.str();
+  }
+
+  /// Look up an entry
+  /// @return True if the key was found, in which case `eig` is set
+  /// @note Collective MPI operation
+  bool find(const std::string& key, std::array<T, 2>& eig) const
+  {
+    int found = 0;
+    if (dolfinx::MPI::rank(_comm) == 0)
+    {
+      if (auto it = _entries.find(key); it != _entries.end())
+      {
+        found = 1;
+        eig = it->second;
+      }
+    }
+    MPI_Bcast(&found, 1, MPI_INT, 0, _comm);
+    if (found)
+      MPI_Bcast(eig.data(), 2, dolfinx::MPI::mpi_type<T>(), 0, _comm);
+    return found;
+  }
+
+  /// Add an entry, and append it to the file
+  void insert(const std::string& key, std::array<T, 2> eig)
+  {
+    if (dolfinx::MPI::rank(_comm) == 0)
+    {
+      _entries[key] = eig;
+      std::ofstream file(_filename, std::ios::app);
+      file.precision(17);
+      file << key << " " << eig[0] << " " << eig[1] << "\n";
+    }
+  }
+
+  /// Remove all entries, and truncate the file
+  void clear()
+  {
+    if (dolfinx::MPI::rank(_comm) == 0)
+    {
+      _entries.clear();
+      std::ofstream file(_filename, std::ios::trunc);
+    }
+  }
+
+private:
+  MPI_Comm _comm;
+  std::string _filename;
+  std::map<std::string, std::array<T, 2>> _entries;
+};
+} // namespace dolfinx::acc
@@ -1,9 +1,8 @@
 // Copyright (C) 2023 Igor A. Baratta
 // SPDX-License-Identifier:    MIT
 
+#include "gll_tables.hpp"
 #include "hip/hip_runtime.h"
-#include <basix/finite-element.h>
-#include <basix/quadrature.h>
 #include <thrust/device_vector.h>
 
 #pragma once
@@ -132,21 +131,28 @@ __global__ void geometry_computation(const T* xgeom, T* G_entity,
 /// @param y Output vector of size (ndofs,)
 /// @param G_entity Array of size (n_entities, nq, 6) with the geometry operator G for each entity
 /// @param entity_dofmap Array of size (n_entities, ndofs) with the dofmap for each entity
-/// @param dphi Array of size (nq, ndofs) with the basis function gradients in 1D.
 /// @param entities List of entities to compute on
 /// @param n_entities Number of entries in `entities`
+/// @param bc_marker Marker for Dirichlet dofs (rows/columns replaced by the identity)
+/// @param scale Uniform scaling applied to all entity constants
 
 /// @note The kernel is launched with a 3D grid of 1D blocks, where each block
 /// is responsible for computing the stiffness operator for a single entity.
 /// The block size is (P+1, P+1, P+1) and the shared memory 4 * (P+1)^3 * sizeof(T).
+/// The 1D basis derivative table (nq, nd) is generated at build time (see
+/// gll_tables.py), so all contractions have compile-time trip counts and are
+/// fully unrolled.
 template <typename T, int P>
 __global__ void stiffness_operator(const T* x, const T* entity_constants, T* y, const T* G_entity,
-                                   const std::int32_t* entity_dofmap, const T* dphi,
-                                   const int* entities, int n_entities,
-                                   const std::int8_t* bc_marker)
+                                   const std::int32_t* entity_dofmap, const int* entities,
+                                   int n_entities, const std::int8_t* bc_marker, T scale)
 {
   constexpr int nd = P + 1; // Number of dofs per direction in 1D
   constexpr int nq = nd;    // Number of quadrature points in 1D (must be the same as nd)
+  static_assert(dolfinx::acc::tables::gll<T, P>::nd == nd, "Table size mismatch");
+
+  // Basis function gradients in 1D at quadrature points, shape (nq, nd)
+  constexpr const T* dphi = dolfinx::acc::tables::gll<T, P>::dphi;
 
   assert(blockDim.x == nd);
   assert(blockDim.y == nd);
@@ -192,6 +198,7 @@ __global__ void stiffness_operator(const T* x, const T* entity_constants, T* y,
   // Apply contraction in the x-direction
   // tx is quadrature point index, ty, tz dof indices
   T val_x = 0.0;
+#pragma unroll
   for (int ix = 0; ix < nd; ++ix)
   {
     val_x += dphi[tx * nd + ix] * scratch[ix * square_nd + ty * nd + tz];
@@ -203,6 +210,7 @@ __global__ void stiffness_operator(const T* x, const T* entity_constants, T* y,
   // Apply contraction in the y-direction
   // ty is quadrature point index, tx, tz dof indices
   T val_y = 0.0;
+#pragma unroll
   for (int iy = 0; iy < nd; ++iy)
   {
     val_y += dphi[ty * nd + iy] * scratch[tx * square_nd + iy * nd + tz];
@@ -211,6 +219,7 @@ __global__ void stiffness_operator(const T* x, const T* entity_constants, T* y,
   // Apply contraction in the z-direction
   // tz is quadrature point index, tx, ty dof indices
   T val_z = 0.0;
+#pragma unroll
   for (int iz = 0; iz < nd; ++iz)
   {
     val_z += dphi[tz * nd + iz] * scratch[tx * square_nd + ty * nd + iz];
@@ -226,7 +235,7 @@ __global__ void stiffness_operator(const T* x, const T* entity_constants, T* y,
   T G5 = G_entity[offset + 5];
 
   // DG-0 Coefficient
-  T coeff = entity_constants[block_id];
+  T coeff = scale * entity_constants[entities[block_id]];
 
   // Apply geometry
   T fw0 = coeff * (G0 * val_x + G1 * val_y + G2 * val_z);
@@ -244,6 +253,7 @@ __global__ void stiffness_operator(const T* x, const T* entity_constants, T* y,
   // Apply contraction in the x-direction
   val_x = 0.0;
   // tx is dof index, ty, tz quadrature point indices
+#pragma unroll
   for (int ix = 0; ix < nq; ++ix)
   {
     val_x += dphi[ix * nd + tx] * scratchx[ix * square_nq + ty * nd + tz];
@@ -252,6 +262,7 @@ __global__ void stiffness_operator(const T* x, const T* entity_constants, T* y,
   // Apply contraction in the y-direction and add y contribution
   // ty is dof index, tx, tz quadrature point indices
   val_y = 0.0;
+#pragma unroll
   for (int iy = 0; iy < nq; ++iy)
   {
     val_y += dphi[iy * nd + ty] * scratchy[tx * square_nq + iy * nd + tz];
@@ -260,6 +271,7 @@ __global__ void stiffness_operator(const T* x, const T* entity_constants, T* y,
   // Apply contraction in the z-direction and add z contribution
   // tz is dof index, tx, ty quadrature point indices
   val_z = 0.0;
+#pragma unroll
   for (int iz = 0; iz < nq; ++iz)
   {
     val_z += dphi[iz * nd + tz] * scratchz[tx * square_nq + ty * nd + iz];
@@ -276,9 +288,203 @@ __global__ void stiffness_operator(const T* x, const T* entity_constants, T* y,
     atomicAdd(&y[dof], val);
 }
 
+/// Compute Y = A * X for a multi-vector with `ncols` interleaved columns
+/// (entry (dof, c) at dof * ncols + c), see `stiffness_operator`. The
+/// geometry factors, coefficient and dofmap entries of each quadrature
+/// point are loaded once and reused for all columns.
+/// @note The block size is (P+1, P+1, P+1) and the shared memory 4 * (P+1)^3 * sizeof(T)
+template <typename T, int P>
+__global__ void stiffness_operator_block(const T* x, const T* entity_constants, T* y,
+                                         const T* G_entity, const std::int32_t* entity_dofmap,
+                                         const int* entities, int n_entities,
+                                         const std::int8_t* bc_marker, T scale, int ncols)
+{
+  constexpr int nd = P + 1;
+  constexpr int nq = nd;
+  constexpr const T* dphi = dolfinx::acc::tables::gll<T, P>::dphi;
+
+  constexpr int cube_nd = nd * nd * nd;
+  constexpr int cube_nq = nq * nq * nq;
+  constexpr int square_nd = nd * nd;
+  constexpr int square_nq = nq * nq;
+
+  extern __shared__ T shared_mem[];
+
+  T* scratch = shared_mem;
+  T* scratchx = shared_mem + cube_nd;
+  T* scratchy = scratchx + cube_nq;
+  T* scratchz = scratchy + cube_nq;
+
+  int tx = threadIdx.x;
+  int ty = threadIdx.y;
+  int tz = threadIdx.z;
+  int thread_id = tx * square_nd + ty * nd + tz;
+  int block_id = blockIdx.x;
+
+  if (block_id >= n_entities)
+    return;
+
+  int dof = entity_dofmap[entities[block_id] * cube_nd + thread_id];
+  const bool bc = bc_marker[dof];
+
+  int offset = (block_id * cube_nq + thread_id) * 6;
+  T G0 = G_entity[offset + 0];
+  T G1 = G_entity[offset + 1];
+  T G2 = G_entity[offset + 2];
+  T G3 = G_entity[offset + 3];
+  T G4 = G_entity[offset + 4];
+  T G5 = G_entity[offset + 5];
+  T coeff = scale * entity_constants[entities[block_id]];
+
+  for (int c = 0; c < ncols; ++c)
+  {
+    scratch[thread_id] = bc ? T(0.0) : x[dof * ncols + c];
+    __syncthreads();
+
+    T val_x = 0.0;
+    T val_y = 0.0;
+    T val_z = 0.0;
+#pragma unroll
+    for (int i = 0; i < nd; ++i)
+    {
+      val_x += dphi[tx * nd + i] * scratch[i * square_nd + ty * nd + tz];
+      val_y += dphi[ty * nd + i] * scratch[tx * square_nd + i * nd + tz];
+      val_z += dphi[tz * nd + i] * scratch[tx * square_nd + ty * nd + i];
+    }
+
+    scratchx[thread_id] = coeff * (G0 * val_x + G1 * val_y + G2 * val_z);
+    scratchy[thread_id] = coeff * (G1 * val_x + G3 * val_y + G4 * val_z);
+    scratchz[thread_id] = coeff * (G2 * val_x + G4 * val_y + G5 * val_z);
+    __syncthreads();
+
+    T val = 0.0;
+#pragma unroll
+    for (int i = 0; i < nq; ++i)
+    {
+      val += dphi[i * nd + tx] * scratchx[i * square_nq + ty * nd + tz];
+      val += dphi[i * nd + ty] * scratchy[tx * square_nq + i * nd + tz];
+      val += dphi[i * nd + tz] * scratchz[tx * square_nq + ty * nd + i];
+    }
+
+    if (bc)
+      y[dof * ncols + c] = x[dof * ncols + c];
+    else
+      atomicAdd(&y[dof * ncols + c], val);
+  }
+}
+
+/// Compute the diagonal of the stiffness operator (see `stiffness_operator`)
+/// for a set of entities, accumulating into `diag`.
+///
+/// The quadrature points coincide with the dofs, so the gradient of the
+/// basis function at dof (ix, iy, iz) is non-zero in the x-direction only at
+/// the quadrature points (qx, iy, iz), and similarly in y and z. The
+/// diagonal entry is therefore a sum of nd terms per direction plus the
+/// mixed terms at the quadrature point coinciding with the dof.
+///
+/// @tparam P Polynomial degree of the basis functions
+/// @tparam T Data type of the input and output arrays
+/// @param entity_constants Array with the constant C for each entity
+/// @param diag Output diagonal of size (ndofs,)
+/// @param G_entity Array of size (n_entities, nq, 6) with the geometry operator G for each entity
+/// @param entity_dofmap Array of size (n_entities, ndofs) with the dofmap for each entity
+/// @param entities List of entities to compute on
+/// @param n_entities Number of entries in `entities`
+/// @param bc_marker Marker for Dirichlet dofs (diagonal set to one)
+/// @param scale Uniform scaling applied to all entity constants
+/// @note The kernel is launched with the same block layout as `stiffness_operator`,
+/// and does not require shared memory.
+template <typename T, int P>
+__global__ void stiffness_diagonal(const T* entity_constants, T* diag, const T* G_entity,
+                                   const std::int32_t* entity_dofmap, const int* entities,
+                                   int n_entities, const std::int8_t* bc_marker, T scale)
+{
+  constexpr int nd = P + 1;
+  constexpr const T* dphi = dolfinx::acc::tables::gll<T, P>::dphi;
+  constexpr int square_nd = nd * nd;
+  constexpr int cube_nd = nd * nd * nd;
+
+  int tx = threadIdx.x;
+  int ty = threadIdx.y;
+  int tz = threadIdx.z;
+  int thread_id = tx * square_nd + ty * nd + tz;
+  int block_id = blockIdx.x;
+
+  if (block_id >= n_entities)
+    return;
+
+  int dof = entity_dofmap[entities[block_id] * cube_nd + thread_id];
+  if (bc_marker[dof])
+  {
+    diag[dof] = 1.0;
+    return;
+  }
+
+  // Geometry component k at quadrature point (qx, qy, qz) of this entity
+  auto G = [&](int qx, int qy, int qz, int k) -> T
+  { return G_entity[(block_id * cube_nd + qx * square_nd + qy * nd + qz) * 6 + k]; };
+
+  T val = 0.0;
+#pragma unroll
+  for (int q = 0; q < nd; ++q)
+  {
+    T dx = dphi[q * nd + tx];
+    T dy = dphi[q * nd + ty];
+    T dz = dphi[q * nd + tz];
+    val += G(q, ty, tz, 0) * dx * dx + G(tx, q, tz, 3) * dy * dy + G(tx, ty, q, 5) * dz * dz;
+  }
+
+  // Mixed terms only at the quadrature point of this dof
+  T dx = dphi[tx * nd + tx];
+  T dy = dphi[ty * nd + ty];
+  T dz = dphi[tz * nd + tz];
+  val += 2.0
+         * (G(tx, ty, tz, 1) * dx * dy + G(tx, ty, tz, 2) * dx * dz + G(tx, ty, tz, 4) * dy * dz);
+
+  atomicAdd(&diag[dof], scale * entity_constants[entities[block_id]] * val);
+}
+
 namespace dolfinx::acc
 {
 
+/// Highest degree for which kernels (and 1D tables) are instantiated
+constexpr int max_degree = 8;
+
+/// Call f.template operator()<P>() with P equal to the runtime degree
+template <typename F>
+void dispatch_degree(int degree, F&& f)
+{
+  switch (degree)
+  {
+  case 1:
+    f.template operator()<1>();
+    break;
+  case 2:
+    f.template operator()<2>();
+    break;
+  case 3:
+    f.template operator()<3>();
+    break;
+  case 4:
+    f.template operator()<4>();
+    break;
+  case 5:
+    f.template operator()<5>();
+    break;
+  case 6:
+    f.template operator()<6>();
+    break;
+  case 7:
+    f.template operator()<7>();
+    break;
+  case 8:
+    f.template operator()<8>();
+    break;
+  default:
+    throw std::runtime_error("Unsupported degree " + std::to_string(degree));
+  }
+}
+
 template <typename T>
 class MatFreeLaplacian
 {
@@ -294,25 +500,9 @@ public:
         geometry_dofmap(geometry_dofmap), dphi_geometry(dphi_geometry), G_weights(G_weights),
         bc_marker(bc_marker), lcells(lcells), bcells(bcells)
   {
-    std::map<int, int> Qdegree = {{2, 3}, {3, 4}, {4, 6}, {5, 8}};
-
-    // Create 1D element
-    auto element1D = basix::create_element<T>(
-        basix::element::family::P, basix::cell::type::interval, degree,
-        basix::element::lagrange_variant::gll_warped, basix::element::dpc_variant::unset, false);
-
-    // Create quadrature
-    auto [points, weights] = basix::quadrature::make_quadrature<T>(
-        basix::quadrature::type::gll, basix::cell::type::interval, basix::polyset::type::standard,
-        Qdegree[degree]);
-
-    // Tabulate 1D
-    auto [table, shape] = element1D.tabulate(1, points, {weights.size(), 1});
-
-    spdlog::debug("Create device vector for phi");
-    // Basis value gradient evualation table
-    dphi_d.resize(table.size() / 2);
-    thrust::copy(std::next(table.begin(), table.size() / 2), table.end(), dphi_d.begin());
+    // 1D basis tables are generated at build time for each supported degree
+    if (degree < 1 or degree > max_degree)
+      throw std::runtime_error("MatFreeLaplacian: unsupported degree " + std::to_string(degree));
   }
 
   // Compute weighted geometry data on GPU
@@ -352,20 +542,7 @@ public:
       compute_geometry<P>();
       err_check(hipDeviceSynchronize());
 
-      dim3 block_size(P + 1, P + 1, P + 1);
-      int p1cubed = (P + 1) * (P + 1) * (P + 1);
-      dim3 grid_size(cell_list_d.size());
-      std::size_t shm_size = 4 * p1cubed * sizeof(T);
-
-      T* x = in.mutable_array().data();
-      T* y = out.mutable_array().data();
-      hipLaunchKernelGGL(HIP_KERNEL_NAME(stiffness_operator<T, P>), grid_size, block_size, shm_size,
-                         0, x, cell_constants.data(), y, thrust::raw_pointer_cast(G_entity.data()),
-                         cell_dofmap.data(), thrust::raw_pointer_cast(dphi_d.data()),
-                         thrust::raw_pointer_cast(cell_list_d.data()), cell_list_d.size(),
-                         bc_marker.data());
-
-      err_check(hipGetLastError());
+      launch_stiffness<P>(in, out, bc_marker);
     }
 
     spdlog::debug("impl_operator done lcells");
@@ -375,7 +552,6 @@ public:
     spdlog::debug("out size {}", out.array().size());
     spdlog::debug("G_entity size {}", G_entity.size());
     spdlog::debug("cell_dofmap size {}", cell_dofmap.size());
-    spdlog::debug("dphi_d size {}", dphi_d.size());
     spdlog::debug("cell_list_d size {}", cell_list_d.size());
     spdlog::debug("bc_marker size {}", bc_marker.size());
 
@@ -391,42 +567,86 @@ public:
 
       compute_geometry<P>();
       err_check(hipDeviceSynchronize());
-      dim3 block_size(P + 1, P + 1, P + 1);
-      int p1cubed = (P + 1) * (P + 1) * (P + 1);
-      dim3 grid_size(cell_list_d.size());
-      std::size_t shm_size = 4 * p1cubed * sizeof(T);
-
-      T* x = in.mutable_array().data();
-      T* y = out.mutable_array().data();
-
-      hipLaunchKernelGGL(HIP_KERNEL_NAME(stiffness_operator<T, P>), grid_size, block_size, shm_size,
-                         0, x, cell_constants.data(), y, thrust::raw_pointer_cast(G_entity.data()),
-                         cell_dofmap.data(), thrust::raw_pointer_cast(dphi_d.data()),
-                         thrust::raw_pointer_cast(cell_list_d.data()), cell_list_d.size(),
-                         bc_marker.data());
-
-      err_check(hipGetLastError());
+      launch_stiffness<P>(in, out, bc_marker);
     }
 
     err_check(hipDeviceSynchronize());
     spdlog::debug("impl_operator done bcells");
   }
 
+  /// Apply the operator, out = A * in. If the vectors have block size
+  /// greater than one they are multi-vectors (one column per block entry),
+  /// and the operator is applied to all columns at once.
   template <typename Vector>
   void operator()(Vector& in, Vector& out)
   {
     spdlog::debug("Mat free operator start");
     out.set(T{0.0});
 
-    if (degree == 1)
-      impl_operator<1>(in, out);
-    else if (degree == 2)
-      impl_operator<2>(in, out);
-    else if (degree == 3)
-      impl_operator<3>(in, out);
+    dispatch_degree(degree, [&]<int P>() { impl_operator<P>(in, out); });
     spdlog::debug("Mat free operator end");
   }
 
+  /// Apply the operator using all cells on this process (owned and ghost),
+  /// without updating the ghost values of `in`. Rows of owned dofs are
+  /// complete, while rows of ghost dofs only have contributions from cells on
+  /// this process. Dofs marked in `marker` are treated as Dirichlet dofs.
+  /// Used for local (subdomain) solves, see SchwarzSmoother.
+  template <typename Vector>
+  void apply_local(Vector& in, Vector& out, std::span<const std::int8_t> marker)
+  {
+    out.set(T{0.0});
+    dispatch_degree(degree, [&]<int P>() { impl_apply_local<P>(in, out, marker); });
+  }
+
+  template <int P, typename Vector>
+  void impl_apply_local(Vector& in, Vector& out, std::span<const std::int8_t> marker)
+  {
+    std::vector<int> cells(lcells.begin(), lcells.end());
+    cells.insert(cells.end(), bcells.begin(), bcells.end());
+    if (cells.empty())
+      return;
+
+    cell_list_d.resize(cells.size());
+    thrust::copy(cells.begin(), cells.end(), cell_list_d.begin());
+    compute_geometry<P>();
+    err_check(hipDeviceSynchronize());
+    launch_stiffness<P>(in, out, marker);
+    err_check(hipDeviceSynchronize());
+  }
+
+  /// Launch the stiffness kernel on the cells in cell_list_d (geometry
+  /// already computed). Vectors with block size greater than one are
+  /// multi-vectors, with one column per block entry.
+  template <int P, typename Vector>
+  void launch_stiffness(Vector& in, Vector& out, std::span<const std::int8_t> marker)
+  {
+    dim3 block_size(P + 1, P + 1, P + 1);
+    int p1cubed = (P + 1) * (P + 1) * (P + 1);
+    dim3 grid_size(cell_list_d.size());
+    std::size_t shm_size = 4 * p1cubed * sizeof(T);
+
+    T* x = in.mutable_array().data();
+    T* y = out.mutable_array().data();
+    if (in.bs() == 1)
+    {
+      hipLaunchKernelGGL(HIP_KERNEL_NAME(stiffness_operator<T, P>), grid_size, block_size,
+                         shm_size, 0, x, cell_constants.data(), y,
+                         thrust::raw_pointer_cast(G_entity.data()), cell_dofmap.data(),
+                         thrust::raw_pointer_cast(cell_list_d.data()), cell_list_d.size(),
+                         marker.data(), _scale);
+    }
+    else
+    {
+      hipLaunchKernelGGL(HIP_KERNEL_NAME(stiffness_operator_block<T, P>), grid_size, block_size,
+                         shm_size, 0, x, cell_constants.data(), y,
+                         thrust::raw_pointer_cast(G_entity.data()), cell_dofmap.data(),
+                         thrust::raw_pointer_cast(cell_list_d.data()), cell_list_d.size(),
+                         marker.data(), _scale, in.bs());
+    }
+    err_check(hipGetLastError());
+  }
+
   template <typename Vector>
   void get_diag_inverse(Vector& diag_inv)
   {
@@ -440,9 +660,70 @@ public:
     thrust::copy(diag_inv.array().begin(), diag_inv.array().end(), _diag_inv.begin());
   }
 
+  /// Compute the inverse diagonal on device (for Jacobi preconditioning), without
+  /// assembling a matrix. Entries are computed for owned and ghost dofs, using all
+  /// cells available on this process.
+  void compute_diag_inverse()
+  {
+    dispatch_degree(degree, [&]<int P>() { impl_diag_inverse<P>(); });
+  }
+
+  template <int P>
+  void impl_diag_inverse()
+  {
+    dolfinx::common::Timer t0("~compute diagonal MatFreeLaplacian");
+
+    std::vector<int> cells(lcells.begin(), lcells.end());
+    cells.insert(cells.end(), bcells.begin(), bcells.end());
+    cell_list_d.resize(cells.size());
+    thrust::copy(cells.begin(), cells.end(), cell_list_d.begin());
+
+    _diag_inv.resize(bc_marker.size());
+    thrust::fill(_diag_inv.begin(), _diag_inv.end(), T{0.0});
+
+    if (!cells.empty())
+    {
+      compute_geometry<P>();
+      err_check(hipDeviceSynchronize());
+
+      dim3 block_size(P + 1, P + 1, P + 1);
+      dim3 grid_size(cell_list_d.size());
+      hipLaunchKernelGGL(HIP_KERNEL_NAME(stiffness_diagonal<T, P>), grid_size, block_size, 0, 0,
+                         cell_constants.data(), thrust::raw_pointer_cast(_diag_inv.data()),
+                         thrust::raw_pointer_cast(G_entity.data()), cell_dofmap.data(),
+                         thrust::raw_pointer_cast(cell_list_d.data()), cell_list_d.size(),
+                         bc_marker.data(), _scale);
+      err_check(hipGetLastError());
+    }
+
+    thrust::transform(thrust::device, _diag_inv.begin(), _diag_inv.end(), _diag_inv.begin(),
+                      [] __host__ __device__(const T& d) { return d == T{0.0} ? T{0.0} : 1 / d; });
+    err_check(hipDeviceSynchronize());
+  }
+
+  /// Replace the (on device) per-cell constants. The constants may also be
+  /// updated in place, with the same span passed again. The inverse diagonal
+  /// is not recomputed: call compute_diag_inverse() afterwards, or
+  /// MultigridPreconditioner::update_diagonals() for all levels at once.
+  void update_coefficients(std::span<const T> coefficients) { cell_constants = coefficients; }
+
+  /// Scale the operator uniformly, A <- alpha * A. The cell constants are not
+  /// modified; the scaling is applied in the kernel. Dirichlet rows are unchanged.
+  void scale(T alpha)
+  {
+    _scale *= alpha;
+    thrust::transform(thrust::device, _diag_inv.begin(), _diag_inv.end(), bc_marker.begin(),
+                      _diag_inv.begin(),
+                      [alpha] __host__ __device__(const T& d, const std::int8_t& bc)
+                      { return bc ? d : d / alpha; });
+  }
+
 private:
   int degree;
 
+  // Uniform scaling of the cell constants
+  T _scale = 1.0;
+
   // Reference to on-device storage for constants, dofmap etc.
   std::span<const T> cell_constants;
   std::span<const std::int32_t> cell_dofmap;
@@ -457,9 +738,6 @@ private:
   // On device storage for geometry data (computed for each batch of cells)
   thrust::device_vector<T> G_entity;
 
-  // On device storage for dphi
-  thrust::device_vector<T> dphi_d;
-
   // Lists of cells which are local (lcells) and boundary (bcells)
   std::vector<int> lcells, bcells;
 
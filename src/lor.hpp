@@ -0,0 +1,299 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "csr.hpp"
+#include "laplacian.hpp"
+#include "vector.hpp"
+#include <array>
+#include <cmath>
+#include <dolfinx/fem/DirichletBC.h>
+#include <dolfinx/fem/FunctionSpace.h>
+#include <dolfinx/la/MatrixCSR.h>
+#include <dolfinx/la/SparsityPattern.h>
+
+using namespace dolfinx;
+
+namespace dolfinx::acc
+{
+
+namespace impl
+{
+/// Stiffness matrix of a trilinear (Q1) hexahedron, computed with 2x2x2
+/// Gauss quadrature. Vertices and rows are in tensor product order
+/// (a * 4 + b * 2 + c).
+/// @param xv Vertex coordinates, xv[v * 3 + i]
+template <typename T>
+std::array<T, 64> q1_stiffness(const std::array<T, 24>& xv)
+{
+  const T g = 0.5 / std::sqrt(3.0);
+  const std::array<T, 2> qp = {0.5 - g, 0.5 + g};
+
+  std::array<T, 64> K;
+  K.fill(0);
+  for (T X : qp)
+    for (T Y : qp)
+      for (T Z : qp)
+      {
+        // Reference gradients of the shape functions
+        std::array<T, 24> dN;
+        for (int a = 0; a < 2; ++a)
+          for (int b = 0; b < 2; ++b)
+            for (int c = 0; c < 2; ++c)
+            {
+              const T Na = a ? X : 1 - X, Nb = b ? Y : 1 - Y, Nc = c ? Z : 1 - Z;
+              const T da = a ? 1 : -1, db = b ? 1 : -1, dc = c ? 1 : -1;
+              const int v = a * 4 + b * 2 + c;
+              dN[v * 3 + 0] = da * Nb * Nc;
+              dN[v * 3 + 1] = Na * db * Nc;
+              dN[v * 3 + 2] = Na * Nb * dc;
+            }
+
+        // Jacobian J[i][j] = dx_i/dX_j, its determinant and inverse
+        std::array<T, 9> J = {0};
+        for (int v = 0; v < 8; ++v)
+          for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+              J[i * 3 + j] += xv[v * 3 + i] * dN[v * 3 + j];
+        const T detJ = J[0] * (J[4] * J[8] - J[5] * J[7]) - J[1] * (J[3] * J[8] - J[5] * J[6])
+                       + J[2] * (J[3] * J[7] - J[4] * J[6]);
+        std::array<T, 9> Jinv
+            = {(J[4] * J[8] - J[5] * J[7]) / detJ, (J[2] * J[7] - J[1] * J[8]) / detJ,
+               (J[1] * J[5] - J[2] * J[4]) / detJ, (J[5] * J[6] - J[3] * J[8]) / detJ,
+               (J[0] * J[8] - J[2] * J[6]) / detJ, (J[2] * J[3] - J[0] * J[5]) / detJ,
+               (J[3] * J[7] - J[4] * J[6]) / detJ, (J[1] * J[6] - J[0] * J[7]) / detJ,
+               (J[0] * J[4] - J[1] * J[3]) / detJ};
+
+        // Physical gradients, dN/dx_i = sum_j dN/dX_j dX_j/dx_i
+        std::array<T, 24> grad = {0};
+        for (int v = 0; v < 8; ++v)
+          for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+              grad[v * 3 + i] += dN[v * 3 + j] * Jinv[j * 3 + i];
+
+        const T w = std::abs(detJ) / 8.0;
+        for (int u = 0; u < 8; ++u)
+          for (int v = 0; v < 8; ++v)
+            K[u * 8 + v] += w
+                            * (grad[u * 3] * grad[v * 3] + grad[u * 3 + 1] * grad[v * 3 + 1]
+                               + grad[u * 3 + 2] * grad[v * 3 + 2]);
+      }
+
+  return K;
+}
+} // namespace impl
+
+/// Assemble the low-order-refined (LOR) matrix of a high-order level: the
+/// Q1 Laplacian on the sub-mesh whose vertices are the GLL dof points of each
+/// cell, using the same dof numbering and parallel layout as V. For P >= 2 it
+/// is spectrally equivalent to the high-order operator, with 27 rather than
+/// (2P + 1)^3 non-zeros per row.
+/// @param V Function space of the level (tensor product Lagrange, GLL points)
+/// @param bcs Dirichlet conditions (rows and columns are replaced by identity)
+/// @param coefficients Per-cell constants (on host)
+/// @return Host matrix, with ghost contributions accumulated, ready to create
+/// a MatrixOperator
+template <typename T>
+std::unique_ptr<
+    la::MatrixCSR<T, std::vector<T>, std::vector<std::int32_t>, std::vector<std::int32_t>>>
+create_lor_matrix(const fem::FunctionSpace<T>& V,
+                  const std::vector<std::shared_ptr<const fem::DirichletBC<T, double>>>& bcs,
+                  std::span<const T> coefficients)
+{
+  dolfinx::common::Timer t0("~setup phase LOR matrix");
+
+  const int degree = V.element()->basix_element().degree();
+  const int nd = degree + 1;
+
+  // GLL points on [0, 1], the vertices of the sub-cells
+  std::vector<T> pts;
+  dispatch_degree(degree,
+                  [&]<int P>()
+                  {
+                    using table = dolfinx::acc::tables::gll<T, P>;
+                    pts.assign(table::points.begin(), table::points.end());
+                  });
+
+  auto mesh = V.mesh();
+  auto dofmap = V.dofmap();
+  auto map = dofmap->index_map;
+  const int tdim = mesh->topology()->dim();
+  const std::int32_t num_cells = mesh->topology()->index_map(tdim)->size_local();
+
+  std::vector<std::int8_t> bc_marker(map->size_local() + map->num_ghosts(), 0);
+  for (auto& bc : bcs)
+  {
+    auto [dofs, pos] = bc->dof_indices();
+    for (std::int32_t index : dofs)
+      bc_marker[index] = 1;
+  }
+
+  // Dofs of sub-cell (i, j, k) of a cell, in tensor product order
+  auto sub_cell_dofs = [&](std::span<const std::int32_t> cell_dofs, int i, int j, int k,
+                           std::array<std::int32_t, 8>& dofs)
+  {
+    for (int a = 0; a < 2; ++a)
+      for (int b = 0; b < 2; ++b)
+        for (int c = 0; c < 2; ++c)
+          dofs[a * 4 + b * 2 + c] = cell_dofs[(i + a) * nd * nd + (j + b) * nd + (k + c)];
+  };
+
+  la::SparsityPattern pattern(mesh->comm(), {map, map}, {1, 1});
+  std::array<std::int32_t, 8> dofs;
+  for (std::int32_t cell = 0; cell < num_cells; ++cell)
+  {
+    auto cell_dofs = dofmap->cell_dofs(cell);
+    for (int i = 0; i < degree; ++i)
+      for (int j = 0; j < degree; ++j)
+        for (int k = 0; k < degree; ++k)
+        {
+          sub_cell_dofs(cell_dofs, i, j, k, dofs);
+          pattern.insert(dofs, dofs);
+        }
+  }
+  pattern.finalize();
+
+  auto A = std::make_unique<
+      la::MatrixCSR<T, std::vector<T>, std::vector<std::int32_t>, std::vector<std::int32_t>>>(
+      pattern);
+  auto mat_add = A->mat_add_values();
+
+  // Sub-cell vertices are mapped with the trilinear map of the cell vertices
+  // (geometry nodes 0-7, in tensor product order)
+  auto x_dofmap = mesh->geometry().dofmap();
+  std::span<const T> x = mesh->geometry().x();
+  std::array<T, 24> xc, xv;
+  for (std::int32_t cell = 0; cell < num_cells; ++cell)
+  {
+    for (int v = 0; v < 8; ++v)
+      for (int l = 0; l < 3; ++l)
+        xc[v * 3 + l] = x[3 * x_dofmap(cell, v) + l];
+
+    auto cell_dofs = dofmap->cell_dofs(cell);
+    for (int i = 0; i < degree; ++i)
+      for (int j = 0; j < degree; ++j)
+        for (int k = 0; k < degree; ++k)
+        {
+          for (int a = 0; a < 2; ++a)
+            for (int b = 0; b < 2; ++b)
+              for (int c = 0; c < 2; ++c)
+              {
+                const T X = pts[i + a], Y = pts[j + b], Z = pts[k + c];
+                const int v = a * 4 + b * 2 + c;
+                for (int l = 0; l < 3; ++l)
+                  xv[v * 3 + l] = (1 - X) * ((1 - Y) * ((1 - Z) * xc[l] + Z * xc[3 + l])
+                                             + Y * ((1 - Z) * xc[6 + l] + Z * xc[9 + l]))
+                                  + X * ((1 - Y) * ((1 - Z) * xc[12 + l] + Z * xc[15 + l])
+                                         + Y * ((1 - Z) * xc[18 + l] + Z * xc[21 + l]));
+              }
+
+          std::array<T, 64> Ke = impl::q1_stiffness(xv);
+          sub_cell_dofs(cell_dofs, i, j, k, dofs);
+          const T coeff = coefficients[cell];
+          for (int u = 0; u < 8; ++u)
+            for (int v = 0; v < 8; ++v)
+              Ke[u * 8 + v] *= (bc_marker[dofs[u]] or bc_marker[dofs[v]]) ? 0 : coeff;
+          mat_add(dofs, dofs, Ke);
+        }
+  }
+
+  A->scatter_rev();
+  fem::set_diagonal<T>(A->mat_set_values(), V, bcs, T(1.0));
+
+  return A;
+}
+
+/// Smoother (or preconditioner) for a high-order level using its
+/// low-order-refined matrix. Each step computes the residual with the
+/// high-order operator, solves approximately with the LOR matrix using an
+/// inner solver (e.g. Chebyshev or l1-Jacobi with the LOR diagonal), and
+/// adds the correction to x.
+template <typename Vector, typename Solver>
+class LORSmoother
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  /// Create a smoother
+  /// @param map Index map of the level
+  /// @param bs Block size
+  /// @param lor The LOR matrix (see create_lor_matrix)
+  /// @param solver Inner solver, applied to the LOR matrix
+  LORSmoother(std::shared_ptr<const common::IndexMap> map, int bs,
+              std::shared_ptr<MatrixOperator<T>> lor, std::shared_ptr<Solver> solver)
+      : _lor(lor), _solver(solver)
+  {
+    _r = std::make_unique<Vector>(map, bs);
+    _e = std::make_unique<Vector>(map, bs);
+  }
+
+  /// Set the number of outer (high-order residual) steps
+  void set_max_iterations(int max_iter) { _max_iter = max_iter; }
+
+  /// The inner solver uses the diagonal of the LOR matrix, not of A
+  template <typename Operator>
+  void update_diagonal(Operator&)
+  {
+  }
+
+  /// Update the smoother after the operator has been scaled uniformly by alpha
+  void rescale(T alpha)
+  {
+    _lor->scale(alpha);
+    _solver->rescale(alpha);
+  }
+
+  /// Apply max_iter LOR-preconditioned steps to Ax = b
+  /// @param zero_guess If true, the initial value of x is ignored and
+  /// taken to be zero, which saves one application of A
+  template <typename Operator>
+  void solve(Operator& A, Vector& x, const Vector& b, bool verbose, bool zero_guess = false)
+  {
+    dolfinx::common::Timer t0("~LORSmoother solve");
+
+    for (int k = 0; k < _max_iter; k++)
+    {
+      const bool zero = (k == 0 and zero_guess);
+
+      // r = b - A x
+      if (zero)
+        acc::copy(*_r, b);
+      else
+      {
+        A(x, *_r);
+        acc::axpy(*_r, T(-1), *_r, b);
+      }
+
+      // A_lor e = r
+      _solver->solve(*_lor, *_e, *_r, false, true);
+
+      if (zero)
+        acc::copy(x, *_e);
+      else
+        acc::axpy(x, T(1), *_e, x);
+
+      if (verbose)
+      {
+        A(x, *_r);
+        acc::axpy(*_r, T(-1), *_r, b);
+        spdlog::info("LOR iteration {}, UNPRECONDITIONED residual norm = {}", k + 1,
+                     acc::norm(*_r));
+      }
+    }
+  }
+
+private:
+  /// Number of outer steps
+  int _max_iter = 1;
+
+  /// LOR matrix and its (approximate) solver
+  std::shared_ptr<MatrixOperator<T>> _lor;
+  std::shared_ptr<Solver> _solver;
+
+  /// Working vectors
+  std::unique_ptr<Vector> _r;
+  std::unique_ptr<Vector> _e;
+};
+} // namespace dolfinx::acc
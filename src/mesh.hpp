@@ -2,6 +2,7 @@
 #include <basix/finite-element.h>
 #include <dolfinx/fem/CoordinateElement.h>
 #include <dolfinx/fem/FunctionSpace.h>
+#include <dolfinx/la/Vector.h>
 #include <dolfinx/mesh/Mesh.h>
 #include <dolfinx/mesh/utils.h>
 #include <map>
@@ -70,11 +71,54 @@ std::vector<T> create_geom(MPI_Comm comm, std::array<std::array<double, 3>, 2> p
   return geom;
 }
 
+/// @brief Create a cell partitioner for the structured meshes of build_hex,
+/// which assigns the cells to processes in blocks of the grid coarsened
+/// `levels` times by a factor of 2 (using MPI_Dims_create). Meshes of the same
+/// box with n, n / 2, ..., n / 2^levels cells per direction are then
+/// partitioned such that each cell is on the same process as its parent on
+/// every coarser mesh, as required by the h-multigrid transfer operators.
+/// @param n Number of cells in each direction, divisible by 2^levels
+/// @param levels Number of coarsenings to the grid that is partitioned
+inline dolfinx::mesh::CellPartitionFunction
+create_structured_partitioner(std::array<std::int64_t, 3> n, int levels)
+{
+  for (int d = 0; d < 3; ++d)
+    if (n[d] % (std::int64_t(1) << levels) != 0)
+      throw std::runtime_error("Number of cells is not divisible by 2^levels");
+
+  return [n, levels](MPI_Comm, int nparts, const std::vector<dolfinx::mesh::CellType>&,
+                     const std::vector<std::span<const std::int64_t>>& cells)
+  {
+    std::array<int, 3> dims = {0, 0, 0};
+    MPI_Dims_create(nparts, 3, dims.data());
+
+    std::vector<std::int32_t> dests;
+    std::vector<std::int32_t> offsets = {0};
+    std::span<const std::int64_t> c = cells.front();
+    for (std::size_t i = 0; i < c.size(); i += 8)
+    {
+      // Grid index of the cell from its first vertex (see build_hex)
+      const std::int64_t v0 = c[i];
+      const std::array<std::int64_t, 3> index = {v0 % (n[0] + 1), (v0 / (n[0] + 1)) % (n[1] + 1),
+                                                 v0 / ((n[0] + 1) * (n[1] + 1))};
+      std::array<std::int64_t, 3> block;
+      for (int d = 0; d < 3; ++d)
+        block[d] = ((index[d] >> levels) * dims[d]) / (n[d] >> levels);
+      dests.push_back((block[2] * dims[1] + block[1]) * dims[0] + block[0]);
+      offsets.push_back(dests.size());
+    }
+    return dolfinx::graph::AdjacencyList<std::int32_t>(std::move(dests), std::move(offsets));
+  };
+}
+
 /// Create hex mesh with a coordinate element
+/// @param partitioner Cell partitioner, e.g. create_structured_partitioner
 template <std::floating_point T>
 dolfinx::mesh::Mesh<T>
 build_hex(MPI_Comm comm, MPI_Comm subcomm, std::array<std::array<double, 3>, 2> p,
-          std::array<std::int64_t, 3> n, const dolfinx::fem::CoordinateElement<T>& element)
+          std::array<std::int64_t, 3> n, const dolfinx::fem::CoordinateElement<T>& element,
+          const dolfinx::mesh::CellPartitionFunction& partitioner
+          = dolfinx::mesh::create_cell_partitioner())
 {
   common::Timer timer("Build BoxMesh (hexahedra)");
   std::vector<T> x;
@@ -110,27 +154,45 @@ build_hex(MPI_Comm comm, MPI_Comm subcomm, std::array<std::array<double, 3>, 2>
     }
   }
 
-  auto partitioner = dolfinx::mesh::create_cell_partitioner();
-
   return create_mesh(comm, subcomm, cells, element, subcomm, x, {x.size() / 3, 3}, partitioner);
 }
 
-/// @brief Create a new mesh with an extra boundary layer, such that all cells on other processes
-/// which share a vertex with this process are ghosted.
+/// @brief Create a new mesh with extra boundary layers, such that all cells on other processes
+/// which share a vertex with this process are ghosted, and recursively for `num_layers` layers.
 /// @param mesh Input mesh
 /// @param coord_element A coordinate element for the new mesh. This may be tensor product ordering.
-
+/// @param num_layers Number of layers of ghost cells
+/// @param permute Permute the geometry dofmap of the input mesh to the ordering of `coord_element`
+/// (only for the first layer, the geometry of the new mesh is already in this ordering)
+/// @param to_vertex_owners Also send each cell to the owners of its ghost vertices. The first
+/// layer sends a cell only to the processes which ghost one of its owned vertices. An additional
+/// layer has to grow out of the ghost cells of the previous one, whose vertices are largely owned
+/// by other processes, so it uses both rules (set for the additional layers only).
 template <std::floating_point T>
 dolfinx::mesh::Mesh<T> ghost_layer_mesh(dolfinx::mesh::Mesh<T>& mesh,
-                                        dolfinx::fem::CoordinateElement<T> coord_element)
+                                        dolfinx::fem::CoordinateElement<T> coord_element,
+                                        int num_layers = 1, bool permute = true,
+                                        bool to_vertex_owners = false)
 {
+  if (num_layers < 1)
+    throw std::runtime_error("ghost_layer_mesh: at least one layer is required");
+  if (num_layers > 1)
+  {
+    dolfinx::mesh::Mesh<T> inner
+        = ghost_layer_mesh(mesh, coord_element, num_layers - 1, permute, to_vertex_owners);
+    inner.topology_mutable()->create_connectivity(3, 0);
+    return ghost_layer_mesh(inner, coord_element, 1, false, true);
+  }
+
   constexpr int tdim = 3;
   constexpr int gdim = 3;
   std::size_t ncells = mesh.topology()->index_map(tdim)->size_local();
   std::size_t num_vertices = mesh.topology()->index_map(0)->size_local();
 
-  // Find which local vertices are ghosted elsewhere
+  // Find which local vertices are ghosted elsewhere (owned vertices), and
+  // the owners of ghost vertices (additional layers only)
   auto vertex_destinations = mesh.topology()->index_map(0)->index_to_dest_ranks();
+  auto vertex_owners = mesh.topology()->index_map(0)->owners();
 
   // Map from any local cells to processes where they should be ghosted
   std::map<int, std::vector<int>> cell_to_dests;
@@ -142,9 +204,14 @@ dolfinx::mesh::Mesh<T> ghost_layer_mesh(dolfinx::mesh::Mesh<T>& mesh,
     cdests.clear();
     for (auto v : c_to_v->links(c))
     {
-      auto vdest = vertex_destinations.links(v);
-      for (int dest : vdest)
-        cdests.push_back(dest);
+      if (v < static_cast<std::int32_t>(num_vertices))
+      {
+        auto vdest = vertex_destinations.links(v);
+        for (int dest : vdest)
+          cdests.push_back(dest);
+      }
+      else if (to_vertex_owners)
+        cdests.push_back(vertex_owners[v - num_vertices]);
     }
     std::sort(cdests.begin(), cdests.end());
     cdests.erase(std::unique(cdests.begin(), cdests.end()), cdests.end());
@@ -174,15 +241,23 @@ dolfinx::mesh::Mesh<T> ghost_layer_mesh(dolfinx::mesh::Mesh<T>& mesh,
     return dolfinx::graph::AdjacencyList<std::int32_t>(std::move(dests), std::move(offsets));
   };
 
-  std::array<std::size_t, 2> xshape = {num_vertices, gdim};
+  std::array<std::size_t, 2> xshape = {
+      static_cast<std::size_t>(mesh.geometry().index_map()->size_local()), gdim};
   std::span<const T> x(mesh.geometry().x().data(), xshape[0] * xshape[1]);
 
   auto dofmap = mesh.geometry().dofmap();
   auto imap = mesh.geometry().index_map();
   std::vector<std::int32_t> permuted_dofmap;
-  std::vector<int> perm = basix::tp_dof_ordering(
-      basix::element::family::P, mesh::cell_type_to_basix_type(coord_element.cell_shape()),
-      coord_element.degree(), coord_element.variant(), basix::element::dpc_variant::unset, false);
+  std::vector<int> perm(dofmap.extent(1));
+  if (permute)
+  {
+    perm = basix::tp_dof_ordering(
+        basix::element::family::P, mesh::cell_type_to_basix_type(coord_element.cell_shape()),
+        coord_element.degree(), coord_element.variant(), basix::element::dpc_variant::unset,
+        false);
+  }
+  else
+    std::iota(perm.begin(), perm.end(), 0);
   for (std::size_t c = 0; c < dofmap.extent(0); ++c)
   {
     auto cell_dofs = std::submdspan(dofmap, c, std::full_extent);
@@ -248,3 +323,46 @@ compute_boundary_cells(std::shared_ptr<dolfinx::fem::FunctionSpace<T>> V)
 
   return {std::move(local_cells), std::move(boundary_cells)};
 }
+
+/// @brief Mark the dofs on the artificial boundary of the local subdomain,
+/// i.e. ghost dofs which are shared with cells that are not on this process.
+/// The local problem on owned and ghost cells, with these dofs treated as
+/// Dirichlet dofs, is the overlapping subdomain problem used by the
+/// restricted additive Schwarz smoother.
+/// @note Collective MPI operation
+template <typename T>
+std::vector<std::int8_t>
+compute_subdomain_interface(std::shared_ptr<dolfinx::fem::FunctionSpace<T>> V)
+{
+  auto mesh = V->mesh();
+  int tdim = mesh->topology()->dim();
+  int ncells_local = mesh->topology()->index_map(tdim)->size_local();
+  int ncells_ghost = mesh->topology()->index_map(tdim)->num_ghosts();
+  auto dofmap = V->dofmap();
+  auto map = dofmap->index_map;
+  const std::int32_t size = map->size_local() + map->num_ghosts();
+
+  // Count cells on this process touching each dof, and owned cells (summed
+  // over all processes) touching each dof
+  std::vector<std::int32_t> local_count(size, 0);
+  dolfinx::la::Vector<std::int32_t> global_count(map, 1);
+  global_count.set(0);
+  std::span<std::int32_t> gc = global_count.mutable_array();
+  for (int c = 0; c < ncells_local + ncells_ghost; ++c)
+  {
+    for (auto dof : dofmap->cell_dofs(c))
+    {
+      local_count[dof]++;
+      if (c < ncells_local)
+        gc[dof]++;
+    }
+  }
+  global_count.scatter_rev(std::plus<std::int32_t>());
+  global_count.scatter_fwd();
+
+  std::vector<std::int8_t> marker(size, 0);
+  for (std::int32_t i = 0; i < size; ++i)
+    marker[i] = local_count[i] < gc[i];
+
+  return marker;
+}
@@ -0,0 +1,80 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "vector.hpp"
+#include <dolfinx/common/IndexMap.h>
+
+using namespace dolfinx;
+
+namespace
+{
+/// Copy with conversion of the value type, y = x
+template <typename T, typename U>
+static __global__ void convert_values(int N, const U* __restrict__ x, T* __restrict__ y)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+    y[i] = static_cast<T>(x[i]);
+}
+} // namespace
+
+namespace dolfinx::acc
+{
+
+/// Copy the owned entries of x into y, converting the value type. The two
+/// vectors must have the same parallel layout.
+template <typename VectorOut, typename VectorIn>
+void convert(VectorOut& y, const VectorIn& x)
+{
+  using T = typename VectorOut::value_type;
+  using U = typename VectorIn::value_type;
+
+  const int N = x.bs() * x.map()->size_local();
+  dim3 block_size(512);
+  dim3 grid_size((N + block_size.x - 1) / block_size.x);
+  hipLaunchKernelGGL((convert_values<T, U>), grid_size, block_size, 0, 0, N, x.array().data(),
+                     y.mutable_array().data());
+  err_check(hipGetLastError());
+}
+
+/// Apply a preconditioner in a lower precision, e.g. a multigrid hierarchy
+/// in single precision inside a double precision Krylov solver. The residual
+/// is converted on input and the correction on output; the outer iteration
+/// keeps the accuracy of the higher precision.
+template <typename Vector, typename LowVector, typename Preconditioner>
+class MixedPrecisionPreconditioner
+{
+public:
+  /// Create a preconditioner
+  /// @param map Index map of the vectors
+  /// @param bs Block size
+  /// @param M Preconditioner operating on LowVector, which must provide
+  /// `apply(const LowVector& r, LowVector& z)`
+  MixedPrecisionPreconditioner(std::shared_ptr<const common::IndexMap> map, int bs,
+                               std::shared_ptr<Preconditioner> M)
+      : _M(M)
+  {
+    _r = std::make_unique<LowVector>(map, bs);
+    _z = std::make_unique<LowVector>(map, bs);
+  }
+
+  // Apply M^{-1}r = z
+  void apply(const Vector& r, Vector& z, bool verbose = false)
+  {
+    dolfinx::common::Timer t0("~apply MixedPrecisionPreconditioner");
+    acc::convert(*_r, r);
+    _M->apply(*_r, *_z, verbose);
+    acc::convert(z, *_z);
+  }
+
+private:
+  /// Lower precision preconditioner
+  std::shared_ptr<Preconditioner> _M;
+
+  /// Working vectors in the lower precision
+  std::unique_ptr<LowVector> _r;
+  std::unique_ptr<LowVector> _z;
+};
+} // namespace dolfinx::acc
@@ -0,0 +1,215 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "vector.hpp"
+#include <array>
+#include <dolfinx/common/IndexMap.h>
+#include <dolfinx/common/MPI.h>
+
+#include "amd_gpu.hpp"
+
+using namespace dolfinx;
+
+namespace
+{
+/// Fused vector updates of pipelined CG (owned entries):
+/// z = n + beta z, q = m + beta q, s = w + beta s, p = u + beta p,
+/// x += alpha p, r -= alpha s, u -= alpha q, w -= alpha z
+template <typename T>
+static __global__ void pipelined_cg_update(int N, T alpha, T beta, const T* __restrict__ m,
+                                           const T* __restrict__ n, T* __restrict__ x,
+                                           T* __restrict__ r, T* __restrict__ u,
+                                           T* __restrict__ w, T* __restrict__ p,
+                                           T* __restrict__ s, T* __restrict__ q,
+                                           T* __restrict__ z)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+  {
+    T zi = n[i] + beta * z[i];
+    T qi = m[i] + beta * q[i];
+    T si = w[i] + beta * s[i];
+    T pi = u[i] + beta * p[i];
+    z[i] = zi;
+    q[i] = qi;
+    s[i] = si;
+    p[i] = pi;
+    x[i] += alpha * pi;
+    r[i] -= alpha * si;
+    u[i] -= alpha * qi;
+    w[i] -= alpha * zi;
+  }
+}
+} // namespace
+
+namespace dolfinx::acc
+{
+
+/// Pipelined preconditioned conjugate gradient method (Ghysels and
+/// Vanroose). The two inner products of each iteration are combined in a
+/// single non-blocking reduction, which is overlapped with the application
+/// of the preconditioner and of the operator. The unpreconditioned residual
+/// norm used for the convergence test is only computed every
+/// `check_interval` iterations, as part of the same reduction.
+template <typename Vector>
+class PipelinedCGSolver
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  PipelinedCGSolver(std::shared_ptr<const common::IndexMap> map, int bs) : _map{map}, _bs{bs}
+  {
+    _r = std::make_unique<Vector>(_map, _bs);
+    _u = std::make_unique<Vector>(_map, _bs);
+    _w = std::make_unique<Vector>(_map, _bs);
+    _m = std::make_unique<Vector>(_map, _bs);
+    _n = std::make_unique<Vector>(_map, _bs);
+    _p = std::make_unique<Vector>(_map, _bs);
+    _s = std::make_unique<Vector>(_map, _bs);
+    _q = std::make_unique<Vector>(_map, _bs);
+    _z = std::make_unique<Vector>(_map, _bs);
+    _diag_inv = std::make_unique<Vector>(_map, _bs);
+  }
+
+  void set_max_iterations(int max_iter) { _max_iter = max_iter; }
+  void set_tolerance(double tolerance) { _rtol = tolerance; }
+
+  /// Test for convergence every `interval` iterations only (default 1). The
+  /// solver may then do up to interval - 1 iterations more than needed, but
+  /// skips the local residual norm on the other iterations.
+  void set_check_interval(int interval) { _check_interval = interval; }
+
+  /// Solve Ax = b with Jacobi preconditioning
+  template <typename Operator>
+  int solve(Operator& A, Vector& x, const Vector& b, bool verbose = false)
+  {
+    A.get_diag_inverse(*_diag_inv);
+    return solve_impl(
+        A, [&](const Vector& in, Vector& out) { acc::pointwise_mult(out, in, *_diag_inv); }, x,
+        b, verbose);
+  }
+
+  /// Solve Ax = b with preconditioner M, which must provide
+  /// `apply(const Vector& r, Vector& z)` computing z = M^-1 r (a multigrid
+  /// preconditioner must be set to use a zero initial guess)
+  template <typename Operator, typename Preconditioner>
+  int solve(Operator& A, Preconditioner& M, Vector& x, const Vector& b, bool verbose = false)
+  {
+    return solve_impl(
+        A, [&](const Vector& in, Vector& out) { M.apply(in, out); }, x, b, verbose);
+  }
+
+private:
+  template <typename Operator, typename Precondition>
+  int solve_impl(Operator& A, Precondition&& precondition, Vector& x, const Vector& b,
+                 bool verbose)
+  {
+    dolfinx::common::Timer t0("~PipelinedCG solve");
+
+    MPI_Comm comm = _map->comm();
+    int rank = dolfinx::MPI::rank(comm);
+
+    const int N = _bs * _map->size_local();
+    dim3 block_size(512);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+
+    // r = b - Ax, u = M^-1 r, w = Au
+    A(x, *_w);
+    acc::axpy(*_r, T(-1), *_w, b);
+    precondition(*_r, *_u);
+    A(*_u, *_w);
+
+    // The search directions are updated with beta = 0 in the first iteration
+    _p->set(T{0.0});
+    _s->set(T{0.0});
+    _q->set(T{0.0});
+    _z->set(T{0.0});
+
+    const T rtol2 = _rtol * _rtol;
+    T rnorm0 = -1;
+    T gamma_old = 0, alpha_old = 0;
+
+    int k = 0;
+    while (k < _max_iter)
+    {
+      add_profiling_annotation("pipelined cg solver iteration");
+      const bool check = (k % _check_interval == 0);
+
+      // Local gamma = (r, u), delta = (w, u) and, if checking, (r, r)
+      std::array<T, 3> dots = {acc::inner_product_local(*_r, *_u),
+                               acc::inner_product_local(*_w, *_u),
+                               check ? acc::inner_product_local(*_r, *_r) : T(0)};
+      MPI_Request request;
+      MPI_Iallreduce(MPI_IN_PLACE, dots.data(), check ? 3 : 2, dolfinx::MPI::mpi_type<T>(),
+                     MPI_SUM, comm, &request);
+
+      // m = M^-1 w, n = Am, overlapped with the reduction
+      precondition(*_w, *_m);
+      A(*_m, *_n);
+
+      MPI_Wait(&request, MPI_STATUS_IGNORE);
+      const auto [gamma, delta, rnorm] = dots;
+
+      if (check)
+      {
+        if (rnorm0 < 0)
+          rnorm0 = rnorm;
+        if (rank == 0 and verbose)
+          std::cout << "Iteration " << k << " residual " << std::sqrt(rnorm) << std::endl;
+        if (rnorm <= rtol2 * rnorm0)
+          break;
+      }
+
+      T alpha, beta;
+      if (k == 0)
+      {
+        beta = 0;
+        alpha = gamma / delta;
+      }
+      else
+      {
+        beta = gamma / gamma_old;
+        alpha = gamma / (delta - beta * gamma / alpha_old);
+      }
+      gamma_old = gamma;
+      alpha_old = alpha;
+
+      hipLaunchKernelGGL(pipelined_cg_update<T>, grid_size, block_size, 0, 0, N, alpha, beta,
+                         _m->array().data(), _n->array().data(), x.mutable_array().data(),
+                         _r->mutable_array().data(), _u->mutable_array().data(),
+                         _w->mutable_array().data(), _p->mutable_array().data(),
+                         _s->mutable_array().data(), _q->mutable_array().data(),
+                         _z->mutable_array().data());
+      err_check(hipGetLastError());
+
+      ++k;
+      remove_profiling_annotation("pipelined cg solver iteration");
+    }
+    return k;
+  }
+
+  /// Limit for the number of iterations the solver is allowed to do
+  int _max_iter;
+
+  /// Relative tolerance
+  T _rtol;
+
+  /// Number of iterations between convergence tests
+  int _check_interval = 1;
+
+  // Map describing the data layout
+  std::shared_ptr<const common::IndexMap> _map;
+
+  // Block size
+  int _bs;
+
+  /// Working vectors: residual r, u = M^-1 r, w = Au, m = M^-1 w, n = Am,
+  /// and the recurrences p, s = Ap, q = M^-1 s, z = Aq
+  std::unique_ptr<Vector> _r, _u, _w, _m, _n;
+  std::unique_ptr<Vector> _p, _s, _q, _z;
+  std::unique_ptr<Vector> _diag_inv;
+};
+} // namespace dolfinx::acc
@@ -4,13 +4,26 @@
 #include "interpolate.hpp"
 #include "vector.hpp"
 #include <algorithm>
+#include <array>
 #include <dolfinx/common/IndexMap.h>
 #include <dolfinx/common/MPI.h>
+#include <string>
+#include <type_traits>
 
 using namespace dolfinx;
 
 namespace dolfinx::acc
 {
+/// Multigrid cycle types: V (one visit of each coarser level), W (two
+/// visits) and F (a recursive F-cycle followed by a V-cycle on each coarser
+/// level)
+enum class CycleType
+{
+  V,
+  W,
+  F
+};
+
 /// Conjugate gradient method
 template <typename Vector, typename Operator, typename Prolongation, typename Restriction,
           typename Solver, typename CoarseSolver>
@@ -44,7 +57,13 @@ public:
 
   void set_solvers(std::vector<std::shared_ptr<Solver>>& solvers) { _solvers = solvers; }
 
-  void set_coarse_solver(std::shared_ptr<CoarseSolver> solver) { _coarse_solver = solver; }
+  /// Set the coarse solver, which is assumed to be set up for the current
+  /// coarse operator, i.e. any earlier scale_coefficients() is discarded
+  void set_coarse_solver(std::shared_ptr<CoarseSolver> solver)
+  {
+    _coarse_solver = solver;
+    _coarse_scale = 1;
+  }
 
   void set_operators(std::vector<std::shared_ptr<Operator>>& operators) { _operators = operators; }
 
@@ -53,6 +72,100 @@ public:
     _interpolation = interpolators;
   }
 
+  /// Update the hierarchy after the coefficient has been scaled uniformly by
+  /// alpha (e.g. a change of kappa). Operators and diagonals are scaled in place
+  /// and the smoothers are notified. Prolongations, communication plans and the
+  /// coarse solver setup are left untouched; the coarse correction is rescaled.
+  void scale_coefficients(T alpha)
+  {
+    dolfinx::common::Timer t0("~update MultigridPreconditioner coefficients");
+    for (std::size_t i = 0; i < _operators.size(); i++)
+    {
+      _operators[i]->scale(alpha);
+      _solvers[i]->rescale(alpha);
+    }
+    _coarse_scale *= alpha;
+  }
+
+  /// Refresh the operator diagonals after the per-cell constants have been
+  /// modified (see MatFreeLaplacian::update_coefficients), and pass them on to
+  /// the smoothers. Operators without compute_diag_inverse() (assembled
+  /// operators, whose diagonal is fixed at setup or updated by scale()) only
+  /// pass on their current diagonal.
+  /// Eigenvalue bounds for the smoothers are not updated, and should be
+  /// re-estimated by the caller if the change is not a uniform scaling.
+  void update_diagonals()
+  {
+    dolfinx::common::Timer t0("~update MultigridPreconditioner diagonals");
+    for (std::size_t i = 0; i < _operators.size(); i++)
+    {
+      if constexpr (requires(Operator& A) { A.compute_diag_inverse(); })
+        _operators[i]->compute_diag_inverse();
+      _solvers[i]->update_diagonal(*_operators[i]);
+    }
+  }
+
+  /// Use a zero initial guess on the finest level, i.e. ignore the input
+  /// value of y in apply(). This is the case when the preconditioner is used
+  /// inside a Krylov method, and saves one operator application.
+  void set_zero_initial_guess(bool zero_guess) { _zero_guess = zero_guess; }
+
+  /// Set the cycle type, see CycleType (default V). V and W set the number of
+  /// visits of every coarser level to 1 and 2.
+  void set_cycle(CycleType type)
+  {
+    _fcycle = (type == CycleType::F);
+    _visits.assign(_maps.size(), type == CycleType::W ? 2 : 1);
+  }
+
+  /// Set the number of visits gamma[l] of level l per visit of level l + 1,
+  /// i.e. the number of recursive coarse-grid corrections (a V-cycle has
+  /// gamma = 1 and a W-cycle gamma = 2). Levels using a K-cycle ignore it.
+  void set_cycle_visits(const std::vector<int>& gamma)
+  {
+    if (gamma.size() + 1 < _maps.size())
+      throw std::runtime_error("Number of visits required for each coarse level");
+    _fcycle = false;
+    _visits.assign(gamma.begin(), gamma.end());
+  }
+
+  /// Use a K-cycle (Krylov-accelerated multigrid, Notay and Vassilevski) for
+  /// the coarse-grid correction on the given levels. The correction on level
+  /// l is computed with (at most) two flexible CG iterations on A[l], each
+  /// preconditioned by a recursive cycle starting at level l. Level 0 (the
+  /// coarse solve) and the finest level are not allowed.
+  void set_kcycle_levels(const std::vector<int>& levels)
+  {
+    int num_levels = _maps.size();
+    _kcycle.assign(num_levels, false);
+    _kr.resize(num_levels);
+    _kc.resize(num_levels);
+    _kv.resize(num_levels);
+    for (int l : levels)
+    {
+      if (l < 1 or l > num_levels - 2)
+        throw std::runtime_error("K-cycle not supported on level " + std::to_string(l));
+      _kcycle[l] = true;
+      if (!_kr[l])
+      {
+        _kr[l] = std::make_unique<Vector>(_maps[l], _bs);
+        _kc[l] = std::make_unique<Vector>(_maps[l], _bs);
+        _kv[l] = std::make_unique<Vector>(_maps[l], _bs);
+      }
+    }
+  }
+
+  /// The second K-cycle iteration is skipped if the first one reduces the
+  /// residual on the level by at least this factor (default 0.25)
+  void set_kcycle_tolerance(T tol) { _kcycle_tol = tol; }
+
+  /// Compute and log residual norms before and after each phase of the
+  /// cycle (default false). This costs up to three extra operator
+  /// applications and several reductions per level, so it is meant for
+  /// diagnostics only; otherwise only the residual restricted to the next
+  /// coarser level is computed.
+  void set_monitor(bool monitor) { _monitor = monitor; }
+
   // Apply M^{-1}x = y
   void apply(const Vector& x, Vector& y, bool verbose = false)
   {
@@ -60,103 +173,219 @@ public:
 
     [[maybe_unused]] int num_levels = _maps.size();
 
-    // Set to zeros
-    for (int i = 0; i < num_levels - 1; i++)
-      _u[i]->set(T{0});
-    acc::copy(*_u.back(), y);
+    // The coarser levels always start from zero, which the smoothers and
+    // the coarse solver are told about, so u[i] need not be zeroed here
+    if (!_zero_guess)
+      acc::copy(*_u.back(), y);
 
-    spdlog::info("Copy x to b");
     acc::copy(*_b.back(), x);
 
-    for (int i = num_levels - 1; i > 0; i--)
+    cycle(num_levels - 1, _zero_guess, _fcycle ? CycleType::F : CycleType::V);
+
+    if (verbose == true)
     {
-      spdlog::info("Level {}", i);
+      if (!_monitor)
+      {
+        (*_operators.back())(*_u.back(), *_r.back());
+        axpy(*_r.back(), T(-1), *_r.back(), *_b.back());
+      }
+      std::cout << "rnorm after PMG = " << acc::norm(*_r[num_levels - 1]) << "\n";
+    }
 
-      // r = b[i] - A[i] * u[i]
-      spdlog::debug("Operator {} on u -> r", i);
-      (*_operators[i])(*_u[i], *_r[i]);
+    if (_monitor)
+      spdlog::info("----------- end of iteration ---------");
 
-      spdlog::debug("axpy");
-      axpy(*_r[i], T(-1), *_r[i], *_b[i]);
-      spdlog::info("Inital: rnorm = {}", acc::norm(*_r[i]));
+    acc::copy(y, *_u.back());
+  }
 
-      // u[i] = M^-1 b[i]
-      _solvers[i]->solve(*_operators[i], *_u[i], *_b[i], false);
+private:
+  /// One cycle on level i, improving u[i] as a solution of A[i] u[i] = b[i]
+  /// @param zero_guess If true, the initial value of u[i] is ignored and
+  /// taken to be zero
+  /// @param type CycleType::F for an F-cycle, otherwise each coarser level l
+  /// is visited _visits[l] times
+  void cycle(int i, bool zero_guess, CycleType type)
+  {
+    if (i == 0)
+    {
+      coarse_solve(zero_guess);
+      return;
+    }
+
+    if (_monitor)
+    {
+      spdlog::info("Level {}", i);
+      if (zero_guess)
+        spdlog::info("Inital: rnorm = {}", acc::norm(*_b[i]));
+      else
+        log_residual(i, "Inital");
+    }
 
-      // r = b[i] - A[i] * u[i]
+    // u[i] = M^-1 b[i], and r = b[i] - A[i] * u[i], the input of the
+    // restriction. Smoothers that track their residual return it, which saves
+    // one application of A[i].
+    if constexpr (requires(Solver& s, Operator& A, Vector& u, const Vector& b, Vector* r) {
+                    s.solve(A, u, b, false, true, r);
+                  })
+    {
+      _solvers[i]->solve(*_operators[i], *_u[i], *_b[i], false, zero_guess, _r[i].get());
+    }
+    else
+    {
+      _solvers[i]->solve(*_operators[i], *_u[i], *_b[i], false, zero_guess);
       (*_operators[i])(*_u[i], *_r[i]);
       axpy(*_r[i], T(-1), *_r[i], *_b[i]);
-
-      spdlog::info("After initial smooth: rnorm = {}", acc::norm(*_r[i]));
-
-      // Restrict residual from level i to level (i - 1)
-      (*_interpolation[i - 1])(*_r[i], *_b[i - 1], true);
     }
 
-    spdlog::info("Level 0");
-    // r = b[i] - A[i] * u[i]
-    // (*_operators[0])(*_u[0], *_r[0]);
-    // axpy(*_r[0], T(-1), *_r[0], *_b[0]);
+    if (_monitor)
+      spdlog::info("After initial smooth: rnorm = {}", acc::norm(*_r[i]));
 
-    thrust::transform(thrust::device, (*_b[0]).array().begin(),
-                      (*_b[0]).array().begin() + (*_b[0]).map()->size_local(), _bc_marker.begin(),
-                      (*_b[0]).mutable_array().begin(),
-                      [] __host__ __device__(const T& xi, const T& yi) { return xi * (1 - yi); });
+    // Restrict residual from level i to level (i - 1)
+    (*_interpolation[i - 1])(*_r[i], *_b[i - 1], true);
 
-    // Solve coarse problem
-    if (_coarse_solver)
-      _coarse_solver->solve(*_u[0], *_b[0]);
+    // Coarse-grid correction, u[i - 1] ~ A[i - 1]^-1 b[i - 1]. Repeated
+    // visits continue from the previous correction.
+    if (_kcycle.size() > 0 and _kcycle[i - 1])
+      kcycle(i - 1, type);
+    else if (type == CycleType::F)
+    {
+      cycle(i - 1, true, CycleType::F);
+      cycle(i - 1, false, CycleType::V);
+    }
     else
-      _solvers[0]->solve(*_operators[0], *_u[0], *_b[0], false);
-
-    spdlog::info("After coarse solve: unorm = {}", acc::norm(*_u[0]));
+    {
+      const int visits = _visits.empty() ? 1 : _visits[i - 1];
+      for (int k = 0; k < visits; ++k)
+        cycle(i - 1, k == 0, type);
+    }
 
-    // r = b[i] - A[i] * u[i]
-    (*_operators[0])(*_u[0], *_r[0]);
-    spdlog::info("After coarse solve: A.u = {}", acc::norm(*_r[0]));
-    axpy(*_r[0], T(-1), *_r[0], *_b[0]);
-    spdlog::info("After coarse solve: A.u-b = {}", acc::norm(*_r[0]));
+    // [coarse->fine] Prolong correction
+    (*_interpolation[i - 1])(*_u[i - 1], *_du[i], false);
 
-    for (int i = 0; i < num_levels - 1; i++)
+    if (_monitor)
     {
-      spdlog::info("Level {}", i + 1);
+      spdlog::info("Level {}", i);
+      spdlog::info("norm(_u[{}]) = {}", i - 1, acc::norm(*_u[i - 1]));
+      spdlog::info("norm(_du[{}]) = {}", i, acc::norm(*_du[i]));
+    }
 
-      // [coarse->fine] Prolong correction
-      (*_interpolation[i])(*_u[i], *_du[i + 1], false);
+    // update U
+    axpy(*_u[i], T(1), *_u[i], *_du[i]);
 
-      spdlog::info("norm(_u[{}]) = {}", i, acc::norm(*_u[i]));
-      spdlog::info("norm(_du[{}]) = {}", i + 1, acc::norm(*_du[i + 1]));
+    if (_monitor)
+      log_residual(i, "After correction");
 
-      // update U
-      axpy(*_u[i + 1], T(1), *_u[i + 1], *_du[i + 1]);
+    // [fine] Post-smooth
+    _solvers[i]->solve(*_operators[i], *_u[i], *_b[i], false);
 
-      // r = b[i] - A[i] * u[i]
-      (*_operators[i + 1])(*_u[i + 1], *_r[i + 1]);
-      axpy(*_r[i + 1], T(-1), *_r[i + 1], *_b[i + 1]);
+    if (_monitor)
+      log_residual(i, "After post-smoothing");
+  }
+
+  /// Compute r[i] = b[i] - A[i] u[i] and log its norm (monitor only)
+  void log_residual(int i, const std::string& stage)
+  {
+    (*_operators[i])(*_u[i], *_r[i]);
+    axpy(*_r[i], T(-1), *_r[i], *_b[i]);
+    spdlog::info("{} ({}): rnorm = {}", stage, i, acc::norm(*_r[i]));
+  }
 
-      spdlog::info("After correction: rnorm = {}", acc::norm(*_r[i + 1]));
+  /// Solve on the coarsest level, u[0] ~ A[0]^-1 b[0]
+  /// @param zero_guess False on repeated visits of the coarse level within a
+  /// cycle: the coarse solver is then skipped (b[0] is unchanged), and the
+  /// smoother continues from u[0]
+  void coarse_solve(bool zero_guess)
+  {
+    if (_monitor)
+      spdlog::info("Level 0");
 
-      // [fine] Post-smooth
-      _solvers[i + 1]->solve(*_operators[i + 1], *_u[i + 1], *_b[i + 1], false);
+    thrust::transform(thrust::device, (*_b[0]).array().begin(),
+                      (*_b[0]).array().begin() + (*_b[0]).map()->size_local(), _bc_marker.begin(),
+                      (*_b[0]).mutable_array().begin(),
+                      [] __host__ __device__(const T& xi, const T& yi) { return xi * (1 - yi); });
 
-      // r = b[i] - A[i] * u[i]
-      (*_operators[i + 1])(*_u[i + 1], *_r[i + 1]);
-      axpy(*_r[i + 1], T(-1), *_r[i + 1], *_b[i + 1]);
-      double rn = acc::norm(*_r[i + 1]);
-      spdlog::info("Residual norm after post-smoothing ({}) = {}", i + 1, rn);
+    // Solve coarse problem (CoarseSolver is void if the coarse level is
+    // always handled by its smoother)
+    if (_coarse_solver)
+    {
+      if (!zero_guess)
+        return;
+      if constexpr (!std::is_void_v<CoarseSolver>)
+      {
+        _coarse_solver->solve(*_u[0], *_b[0]);
+        // Coarse solver was set up with the unscaled operator
+        if (_coarse_scale != T(1))
+          acc::scale(*_u[0], T(1) / _coarse_scale);
+      }
     }
+    else
+      _solvers[0]->solve(*_operators[0], *_u[0], *_b[0], false, zero_guess);
 
-    if (verbose == true)
+    if (_monitor)
     {
-      std::cout << "rnorm after PMG = " << acc::norm(*_r[num_levels - 1]) << "\n";
+      spdlog::info("After coarse solve: unorm = {}", acc::norm(*_u[0]));
+      log_residual(0, "After coarse solve");
     }
+  }
 
-    spdlog::info("----------- end of iteration ---------");
+  /// K-cycle on level l: u[l] ~ A[l]^-1 b[l] from two flexible CG iterations
+  /// preconditioned by cycle(l) of the given type. All inner products of an
+  /// iteration share a single reduction.
+  void kcycle(int l, CycleType type)
+  {
+    auto& A = *_operators[l];
+    MPI_Comm comm = _maps[l]->comm();
+    Vector& r = *_kr[l];
+    Vector& c1 = *_kc[l];
+    Vector& v1 = *_kv[l];
+
+    // c1 = B r, v1 = A c1
+    acc::copy(r, *_b[l]);
+    cycle(l, true, type);
+    acc::copy(c1, *_u[l]);
+    A(c1, v1);
+
+    // (c1, v1), (c1, r), (r, r), (v1, r), (v1, v1)
+    std::array<T, 5> d1
+        = {acc::inner_product_local(c1, v1), acc::inner_product_local(c1, r),
+           acc::inner_product_local(r, r), acc::inner_product_local(v1, r),
+           acc::inner_product_local(v1, v1)};
+    MPI_Allreduce(MPI_IN_PLACE, d1.data(), d1.size(), dolfinx::MPI::mpi_type<T>(), MPI_SUM, comm);
+    const auto [rho1, alpha1, rr, vr, vv] = d1;
+    const T a1 = alpha1 / rho1;
+
+    // |r - a1 v1|^2, without another reduction
+    const T rt2 = std::max(T(0), rr - 2 * a1 * vr + a1 * a1 * vv);
+    if (_monitor)
+      spdlog::info("K-cycle level {}: rnorm = {}, after first iteration = {}", l,
+                   std::sqrt(rr), std::sqrt(rt2));
+    if (rt2 <= _kcycle_tol * _kcycle_tol * rr)
+    {
+      acc::scale(*_u[l], a1);
+      return;
+    }
 
-    acc::copy(y, *_u.back());
+    // c2 = B r~ with r~ = r - a1 v1, v2 = A c2
+    axpy(*_b[l], -a1, v1, r);
+    cycle(l, true, type);
+    A(*_u[l], *_r[l]);
+
+    // (c2, v1), (c2, v2), (c2, r~)
+    std::array<T, 3> d2 = {acc::inner_product_local(*_u[l], v1),
+                           acc::inner_product_local(*_u[l], *_r[l]),
+                           acc::inner_product_local(*_u[l], *_b[l])};
+    MPI_Allreduce(MPI_IN_PLACE, d2.data(), d2.size(), dolfinx::MPI::mpi_type<T>(), MPI_SUM, comm);
+    const auto [gamma, beta, alpha2] = d2;
+    const T rho2 = beta - gamma * gamma / rho1;
+
+    // u = (a1 - gamma alpha2 / (rho1 rho2)) c1 + alpha2 / rho2 c2
+    acc::scale(*_u[l], alpha2 / rho2);
+    axpy(*_u[l], a1 - gamma * alpha2 / (rho1 * rho2), c1, *_u[l]);
+
+    // Restore the right-hand side of the level
+    acc::copy(*_b[l], r);
   }
 
-private:
   // Map describing the data layout
   std::vector<std::shared_ptr<const common::IndexMap>> _maps;
 
@@ -181,7 +410,29 @@ private:
 
   std::shared_ptr<CoarseSolver> _coarse_solver;
 
+  // Ignore the initial value of y in apply()
+  bool _zero_guess = false;
+
+  // Accumulated uniform scaling of the operators since the coarse solver was set up
+  T _coarse_scale = 1;
+
   // Solvers for each level
   std::vector<std::shared_ptr<Solver>> _solvers;
+
+  // Levels using a K-cycle for their coarse-grid correction, and its working
+  // vectors (right-hand side, first search direction and its image)
+  std::vector<bool> _kcycle;
+  std::vector<std::unique_ptr<Vector>> _kr, _kc, _kv;
+
+  // Residual reduction for which the second K-cycle iteration is skipped
+  T _kcycle_tol = 0.25;
+
+  // Number of visits of each level per visit of the next finer level (empty
+  // for a V-cycle), and whether to use an F-cycle
+  std::vector<int> _visits;
+  bool _fcycle = false;
+
+  // Compute and log diagnostic residual norms during the cycle
+  bool _monitor = false;
 };
 } // namespace dolfinx::acc
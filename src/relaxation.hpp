@@ -0,0 +1,408 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "csr.hpp"
+#include "vector.hpp"
+#include <algorithm>
+#include <dolfinx/common/IndexMap.h>
+#include <dolfinx/common/MPI.h>
+#include <numeric>
+
+using namespace dolfinx;
+
+namespace
+{
+/// Compute the inverse diagonal of the owned rows of a CSR matrix, or the
+/// inverse l1 diagonal d_i = a_ii + sum_{j ghost} |a_ij| if l1 is true
+template <typename T>
+static __global__ void csr_diagonal(int N, const T* __restrict__ values,
+                                    const std::int32_t* __restrict__ row_ptr,
+                                    const std::int32_t* __restrict__ off_diag_offset,
+                                    const std::int32_t* __restrict__ cols, T* __restrict__ diag_inv,
+                                    bool l1)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+  {
+    T d = 0;
+    for (std::int32_t j = row_ptr[i]; j < off_diag_offset[i]; j++)
+      if (cols[j] == i)
+        d = values[j];
+    if (l1)
+    {
+      for (std::int32_t j = off_diag_offset[i]; j < row_ptr[i + 1]; j++)
+        d += abs(values[j]);
+    }
+    diag_inv[i] = (d == 0.0) ? 0.0 : 1.0 / d;
+  }
+}
+
+/// Jacobi update with q = A x: x += omega * D^-1 (b - q)
+template <typename T>
+static __global__ void jacobi_update(int N, const T* __restrict__ b, const T* __restrict__ q,
+                                     const T* __restrict__ dinv, T* __restrict__ x, T omega)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+    x[i] += omega * dinv[i] * (b[i] - q[i]);
+}
+
+/// First Jacobi step from a zero initial guess: x = omega * D^-1 b
+template <typename T>
+static __global__ void jacobi_init_zero(int N, const T* __restrict__ b,
+                                        const T* __restrict__ dinv, T* __restrict__ x, T omega)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+    x[i] = omega * dinv[i] * b[i];
+}
+
+/// Right-hand side for the owned block on a list of rows: g = b - A_ghost x_ghost
+template <typename T>
+static __global__ void ghost_rhs(int N, const std::int32_t* __restrict__ rows,
+                                 const T* __restrict__ values,
+                                 const std::int32_t* __restrict__ off_diag_offset,
+                                 const std::int32_t* __restrict__ row_end,
+                                 const std::int32_t* __restrict__ cols, const T* __restrict__ b,
+                                 const T* __restrict__ x, T* __restrict__ g)
+{
+  int k = blockIdx.x * blockDim.x + threadIdx.x;
+  if (k < N)
+  {
+    std::int32_t i = rows[k];
+    T gi = b[i];
+    for (std::int32_t j = off_diag_offset[i]; j < row_end[i]; j++)
+      gi -= values[j] * x[cols[j]];
+    g[i] = gi;
+  }
+}
+
+/// Gauss-Seidel update of the rows of one colour, using the owned block only:
+/// x_i = (g_i - sum_{j != i} a_ij x_j) / a_ii
+template <typename T>
+static __global__ void gauss_seidel_color(int N, const std::int32_t* __restrict__ rows,
+                                          const T* __restrict__ values,
+                                          const std::int32_t* __restrict__ row_ptr,
+                                          const std::int32_t* __restrict__ off_diag_offset,
+                                          const std::int32_t* __restrict__ cols,
+                                          const T* __restrict__ dinv, const T* __restrict__ g,
+                                          T* __restrict__ x)
+{
+  int k = blockIdx.x * blockDim.x + threadIdx.x;
+  if (k < N)
+  {
+    std::int32_t i = rows[k];
+    T s = g[i];
+    for (std::int32_t j = row_ptr[i]; j < off_diag_offset[i]; j++)
+      if (cols[j] != i)
+        s -= values[j] * x[cols[j]];
+    x[i] = s * dinv[i];
+  }
+}
+} // namespace
+
+namespace dolfinx::acc
+{
+
+/// l1-Jacobi smoother for assembled operators (Baker, Falgout, Kolev and Yang,
+/// 2011). The diagonal is augmented by the l1 norm of the ghost columns of each
+/// row, which makes the iteration convergent for SPD matrices without a damping
+/// parameter or eigenvalue estimates.
+template <typename Vector>
+class L1Jacobi
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  template <typename Operator>
+  L1Jacobi(std::shared_ptr<const common::IndexMap> map, int bs, Operator& A)
+  {
+    _q = std::make_unique<Vector>(map, bs);
+    update_diagonal(A);
+  }
+
+  void set_max_iterations(int max_iter) { _max_iter = max_iter; }
+
+  /// Set the damping parameter (default 1)
+  void set_omega(T omega) { _omega = omega; }
+
+  /// Recompute the l1 diagonal from the operator
+  template <typename Operator>
+  void update_diagonal(Operator& A)
+  {
+    const int N = A.row_index_map()->size_local();
+    _l1_diag_inv.resize(N);
+    dim3 block_size(256);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+    hipLaunchKernelGGL(csr_diagonal<T>, grid_size, block_size, 0, 0, N,
+                       thrust::raw_pointer_cast(A.values().data()),
+                       thrust::raw_pointer_cast(A.row_ptr().data()),
+                       thrust::raw_pointer_cast(A.off_diag_offset().data()),
+                       thrust::raw_pointer_cast(A.cols().data()),
+                       thrust::raw_pointer_cast(_l1_diag_inv.data()), true);
+    err_check(hipGetLastError());
+  }
+
+  /// Update the smoother after the operator has been scaled uniformly by alpha
+  void rescale(T alpha)
+  {
+    thrust::transform(thrust::device, _l1_diag_inv.begin(), _l1_diag_inv.end(),
+                      _l1_diag_inv.begin(),
+                      [alpha] __host__ __device__(const T& d) { return d / alpha; });
+  }
+
+  /// Apply max_iter sweeps to Ax = b
+  /// @param zero_guess If true, the initial value of x is ignored and
+  /// taken to be zero, which saves one application of A
+  template <typename Operator>
+  void solve(Operator& A, Vector& x, const Vector& b, bool verbose, bool zero_guess = false)
+  {
+    const int N = _l1_diag_inv.size();
+    dim3 block_size(512);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+    const T* dinv = thrust::raw_pointer_cast(_l1_diag_inv.data());
+
+    for (int k = 0; k < _max_iter; k++)
+    {
+      if (k == 0 and zero_guess)
+      {
+        hipLaunchKernelGGL(jacobi_init_zero<T>, grid_size, block_size, 0, 0, N,
+                           b.array().data(), dinv, x.mutable_array().data(), _omega);
+      }
+      else
+      {
+        A(x, *_q);
+        hipLaunchKernelGGL(jacobi_update<T>, grid_size, block_size, 0, 0, N, b.array().data(),
+                           _q->array().data(), dinv, x.mutable_array().data(), _omega);
+      }
+      err_check(hipGetLastError());
+
+      if (verbose)
+      {
+        A(x, *_q);
+        acc::axpy(*_q, T(-1), *_q, b);
+        spdlog::info("Iteration {}, UNPRECONDITIONED residual norm = {}", k + 1,
+                     acc::norm(*_q));
+      }
+    }
+  }
+
+private:
+  /// Number of sweeps
+  int _max_iter = 1;
+
+  /// Damping parameter
+  T _omega = 1.0;
+
+  /// Inverse l1 diagonal of the owned rows
+  thrust::device_vector<T> _l1_diag_inv;
+
+  /// Working vector
+  std::unique_ptr<Vector> _q;
+};
+
+/// Symmetric multicolor Gauss-Seidel smoother for assembled operators. The
+/// rows are coloured at setup with a greedy colouring of the owned block of
+/// the CSR graph, so that the rows of one colour can be updated in parallel.
+/// Ghost values are exchanged once per sweep and kept fixed during the
+/// sweep (hybrid Gauss-Seidel: Jacobi between processes). Rows without
+/// ghost columns (interior rows) are swept first, while the ghost values are
+/// exchanged, and the remaining (boundary) rows after the exchange.
+template <typename Vector>
+class MulticolorGaussSeidel
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  template <typename Operator>
+  MulticolorGaussSeidel(std::shared_ptr<const common::IndexMap> map, int bs, Operator& A)
+  {
+    dolfinx::common::Timer t0("~setup phase MulticolorGaussSeidel");
+
+    _q = std::make_unique<Vector>(map, bs);
+    update_diagonal(A);
+
+    // Copy the owned block graph to host
+    const int N = A.row_index_map()->size_local();
+    std::vector<std::int32_t> row_ptr(A.row_ptr().size());
+    std::vector<std::int32_t> off_diag_offset(A.off_diag_offset().size());
+    std::vector<std::int32_t> cols(A.cols().size());
+    thrust::copy(A.row_ptr().begin(), A.row_ptr().end(), row_ptr.begin());
+    thrust::copy(A.off_diag_offset().begin(), A.off_diag_offset().end(), off_diag_offset.begin());
+    thrust::copy(A.cols().begin(), A.cols().end(), cols.begin());
+
+    // Greedy colouring
+    std::vector<std::int32_t> color(N, -1);
+    std::vector<std::int32_t> used;
+    int num_colors = 0;
+    for (std::int32_t i = 0; i < N; ++i)
+    {
+      used.clear();
+      for (std::int32_t j = row_ptr[i]; j < off_diag_offset[i]; ++j)
+        if (cols[j] != i and color[cols[j]] >= 0)
+          used.push_back(color[cols[j]]);
+      std::sort(used.begin(), used.end());
+      std::int32_t c = 0;
+      for (std::int32_t u : used)
+      {
+        if (u == c)
+          ++c;
+        else if (u > c)
+          break;
+      }
+      color[i] = c;
+      num_colors = std::max(num_colors, c + 1);
+    }
+
+    // Sort rows by group: interior rows of colour c are in group c, and
+    // boundary rows of colour c in group num_colors + c
+    std::vector<std::int32_t> group(N);
+    for (std::int32_t i = 0; i < N; ++i)
+    {
+      const bool boundary = off_diag_offset[i] < row_ptr[i + 1];
+      group[i] = boundary ? num_colors + color[i] : color[i];
+    }
+    _group_offsets.assign(2 * num_colors + 1, 0);
+    for (std::int32_t g : group)
+      _group_offsets[g + 1]++;
+    std::partial_sum(_group_offsets.begin(), _group_offsets.end(), _group_offsets.begin());
+    std::vector<std::int32_t> rows(N);
+    std::vector<std::int32_t> pos(_group_offsets.begin(), _group_offsets.end() - 1);
+    for (std::int32_t i = 0; i < N; ++i)
+      rows[pos[group[i]]++] = i;
+    _rows = thrust::device_vector<std::int32_t>(rows.begin(), rows.end());
+    _g = thrust::device_vector<T>(N);
+
+    spdlog::info("MulticolorGaussSeidel: {} rows ({} boundary), {} colours", N,
+                 N - _group_offsets[num_colors], num_colors);
+  }
+
+  void set_max_iterations(int max_iter) { _max_iter = max_iter; }
+
+  /// Recompute the diagonal from the operator
+  template <typename Operator>
+  void update_diagonal(Operator& A)
+  {
+    const int N = A.row_index_map()->size_local();
+    _diag_inv.resize(N);
+    dim3 block_size(256);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+    hipLaunchKernelGGL(csr_diagonal<T>, grid_size, block_size, 0, 0, N,
+                       thrust::raw_pointer_cast(A.values().data()),
+                       thrust::raw_pointer_cast(A.row_ptr().data()),
+                       thrust::raw_pointer_cast(A.off_diag_offset().data()),
+                       thrust::raw_pointer_cast(A.cols().data()),
+                       thrust::raw_pointer_cast(_diag_inv.data()), false);
+    err_check(hipGetLastError());
+  }
+
+  /// Update the smoother after the operator has been scaled uniformly by alpha
+  void rescale(T alpha)
+  {
+    thrust::transform(thrust::device, _diag_inv.begin(), _diag_inv.end(), _diag_inv.begin(),
+                      [alpha] __host__ __device__(const T& d) { return d / alpha; });
+  }
+
+  /// Apply max_iter symmetric sweeps (groups in forward then reverse order)
+  /// @param zero_guess If true, the initial value of x is ignored and
+  /// taken to be zero, which saves the first ghost update
+  template <typename Operator>
+  void solve(Operator& A, Vector& x, const Vector& b, bool verbose, bool zero_guess = false)
+  {
+    const int num_colors = (_group_offsets.size() - 1) / 2;
+    const int num_interior = _group_offsets[num_colors];
+    const int num_boundary = _group_offsets.back() - num_interior;
+    dim3 block_size(256);
+    T* _x = x.mutable_array().data();
+
+    // Update the rows of group k, with owned block right-hand side g
+    auto sweep = [&](int k, const T* g)
+    {
+      int n = _group_offsets[k + 1] - _group_offsets[k];
+      if (n == 0)
+        return;
+      dim3 grid_size((n + block_size.x - 1) / block_size.x);
+      hipLaunchKernelGGL(gauss_seidel_color<T>, grid_size, block_size, 0, 0, n,
+                         thrust::raw_pointer_cast(_rows.data()) + _group_offsets[k],
+                         thrust::raw_pointer_cast(A.values().data()),
+                         thrust::raw_pointer_cast(A.row_ptr().data()),
+                         thrust::raw_pointer_cast(A.off_diag_offset().data()),
+                         thrust::raw_pointer_cast(A.cols().data()),
+                         thrust::raw_pointer_cast(_diag_inv.data()), g, _x);
+      err_check(hipGetLastError());
+    };
+
+    for (int k = 0; k < _max_iter; k++)
+    {
+      // Interior rows only see owned values, so g = b. With a zero initial
+      // guess the ghost values are zero, and g = b on the boundary rows too.
+      const bool exchange = !(k == 0 and zero_guess);
+      if (exchange)
+        x.scatter_fwd_begin();
+      else
+        x.set(T{0});
+
+      for (int c = 0; c < num_colors; c++)
+        sweep(c, b.array().data());
+
+      // g = b - A_ghost x_ghost on the boundary rows
+      const T* g_boundary = b.array().data();
+      if (exchange)
+      {
+        x.scatter_fwd_end();
+        if (num_boundary > 0)
+        {
+          dim3 grid_size((num_boundary + block_size.x - 1) / block_size.x);
+          hipLaunchKernelGGL(ghost_rhs<T>, grid_size, block_size, 0, 0, num_boundary,
+                             thrust::raw_pointer_cast(_rows.data()) + num_interior,
+                             thrust::raw_pointer_cast(A.values().data()),
+                             thrust::raw_pointer_cast(A.off_diag_offset().data()),
+                             thrust::raw_pointer_cast(A.row_ptr().data()) + 1,
+                             thrust::raw_pointer_cast(A.cols().data()), b.array().data(), _x,
+                             thrust::raw_pointer_cast(_g.data()));
+          err_check(hipGetLastError());
+        }
+        g_boundary = thrust::raw_pointer_cast(_g.data());
+      }
+
+      // Boundary colours forward and back, then interior colours back
+      for (int c = 0; c < num_colors; c++)
+        sweep(num_colors + c, g_boundary);
+      for (int c = num_colors - 1; c >= 0; c--)
+        sweep(num_colors + c, g_boundary);
+      for (int c = num_colors - 1; c >= 0; c--)
+        sweep(c, b.array().data());
+
+      if (verbose)
+      {
+        A(x, *_q);
+        acc::axpy(*_q, T(-1), *_q, b);
+        spdlog::info("Iteration {}, UNPRECONDITIONED residual norm = {}", k + 1,
+                     acc::norm(*_q));
+      }
+    }
+  }
+
+private:
+  /// Number of symmetric sweeps
+  int _max_iter = 1;
+
+  /// Inverse diagonal of the owned rows
+  thrust::device_vector<T> _diag_inv;
+
+  /// Rows sorted by group (interior rows by colour, then boundary rows by
+  /// colour), and offset of each group in _rows
+  thrust::device_vector<std::int32_t> _rows;
+  std::vector<std::int32_t> _group_offsets;
+
+  /// Owned block right-hand side of the boundary rows, b - A_ghost x_ghost
+  thrust::device_vector<T> _g;
+
+  /// Working vector
+  std::unique_ptr<Vector> _q;
+};
+} // namespace dolfinx::acc
@@ -0,0 +1,167 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "chebyshev.hpp"
+#include "vector.hpp"
+#include <dolfinx/common/IndexMap.h>
+#include <dolfinx/common/MPI.h>
+
+using namespace dolfinx;
+
+namespace
+{
+/// Local residual on owned and ghost dofs, in place: b = b - q, and zero on
+/// the subdomain boundary
+template <typename T>
+static __global__ void schwarz_residual(int N, const T* __restrict__ q,
+                                        const std::int8_t* __restrict__ marker,
+                                        T* __restrict__ b)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+    b[i] = marker[i] ? T(0.0) : b[i] - q[i];
+}
+} // namespace
+
+namespace dolfinx::acc
+{
+
+/// Restricted additive Schwarz smoother, with one overlapping subdomain per
+/// process made of its owned and ghost cells (see ghost_layer_mesh). The
+/// local problem, with Dirichlet conditions on the artificial subdomain
+/// boundary, is solved approximately by a few Jacobi-Chebyshev iterations
+/// without communication, and only the owned part of the correction is
+/// kept. Each application needs a single halo exchange (of x and b
+/// together), rather than one per operator application.
+template <typename Vector>
+class SchwarzSmoother
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  /// Create a smoother
+  /// @param map Index map of the level
+  /// @param bs Block size
+  /// @param eig_range Eigenvalue bounds of D^-1 A, used for the local solver
+  /// @param A The operator (must provide apply_local)
+  /// @param marker Dirichlet and subdomain interface dofs (owned and ghost,
+  /// on device), see compute_subdomain_interface
+  template <typename Operator>
+  SchwarzSmoother(std::shared_ptr<const common::IndexMap> map, int bs,
+                  std::array<T, 2> eig_range, Operator& A, std::span<const std::int8_t> marker)
+      : _eig_range(eig_range), _marker(marker)
+  {
+    _b = std::make_unique<Vector>(map, bs);
+    _e = std::make_unique<Vector>(map, bs);
+    _z = std::make_unique<Vector>(map, bs);
+    _q = std::make_unique<Vector>(map, bs);
+    _r = std::make_unique<Vector>(map, bs);
+    _diag_inv = std::make_unique<Vector>(map, bs);
+    update_diagonal(A);
+  }
+
+  /// Set the number of local Chebyshev iterations
+  void set_max_iterations(int max_iter) { _max_iter = max_iter; }
+
+  /// Fetch the inverse diagonal (owned and ghost entries) from the operator
+  template <typename Operator>
+  void update_diagonal(Operator& A)
+  {
+    A.get_diag_inverse(*_diag_inv);
+  }
+
+  /// Update the smoother after the operator has been scaled uniformly by alpha
+  void rescale(T alpha)
+  {
+    std::span<T> d = _diag_inv->mutable_array();
+    thrust::transform(thrust::device, d.begin(), d.end(), _marker.begin(), d.begin(),
+                      [alpha] __host__ __device__(const T& di, const std::int8_t& m)
+                      { return m ? di : di / alpha; });
+  }
+
+  /// Apply one Schwarz correction to Ax = b
+  /// @param zero_guess If true, the initial value of x is ignored and
+  /// taken to be zero
+  template <typename Operator>
+  void solve(Operator& A, Vector& x, const Vector& b, bool verbose, bool zero_guess = false)
+  {
+    dolfinx::common::Timer t0("~SchwarzSmoother solve");
+
+    const int N = _r->array().size();
+    dim3 block_size(512);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+
+    // Halo exchange of b (and x)
+    acc::copy(*_b, b);
+    _b->scatter_fwd_begin();
+    if (!zero_guess)
+      x.scatter_fwd_begin();
+    _b->scatter_fwd_end();
+    if (!zero_guess)
+      x.scatter_fwd_end();
+
+    // Local residual on the subdomain
+    if (zero_guess)
+      _q->set(T{0.0});
+    else
+      A.apply_local(x, *_q, _marker);
+    hipLaunchKernelGGL(schwarz_residual<T>, grid_size, block_size, 0, 0, N, _q->array().data(),
+                       _marker.data(), _b->mutable_array().data());
+    err_check(hipGetLastError());
+
+    // Local solve A_loc e = r, with e = 0 initially (fourth kind Chebyshev)
+    const T lmax = _eig_range[1];
+    const T* dinv = _diag_inv->array().data();
+    const bool optimized = _max_iter <= max_optimized_degree;
+    hipLaunchKernelGGL(chebyshev_init_zero<T>, grid_size, block_size, 0, 0, N,
+                       _b->array().data(), dinv, _e->mutable_array().data(),
+                       _r->mutable_array().data(), _z->mutable_array().data(),
+                       T(4.0 / (3.0 * lmax)));
+    err_check(hipGetLastError());
+    for (int i = 1; i < _max_iter + 1; i++)
+    {
+      A.apply_local(*_z, *_q, _marker);
+      T beta = optimized ? T(optimized_weights[_max_iter - 1][i - 1]) : T(1.0);
+      hipLaunchKernelGGL(chebyshev_update<T>, grid_size, block_size, 0, 0, N,
+                         _q->array().data(), dinv, _e->mutable_array().data(),
+                         _r->mutable_array().data(), _z->mutable_array().data(), beta,
+                         T(2 * i - 1) / T(2 * i + 3), T(8 * i + 4) / T(2 * i + 3) / lmax);
+      err_check(hipGetLastError());
+    }
+
+    // Restriction to owned dofs: x += e
+    if (zero_guess)
+      acc::copy(x, *_e);
+    else
+      acc::axpy(x, T(1.0), *_e, x);
+
+    if (verbose)
+    {
+      A(x, *_q);
+      acc::axpy(*_q, T(-1), *_q, b);
+      spdlog::info("Schwarz: UNPRECONDITIONED residual norm = {}", acc::norm(*_q));
+    }
+  }
+
+private:
+  /// Number of local Chebyshev iterations
+  int _max_iter = 2;
+
+  /// Eigenvalue bounds for the local solver
+  std::array<T, 2> _eig_range;
+
+  /// Dirichlet and subdomain interface dofs
+  std::span<const std::int8_t> _marker;
+
+  /// Working vectors (owned and ghost entries are used)
+  std::unique_ptr<Vector> _b;
+  std::unique_ptr<Vector> _e;
+  std::unique_ptr<Vector> _z;
+  std::unique_ptr<Vector> _q;
+  std::unique_ptr<Vector> _r;
+  std::unique_ptr<Vector> _diag_inv;
+};
+} // namespace dolfinx::acc
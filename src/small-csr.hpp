@@ -38,6 +38,24 @@ public:
     }
   }
 
+  // Apply matrix to indirect values, scaled by weight_in, and add the result
+  // atomically to data_out (for the transpose of an interpolation, where the
+  // output dofs are shared between cells)
+  __device__ void apply_indirect_add(const std::int32_t* map_in, const std::int32_t* map_out,
+                                     const T* weight_in, const T* data_in, T* data_out) const
+  {
+    for (std::int32_t j = 0; j < row_ptr.size() - 1; j++)
+    {
+      T vj = 0;
+      for (std::int32_t k = row_ptr[j]; k < row_ptr[j + 1]; ++k)
+      {
+        const std::int32_t dof = map_in[cols[k]];
+        vj += vals[k] * weight_in[dof] * data_in[dof];
+      }
+      atomicAdd(&data_out[map_out[j]], vj);
+    }
+  }
+
   // Pointers to row offsets, columns and values, already allocated on device
   std::span<std::int32_t> row_ptr;
   std::span<std::int32_t> cols;
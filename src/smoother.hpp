@@ -0,0 +1,78 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "vector.hpp"
+
+#include <functional>
+#include <memory>
+
+namespace dolfinx::acc
+{
+
+/// Type-erased smoother, so that the levels of a MultigridPreconditioner
+/// can use different smoothers (e.g. Chebyshev on matrix-free levels and
+/// Gauss-Seidel on assembled ones). The wrapped smoother must provide
+/// `solve(A, x, b, verbose, zero_guess)`, `rescale(alpha)`,
+/// `update_diagonal(A)` and `set_max_iterations(n)` for the Operator type.
+/// If its solve also takes an output residual (as Chebyshev does), the
+/// residual requested from solve is forwarded to it, and computed here
+/// otherwise.
+template <typename Vector, typename Operator>
+class Smoother
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  /// Wrap a smoother (shared with the caller, which can keep changing its
+  /// settings)
+  template <typename S>
+  Smoother(std::shared_ptr<S> smoother)
+      : _solve(
+          [smoother](Operator& A, Vector& x, const Vector& b, bool verbose, bool zero_guess,
+                     Vector* r)
+          {
+            if constexpr (requires(S& s) { s.solve(A, x, b, verbose, zero_guess, r); })
+              smoother->solve(A, x, b, verbose, zero_guess, r);
+            else
+            {
+              smoother->solve(A, x, b, verbose, zero_guess);
+              if (r)
+              {
+                A(x, *r);
+                axpy(*r, T(-1), *r, b);
+              }
+            }
+          }),
+        _rescale([smoother](T alpha) { smoother->rescale(alpha); }),
+        _update_diagonal([smoother](Operator& A) { smoother->update_diagonal(A); }),
+        _set_max_iterations([smoother](int max_iter) { smoother->set_max_iterations(max_iter); })
+  {
+  }
+
+  /// Smooth Ax = b, see the wrapped smoother
+  /// @param r If not null, set to the residual b - Ax on exit
+  void solve(Operator& A, Vector& x, const Vector& b, bool verbose, bool zero_guess = false,
+             Vector* r = nullptr)
+  {
+    _solve(A, x, b, verbose, zero_guess, r);
+  }
+
+  /// Update the smoother after the operator has been scaled uniformly by alpha
+  void rescale(T alpha) { _rescale(alpha); }
+
+  /// Fetch the diagonal from the operator
+  void update_diagonal(Operator& A) { _update_diagonal(A); }
+
+  /// Set the number of iterations (or sweeps) of the wrapped smoother
+  void set_max_iterations(int max_iter) { _set_max_iterations(max_iter); }
+
+private:
+  std::function<void(Operator&, Vector&, const Vector&, bool, bool, Vector*)> _solve;
+  std::function<void(T)> _rescale;
+  std::function<void(Operator&)> _update_diagonal;
+  std::function<void(int)> _set_max_iterations;
+};
+} // namespace dolfinx::acc
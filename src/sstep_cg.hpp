@@ -0,0 +1,348 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+#pragma once
+
+#include "cg.hpp"
+#include "vector.hpp"
+#include <array>
+#include <cmath>
+#include <dolfinx/common/IndexMap.h>
+#include <dolfinx/common/MPI.h>
+
+#include "amd_gpu.hpp"
+
+using namespace dolfinx;
+
+namespace
+{
+/// Next Chebyshev basis vector,
+/// v_next = a * (dinv * av - c * v) - b * v_prev (owned entries)
+template <typename T>
+static __global__ void sstep_basis(int N, const T* __restrict__ dinv, const T* __restrict__ av,
+                                   const T* __restrict__ v, const T* __restrict__ v_prev,
+                                   T* __restrict__ v_next, T a, T c, T b)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+    v_next[i] = a * (dinv[i] * av[i] - c * v[i]) - b * v_prev[i];
+}
+
+/// Inner products of every pair of vectors in X (nx vectors) and Y (ny
+/// vectors), added to out[i * ny + j]. The pair is given by blockIdx.y.
+/// @note The shared memory is blockDim.x * sizeof(T), blockDim.x a power of 2
+template <typename T>
+static __global__ void block_dot(int N, int nx, const T* const* __restrict__ X, int ny,
+                                 const T* const* __restrict__ Y, T* __restrict__ out)
+{
+  extern __shared__ T partial[];
+
+  const int pair = blockIdx.y;
+  const T* x = X[pair / ny];
+  const T* y = Y[pair % ny];
+
+  T sum = 0;
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N; i += blockDim.x * gridDim.x)
+    sum += x[i] * y[i];
+  partial[threadIdx.x] = sum;
+  __syncthreads();
+
+  for (int s = blockDim.x / 2; s > 0; s >>= 1)
+  {
+    if (threadIdx.x < s)
+      partial[threadIdx.x] += partial[threadIdx.x + s];
+    __syncthreads();
+  }
+
+  if (threadIdx.x == 0)
+    atomicAdd(&out[pair], partial[0]);
+}
+
+/// y += sum_j c[j] X[j] (owned entries)
+template <typename T>
+static __global__ void block_axpy(int N, int n, const T* const* __restrict__ X,
+                                  const T* __restrict__ c, T* __restrict__ y)
+{
+  int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+  {
+    T yi = y[i];
+    for (int j = 0; j < n; ++j)
+      yi += c[j] * X[j][i];
+    y[i] = yi;
+  }
+}
+} // namespace
+
+namespace dolfinx::acc
+{
+
+/// Largest block size of SStepCGSolver. The Chebyshev basis of D^-1 A stays
+/// well conditioned up to this size; beyond it the Gram matrix may lose
+/// positive definiteness in double precision.
+constexpr int max_sstep_size = 8;
+
+/// s-step (communication-avoiding) Jacobi-preconditioned conjugate gradient
+/// method. Each outer iteration builds a block of s Krylov vectors of D^-1 A
+/// in a Chebyshev basis with s operator applications, makes it A-orthogonal
+/// to the previous block, and minimises the error in the A-norm over it. All
+/// the inner products of an outer iteration are computed with a single
+/// reduction, so there are s times fewer global synchronisations than CG.
+template <typename Vector>
+class SStepCGSolver
+{
+  /// The value type
+  using T = typename Vector::value_type;
+
+public:
+  /// Create a solver
+  /// @param map Index map
+  /// @param bs Block size
+  /// @param s Number of Krylov vectors per outer iteration (1 to
+  /// max_sstep_size)
+  /// @param eig_range Eigenvalue bounds of D^-1 A, for the Chebyshev basis
+  /// (e.g. the estimate used for the Chebyshev smoother)
+  SStepCGSolver(std::shared_ptr<const common::IndexMap> map, int bs, int s,
+                std::array<T, 2> eig_range)
+      : _map{map}, _bs{bs}, _s{s}, _eig_range{eig_range}
+  {
+    if (s < 1 or s > max_sstep_size)
+      throw std::runtime_error("s-step CG: unsupported block size " + std::to_string(s));
+
+    auto create = [&](std::vector<std::unique_ptr<Vector>>& block,
+                      thrust::device_vector<T*>& ptrs)
+    {
+      std::vector<T*> p;
+      for (int i = 0; i < _s; ++i)
+      {
+        block.push_back(std::make_unique<Vector>(_map, _bs));
+        p.push_back(block.back()->mutable_array().data());
+      }
+      ptrs = thrust::device_vector<T*>(p.begin(), p.end());
+    };
+    create(_V, _V_ptrs);
+    create(_AV, _AV_ptrs);
+    create(_P, _P_ptrs);
+    create(_AP, _AP_ptrs);
+    create(_P_new, _P_new_ptrs);
+    create(_AP_new, _AP_new_ptrs);
+
+    _r = std::make_unique<Vector>(_map, _bs);
+    _diag_inv = std::make_unique<Vector>(_map, _bs);
+
+    update_gram_pointers();
+    _gram = thrust::device_vector<T>((2 * _s + 1) * _s);
+    _coeffs = thrust::device_vector<T>(_s);
+  }
+
+  void set_max_iterations(int max_iter) { _max_iter = max_iter; }
+  void set_tolerance(double tolerance) { _rtol = tolerance; }
+
+  /// Set the eigenvalue bounds of D^-1 A used for the Chebyshev basis
+  void set_eig_range(std::array<T, 2> eig_range) { _eig_range = eig_range; }
+
+  /// Solve Ax = b
+  /// @return Number of operator applications in the iterations (s per outer
+  /// iteration)
+  template <typename Operator>
+  int solve(Operator& A, Vector& x, const Vector& b, bool verbose = false)
+  {
+    dolfinx::common::Timer t0("~SStepCG solve");
+
+    MPI_Comm comm = _map->comm();
+    int rank = dolfinx::MPI::rank(comm);
+
+    A.get_diag_inverse(*_diag_inv);
+
+    const int N = _bs * _map->size_local();
+    dim3 block_size(512);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+
+    // Chebyshev basis on [lmin, lmax]: rho_1(t) = (t - c) / h and
+    // rho_{j+1}(t) = 2 (t - c) / h rho_j(t) - rho_{j-1}(t)
+    const T c = (_eig_range[1] + _eig_range[0]) / 2;
+    const T h = (_eig_range[1] - _eig_range[0]) / 2;
+
+    // r = b - Ax
+    A(x, *_r);
+    acc::axpy(*_r, T(-1), *_r, b);
+
+    const int s = _s;
+    std::vector<T> gram((2 * s + 1) * s);
+    std::vector<T> W_prev(s * s), B(s * s), W(s * s), a(s);
+    T rnorm0 = 0;
+
+    int k = 0;
+    for (; k < _max_iter; ++k)
+    {
+      add_profiling_annotation("s-step cg solver iteration");
+
+      // Basis V = [rho_0 z, ..., rho_{s-1} z], z = D^-1 r, and AV
+      acc::pointwise_mult(*_V[0], *_r, *_diag_inv);
+      for (int j = 0; j < s; ++j)
+      {
+        A(*_V[j], *_AV[j]);
+        if (j + 1 < s)
+        {
+          const Vector& v_prev = (j == 0) ? *_V[0] : *_V[j - 1];
+          hipLaunchKernelGGL(sstep_basis<T>, grid_size, block_size, 0, 0, N,
+                             _diag_inv->array().data(), _AV[j]->array().data(),
+                             _V[j]->array().data(), v_prev.array().data(),
+                             _V[j + 1]->mutable_array().data(), T((j == 0 ? 1 : 2) / h), c,
+                             T(j == 0 ? 0 : 1));
+          err_check(hipGetLastError());
+        }
+      }
+
+      // All inner products with one reduction
+      thrust::fill(thrust::device, _gram.begin(), _gram.end(), T{0.0});
+      {
+        dim3 dot_block(256);
+        dim3 dot_grid(std::min<int>((N + dot_block.x - 1) / dot_block.x, 128), (2 * s + 1) * s);
+        hipLaunchKernelGGL(block_dot<T>, dot_grid, dot_block, dot_block.x * sizeof(T), 0, N,
+                           2 * s + 1, thrust::raw_pointer_cast(_gram_x_ptrs.data()), s,
+                           thrust::raw_pointer_cast(_V_ptrs.data()),
+                           thrust::raw_pointer_cast(_gram.data()));
+        err_check(hipGetLastError());
+      }
+      thrust::copy(_gram.begin(), _gram.end(), gram.begin());
+      MPI_Allreduce(MPI_IN_PLACE, gram.data(), gram.size(), dolfinx::MPI::mpi_type<T>(),
+                    MPI_SUM, comm);
+      const T* C = gram.data();             // (AP_i, V_j)
+      const T* G = gram.data() + s * s;     // (AV_i, V_j)
+      const T* g = gram.data() + 2 * s * s; // (r, V_j)
+
+      // Convergence test on (r, D^-1 r)
+      const T rnorm = g[0];
+      if (k == 0)
+        rnorm0 = rnorm;
+      if (rank == 0 and verbose)
+        std::cout << "Iteration " << k * s << " residual " << std::sqrt(rnorm) << std::endl;
+      if (rnorm / rnorm0 < _rtol * _rtol)
+        break;
+
+      // A-orthogonalise against the previous block, P = V - P_prev B with
+      // B = W_prev^-1 C, and W = P^T A P = G - B^T C
+      std::fill(B.begin(), B.end(), 0);
+      if (k > 0)
+      {
+        for (int j = 0; j < s; ++j)
+        {
+          std::vector<T> col(s);
+          for (int i = 0; i < s; ++i)
+            col[i] = C[i * s + j];
+          cholesky_solve(W_prev, s, col.data());
+          for (int i = 0; i < s; ++i)
+            B[i * s + j] = col[i];
+        }
+      }
+      for (int i = 0; i < s; ++i)
+        for (int j = 0; j < s; ++j)
+        {
+          W[i * s + j] = (G[i * s + j] + G[j * s + i]) / 2;
+          for (int l = 0; l < s; ++l)
+            W[i * s + j] -= B[l * s + i] * C[l * s + j];
+        }
+      if (!cholesky(W, s))
+        throw std::runtime_error("s-step CG: basis is not numerically independent, reduce s");
+
+      // Step lengths a = W^-1 P^T r, with P^T r = V^T r
+      std::copy_n(g, s, a.begin());
+      cholesky_solve(W, s, a.data());
+
+      // Update the block of directions
+      for (int j = 0; j < s; ++j)
+      {
+        acc::copy(*_P_new[j], *_V[j]);
+        acc::copy(*_AP_new[j], *_AV[j]);
+        if (k > 0)
+        {
+          std::vector<T> col(s);
+          for (int i = 0; i < s; ++i)
+            col[i] = -B[i * s + j];
+          thrust::copy(col.begin(), col.end(), _coeffs.begin());
+          block_update(_P_ptrs, *_P_new[j]);
+          block_update(_AP_ptrs, *_AP_new[j]);
+        }
+      }
+
+      // x += P a, r -= AP a
+      thrust::copy(a.begin(), a.end(), _coeffs.begin());
+      block_update(_P_new_ptrs, x);
+      std::transform(a.begin(), a.end(), a.begin(), [](T v) { return -v; });
+      thrust::copy(a.begin(), a.end(), _coeffs.begin());
+      block_update(_AP_new_ptrs, *_r);
+
+      std::swap(_P, _P_new);
+      std::swap(_AP, _AP_new);
+      std::swap(_P_ptrs, _P_new_ptrs);
+      std::swap(_AP_ptrs, _AP_new_ptrs);
+      std::swap(W_prev, W);
+      update_gram_pointers();
+      remove_profiling_annotation("s-step cg solver iteration");
+    }
+
+    return k * s;
+  }
+
+private:
+  /// Set the vectors entering the block inner products with V: (AP_i, V_j),
+  /// (AV_i, V_j) and (r, V_j)
+  void update_gram_pointers()
+  {
+    std::vector<T*> x_ptrs;
+    for (auto& v : _AP)
+      x_ptrs.push_back(v->mutable_array().data());
+    for (auto& v : _AV)
+      x_ptrs.push_back(v->mutable_array().data());
+    x_ptrs.push_back(_r->mutable_array().data());
+    _gram_x_ptrs = thrust::device_vector<T*>(x_ptrs.begin(), x_ptrs.end());
+  }
+
+  /// y += sum_j coeffs[j] X[j], with coeffs already on device
+  void block_update(const thrust::device_vector<T*>& X, Vector& y)
+  {
+    const int N = _bs * _map->size_local();
+    dim3 block_size(512);
+    dim3 grid_size((N + block_size.x - 1) / block_size.x);
+    hipLaunchKernelGGL(block_axpy<T>, grid_size, block_size, 0, 0, N, _s,
+                       thrust::raw_pointer_cast(X.data()),
+                       thrust::raw_pointer_cast(_coeffs.data()), y.mutable_array().data());
+    err_check(hipGetLastError());
+  }
+
+  /// Limit for the number of outer iterations
+  int _max_iter;
+
+  /// Relative tolerance
+  T _rtol;
+
+  // Map describing the data layout
+  std::shared_ptr<const common::IndexMap> _map;
+
+  // Block size
+  int _bs;
+
+  /// Number of Krylov vectors per outer iteration
+  int _s;
+
+  /// Eigenvalue bounds of D^-1 A
+  std::array<T, 2> _eig_range;
+
+  /// Krylov basis, directions and their products with A (current and
+  /// previous blocks), with device arrays of pointers to their data
+  std::vector<std::unique_ptr<Vector>> _V, _AV, _P, _AP, _P_new, _AP_new;
+  thrust::device_vector<T*> _V_ptrs, _AV_ptrs, _P_ptrs, _AP_ptrs, _P_new_ptrs, _AP_new_ptrs;
+
+  /// Vectors entering the block inner products ([AP, AV, r])
+  thrust::device_vector<T*> _gram_x_ptrs;
+
+  /// Block inner products and update coefficients
+  thrust::device_vector<T> _gram;
+  thrust::device_vector<T> _coeffs;
+
+  /// Working vectors
+  std::unique_ptr<Vector> _r;
+  std::unique_ptr<Vector> _diag_inv;
+};
+} // namespace dolfinx::acc
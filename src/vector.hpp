@@ -152,10 +152,10 @@ public:
   template <typename OtherVector>
   void copy_from_host(const OtherVector& other)
   {
-    // Copies only local data
+    // Copies only local data (all block entries of the owned indices)
     auto* other_ptr = other.array().data();
     auto* this_ptr = thrust::raw_pointer_cast(_x.data());
-    std::size_t size_bytes = _map->size_local() * sizeof(value_type);
+    std::size_t size_bytes = _bs * _map->size_local() * sizeof(value_type);
 #ifdef USE_HIP
     err_check(hipMemcpy(this_ptr, other_ptr, size_bytes, hipMemcpyHostToDevice));
 #elif USE_CUDA
@@ -383,14 +383,14 @@ private:
   container<T, D> _x;
 };
 
-/// Compute the inner product of two vectors. The two vectors must have
-/// the same parallel layout
-/// @note Collective MPI operation
+/// Compute the inner product of the owned parts of two vectors on this
+/// process, without reduction. The two vectors must have the same parallel
+/// layout
 /// @param a A vector
 /// @param b A vector
-/// @return Returns `a^{H} b` (`a^{T} b` if `a` and `b` are real)
+/// @return Returns the local contribution to `a^{H} b`
 template <typename Vector>
-auto inner_product(const Vector& a, const Vector& b)
+auto inner_product_local(const Vector& a, const Vector& b)
 {
   using T = typename Vector::value_type;
 
@@ -404,7 +404,20 @@ auto inner_product(const Vector& a, const Vector& b)
   T local = 0;
   if constexpr (Vector::device != Device::CPP)
     local = thrust::inner_product(thrust::device, x_a.begin(), x_a.end(), x_b.begin(), T{0.0});
+  return local;
+}
 
+/// Compute the inner product of two vectors. The two vectors must have
+/// the same parallel layout
+/// @note Collective MPI operation
+/// @param a A vector
+/// @param b A vector
+/// @return Returns `a^{H} b` (`a^{T} b` if `a` and `b` are real)
+template <typename Vector>
+auto inner_product(const Vector& a, const Vector& b)
+{
+  using T = typename Vector::value_type;
+  T local = inner_product_local(a, b);
   T result;
   MPI_Allreduce(&local, &result, 1, dolfinx::MPI::mpi_type<T>(), MPI_SUM, a.map()->comm());
   return result;
@@ -458,7 +471,8 @@ void axpy(Vector& r, S alpha, const Vector& x, const Vector& y)
 {
   spdlog::debug("AXPY start");
   using T = typename Vector::value_type;
-  thrust::transform(thrust::device, x.array().begin(), x.array().begin() + x.map()->size_local(),
+  const std::int32_t local_size = x.bs() * x.map()->size_local();
+  thrust::transform(thrust::device, x.array().begin(), x.array().begin() + local_size,
                     y.array().begin(), r.mutable_array().begin(),
                     [alpha] __host__ __device__(const T& vx, const T& vy)
                     { return vx * alpha + vy; });
@@ -499,7 +513,8 @@ void pointwise_mult(Vector& w, const Vector& x, const Vector& y)
   spdlog::debug("pointwise_mult start");
 
   using T = typename Vector::value_type;
-  thrust::transform(thrust::device, x.array().begin(), x.array().begin() + x.map()->size_local(),
+  const std::int32_t local_size = x.bs() * x.map()->size_local();
+  thrust::transform(thrust::device, x.array().begin(), x.array().begin() + local_size,
                     y.array().begin(), w.mutable_array().begin(),
                     [] __host__ __device__(const T& xi, const T& yi) { return xi * yi; });
   spdlog::debug("pointwise_mult end");
@@ -508,7 +523,8 @@ void pointwise_mult(Vector& w, const Vector& x, const Vector& y)
 template <typename Vector, typename UnaryFunction>
 void transform(Vector& x, UnaryFunction op)
 {
-  thrust::transform(thrust::device, x.array().begin(), x.array().begin() + x.map()->size_local(),
+  const std::int32_t local_size = x.bs() * x.map()->size_local();
+  thrust::transform(thrust::device, x.array().begin(), x.array().begin() + local_size,
                     x.mutable_array().begin(), op);
 }
 
@@ -0,0 +1,266 @@
+// Copyright (C) 2023 Igor A. Baratta
+// SPDX-License-Identifier:    MIT
+
+// Setup shared by the tests: the Laplace problem -div(kappa grad u) = f on
+// the unit cube, with u = 0 on the boundary, using the forms of poisson.py
+// (degrees 1 to 3)
+
+#pragma once
+
+#include "../src/csr.hpp"
+#include "../src/lanczos.hpp"
+#include "../src/laplacian.hpp"
+#include "../src/mesh.hpp"
+#include "../src/vector.hpp"
+#include "poisson.h"
+
+#include <thrust/device_vector.h>
+
+#include <array>
+#include <basix/e-lagrange.h>
+#include <basix/quadrature.h>
+#include <cmath>
+#include <dolfinx.h>
+#include <dolfinx/fem/dolfinx_fem.h>
+#include <dolfinx/mesh/generation.h>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace test
+{
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, dolfinx::acc::Device::HIP>;
+
+/// Span over the data of a device vector
+template <typename U>
+std::span<U> device_span(thrust::device_vector<U>& x)
+{
+  return std::span<U>(thrust::raw_pointer_cast(x.data()), x.size());
+}
+
+/// Tensor-product ordered coordinate element of the ghosted meshes
+inline dolfinx::fem::CoordinateElement<T> create_coordinate_element()
+{
+  auto element_1 = std::make_shared<basix::FiniteElement<T>>(basix::create_tp_element<T>(
+      basix::element::family::P, basix::cell::type::hexahedron, 1,
+      basix::element::lagrange_variant::gll_warped, basix::element::dpc_variant::unset, false));
+  return dolfinx::fem::CoordinateElement<T>(element_1);
+}
+
+/// Unit cube of n x n x n hexahedra, without ghost cells
+inline dolfinx::mesh::Mesh<T> create_base_mesh(MPI_Comm comm, std::int64_t n)
+{
+  return dolfinx::mesh::create_box<T>(comm, {{{0, 0, 0}, {1, 1, 1}}}, {n, n, n},
+                                      dolfinx::mesh::CellType::hexahedron);
+}
+
+/// Unit cube of n x n x n hexahedra, with `num_layers` layers of ghost cells
+inline std::shared_ptr<dolfinx::mesh::Mesh<T>> create_mesh(MPI_Comm comm, std::int64_t n,
+                                                            int num_layers = 1)
+{
+  dolfinx::mesh::Mesh<T> base_mesh = create_base_mesh(comm, n);
+  return std::make_shared<dolfinx::mesh::Mesh<T>>(
+      ghost_layer_mesh(base_mesh, create_coordinate_element(), num_layers));
+}
+
+/// Function space of GLL-warped Lagrange elements of the given degree
+inline std::shared_ptr<dolfinx::fem::FunctionSpace<T>>
+create_space(std::shared_ptr<dolfinx::mesh::Mesh<T>> mesh, int degree)
+{
+  auto element = basix::create_tp_element<T>(
+      basix::element::family::P, basix::cell::type::hexahedron, degree,
+      basix::element::lagrange_variant::gll_warped, basix::element::dpc_variant::unset, false);
+  return std::make_shared<dolfinx::fem::FunctionSpace<T>>(
+      dolfinx::fem::create_functionspace(mesh, element, {}));
+}
+
+/// One level of the problem: space, bilinear form, boundary condition, and
+/// the on-device data referenced by the operators of the level
+struct Level
+{
+  int degree;
+  std::shared_ptr<dolfinx::fem::FunctionSpace<T>> V;
+  std::shared_ptr<dolfinx::fem::Form<T, T>> a;
+  std::shared_ptr<const dolfinx::fem::DirichletBC<T, T>> bc;
+
+  /// Cells without and with dofs shared with other processes
+  std::vector<std::int32_t> lcells, bcells;
+
+  /// Dirichlet dofs (owned and ghost) marked with 1
+  thrust::device_vector<std::int8_t> bc_marker;
+
+  /// Per-cell constants, dofmap and geometry data of MatFreeLaplacian
+  thrust::device_vector<T> constants;
+  thrust::device_vector<std::int32_t> dofmap, geometry_dofmap;
+  thrust::device_vector<T> xgeom, dphi, weights;
+
+  std::span<const std::int8_t> marker()
+  {
+    return std::span<const std::int8_t>(device_span(bc_marker));
+  }
+};
+
+/// Create a level of the given degree on a mesh, with the (shared) constant
+/// kappa as coefficient of the bilinear form
+inline std::shared_ptr<Level> create_level(std::shared_ptr<dolfinx::mesh::Mesh<T>> mesh,
+                                           int degree,
+                                           std::shared_ptr<dolfinx::fem::Constant<T>> kappa)
+{
+  std::vector form_a = {form_poisson_a1, form_poisson_a2, form_poisson_a3};
+  if (degree < 1 or degree > static_cast<int>(form_a.size()))
+    throw std::runtime_error("No form for degree " + std::to_string(degree));
+
+  auto level = std::make_shared<Level>();
+  level->degree = degree;
+  level->V = create_space(mesh, degree);
+  level->a = std::make_shared<dolfinx::fem::Form<T, T>>(dolfinx::fem::create_form<T>(
+      *form_a[degree - 1], {level->V, level->V}, {}, {{"c0", kappa}}, {}));
+
+  // Homogeneous Dirichlet condition on the exterior facets
+  const int tdim = mesh->topology()->dim();
+  mesh->topology_mutable()->create_connectivity(tdim - 1, tdim);
+  std::vector<std::int32_t> facets = dolfinx::mesh::exterior_facet_indices(*mesh->topology());
+  auto bdofs = dolfinx::fem::locate_dofs_topological(*mesh->topology(), *level->V->dofmap(),
+                                                     tdim - 1, facets);
+  level->bc = std::make_shared<const dolfinx::fem::DirichletBC<T, T>>(0.0, bdofs, level->V);
+
+  auto map = level->V->dofmap()->index_map;
+  std::vector<std::int8_t> marker(map->size_local() + map->num_ghosts(), 0);
+  for (std::int32_t dof : level->bc->dof_indices().first)
+    marker[dof] = 1;
+  level->bc_marker = thrust::device_vector<std::int8_t>(marker.begin(), marker.end());
+
+  std::tie(level->lcells, level->bcells) = compute_boundary_cells(level->V);
+  return level;
+}
+
+/// Create the matrix-free operator of a level, with all per-cell constants
+/// equal to kappa. The on-device data is stored in the level.
+inline std::shared_ptr<dolfinx::acc::MatFreeLaplacian<T>> create_matfree_operator(Level& level,
+                                                                                  T kappa)
+{
+  auto mesh = level.V->mesh();
+  auto cell_map = mesh->topology()->index_map(mesh->topology()->dim());
+  level.constants.assign(cell_map->size_local() + cell_map->num_ghosts(), kappa);
+
+  auto dofmap = level.V->dofmap()->map();
+  level.dofmap.assign(dofmap.data_handle(), dofmap.data_handle() + dofmap.size());
+
+  const dolfinx::mesh::Geometry<T>& geometry = mesh->geometry();
+  level.xgeom.assign(geometry.x().begin(), geometry.x().end());
+  auto gdofmap = geometry.dofmap();
+  level.geometry_dofmap.assign(gdofmap.data_handle(), gdofmap.data_handle() + gdofmap.size());
+
+  // Derivatives of the coordinate element and weights at the GLL points
+  std::vector<int> k_to_q{1, 3, 4, 6, 8, 10, 12, 14};
+  auto [points, weights] = basix::quadrature::make_quadrature<T>(
+      basix::quadrature::type::gll, basix::cell::type::hexahedron,
+      basix::polyset::type::standard, k_to_q.at(level.degree - 1));
+  const dolfinx::fem::CoordinateElement<T>& cmap = geometry.cmap();
+  std::array<std::size_t, 4> phi_shape = cmap.tabulate_shape(1, weights.size());
+  std::vector<T> phi(std::reduce(phi_shape.begin(), phi_shape.end(), 1, std::multiplies{}));
+  cmap.tabulate(1, points, {weights.size(), 3}, phi);
+  level.dphi.assign(phi.begin() + phi.size() / 4, phi.end());
+  level.weights.assign(weights.begin(), weights.end());
+
+  auto op = std::make_shared<dolfinx::acc::MatFreeLaplacian<T>>(
+      level.degree, device_span(level.constants), device_span(level.dofmap),
+      device_span(level.xgeom), device_span(level.geometry_dofmap), device_span(level.dphi),
+      device_span(level.weights), level.lcells, level.bcells, level.marker());
+  op->compute_diag_inverse();
+  err_check(hipDeviceSynchronize());
+  return op;
+}
+
+/// Set b to one on the free dofs and zero on the Dirichlet dofs
+inline void set_rhs(const Level& level, DeviceVector& b)
+{
+  dolfinx::la::Vector<T> b_host(b.map(), 1);
+  b_host.set(T(1.0));
+  std::span<T> values = b_host.mutable_array();
+  for (std::int32_t dof : level.bc->dof_indices().first)
+    values[dof] = 0;
+  b.copy_from_host(b_host);
+}
+
+/// Initial error with distinct values on the free dofs, and zero on the
+/// Dirichlet dofs
+inline dolfinx::la::Vector<T> initial_error(const Level& level,
+                                            std::shared_ptr<const dolfinx::common::IndexMap> map)
+{
+  dolfinx::la::Vector<T> e(map, 1);
+  e.set(T(0));
+  std::span<T> values = e.mutable_array();
+  std::int64_t offset = map->local_range()[0];
+  for (std::int32_t i = 0; i < map->size_local(); ++i)
+    values[i] = std::sin(T(offset + i));
+  for (std::int32_t dof : level.bc->dof_indices().first)
+    values[dof] = 0;
+  return e;
+}
+
+/// Check that each of `num_steps` applications of a smoother to A x = 0,
+/// from x = e, reduces the energy norm |x|_A of the error, and that a solve
+/// with zero_guess matches a solve from x = 0 (for b = A e)
+/// @return false on failure, after printing an error
+template <typename Smoother, typename Operator>
+bool check_smoother(const std::string& name, Smoother& smoother, Operator& A,
+                    std::shared_ptr<const dolfinx::common::IndexMap> map,
+                    const dolfinx::la::Vector<T>& e, int num_steps = 5)
+{
+  const int rank = dolfinx::MPI::rank(map->comm());
+  DeviceVector x(map, 1), y(map, 1), b(map, 1);
+
+  b.set(T{0.0});
+  x.copy_from_host(e);
+  A(x, y);
+  T enorm = std::sqrt(dolfinx::acc::inner_product(x, y));
+  for (int k = 1; k <= num_steps; ++k)
+  {
+    smoother.solve(A, x, b, false);
+    A(x, y);
+    T xnorm = std::sqrt(dolfinx::acc::inner_product(x, y));
+    if (rank == 0)
+      std::cout << name << " step " << k << ": |e|_A reduction " << xnorm / enorm << "\n";
+    if (!(xnorm < enorm))
+    {
+      std::cout << "Error: " << name << " step " << k << " does not reduce the error\n";
+      return false;
+    }
+    enorm = xnorm;
+  }
+
+  // Zero initial guess, with b = A e
+  x.copy_from_host(e);
+  A(x, b);
+  x.set(T{0.0});
+  smoother.solve(A, x, b, false);
+  y.set(T{1.0});
+  smoother.solve(A, y, b, false, true);
+  dolfinx::acc::axpy(y, T(-1), y, x);
+  T err = dolfinx::acc::norm(y) / dolfinx::acc::norm(x);
+  if (rank == 0)
+    std::cout << name << " zero initial guess: difference " << err << "\n";
+  if (err > 1e-12)
+  {
+    std::cout << "Error: " << name << " zero initial guess differs from x = 0\n";
+    return false;
+  }
+  return true;
+}
+
+/// Lanczos estimate of the extreme eigenvalues of D^-1 A
+template <typename Operator>
+std::array<T, 2> estimate_eigenvalues(Operator& A,
+                                      std::shared_ptr<const dolfinx::common::IndexMap> map)
+{
+  dolfinx::acc::LanczosEstimator<DeviceVector> lanczos(map, 1);
+  lanczos.set_max_iterations(20);
+  DeviceVector y(map, 1);
+  y.set(T{1.0});
+  return lanczos.estimate(A, y);
+}
+} // namespace test
@@ -0,0 +1,132 @@
+// Block CG on several right-hand sides must give, for each column, the
+// solution of Jacobi-preconditioned CGSolver on that column, in at most as
+// many iterations as CGSolver needs for the slowest column: the block
+// Krylov space contains the Krylov space of every column, and both solvers
+// test (r, D^-1 r) of each column. The multi-vector of right-hand sides
+// must also survive the copy to the device unchanged.
+
+#include "../src/block_cg.hpp"
+#include "../src/cg.hpp"
+#include "problem.hpp"
+
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction")("degree", po::value<int>()->default_value(3),
+                                           "Finite element degree");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const int degree = vm["degree"].as<int>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+    auto level = test::create_level(mesh, degree, kappa);
+    auto A = test::create_matfree_operator(*level, kappa->value[0]);
+    auto map = level->V->dofmap()->index_map;
+
+    const int ncols = 4;
+    const std::int32_t size_local = map->size_local();
+    const std::int64_t offset = map->local_range()[0];
+
+    // Columns b_j = b (1 + sin(j g) / 2) on dof g, with b = 1 on the free dofs
+    DeviceVector b(map, 1);
+    test::set_rhs(*level, b);
+    std::vector<T> b_host = b.data_copy();
+    la::Vector<T> B_host(map, ncols);
+    B_host.set(T(0.0));
+    std::span<T> B_values = B_host.mutable_array();
+    for (std::int32_t i = 0; i < size_local; ++i)
+      for (int j = 0; j < ncols; ++j)
+        B_values[i * ncols + j] = b_host[i] * (1 + std::sin(T(j * (offset + i))) / 2);
+
+    const T rtol = 1e-10;
+    DeviceVector B(map, ncols), X(map, ncols);
+    B.copy_from_host(B_host);
+    std::vector<T> B_device = B.data_copy();
+    if (!std::equal(B_values.begin(), B_values.begin() + size_local * ncols, B_device.begin()))
+    {
+      std::cout << "Error: multi-vector copy to the device lost entries" << std::endl;
+      return 1;
+    }
+    X.set(T{0.0});
+    acc::BlockCGSolver<DeviceVector> bcg(map, ncols);
+    bcg.set_max_iterations(1000);
+    bcg.set_tolerance(rtol);
+    const int its_block = bcg.solve(*A, X, B);
+    std::vector<T> X_host = X.data_copy();
+
+    acc::CGSolver<DeviceVector> cg(map, 1);
+    cg.set_max_iterations(1000);
+    cg.set_tolerance(rtol);
+    int its_cg = 0;
+    la::Vector<T> bj_host(map, 1);
+    DeviceVector bj(map, 1), xj(map, 1);
+    for (int j = 0; j < ncols; ++j)
+    {
+      std::span<T> bj_values = bj_host.mutable_array();
+      for (std::int32_t i = 0; i < size_local; ++i)
+        bj_values[i] = B_values[i * ncols + j];
+      bj.copy_from_host(bj_host);
+      xj.set(T{0.0});
+      its_cg = std::max(its_cg, cg.solve(*A, xj, bj));
+
+      // Relative difference of column j
+      std::vector<T> xj_host = xj.data_copy();
+      std::array<T, 2> diff = {0, 0};
+      for (std::int32_t i = 0; i < size_local; ++i)
+      {
+        diff[0] += (X_host[i * ncols + j] - xj_host[i]) * (X_host[i * ncols + j] - xj_host[i]);
+        diff[1] += xj_host[i] * xj_host[i];
+      }
+      MPI_Allreduce(MPI_IN_PLACE, diff.data(), 2, dolfinx::MPI::mpi_type<T>(), MPI_SUM, comm);
+      T err = std::sqrt(diff[0] / diff[1]);
+      if (rank == 0)
+        std::cout << "Column " << j << ": difference " << err << "\n";
+      if (err > 1e-6)
+      {
+        std::cout << "Error: block CG column " << j << " differs from CG" << std::endl;
+        return 1;
+      }
+    }
+
+    if (rank == 0)
+      std::cout << "Block CG " << its_block << " iterations, CG (max) " << its_cg << "\n";
+    if (its_block > its_cg + 1)
+    {
+      std::cout << "Error: block CG needs more iterations than CG" << std::endl;
+      return 1;
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
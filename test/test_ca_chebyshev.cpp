@@ -0,0 +1,110 @@
+// The communication-avoiding Chebyshev smoother must reproduce the Chebyshev
+// smoother (same eigenvalue bounds and weights) when the mesh has enough
+// ghost layers for the number of iterations (one more without zero_guess),
+// and refuse to run with too few layers.
+
+#include "../src/ca_chebyshev.hpp"
+#include "../src/chebyshev.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction")("degree", po::value<int>()->default_value(3),
+                                           "Finite element degree");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const int degree = vm["degree"].as<int>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    const int num_layers = 3;
+    auto mesh = test::create_mesh(comm, nc, num_layers);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+    auto level = test::create_level(mesh, degree, kappa);
+    auto A = test::create_matfree_operator(*level, kappa->value[0]);
+    auto map = level->V->dofmap()->index_map;
+    const T lmax = 1.1 * test::estimate_eigenvalues(*A, map)[1];
+    const std::array<T, 2> eig_range = {T(0.1) * lmax, lmax};
+
+    DeviceVector b(map, 1);
+    test::set_rhs(*level, b);
+    la::Vector<T> x_host = test::initial_error(*level, map);
+    DeviceVector x(map, 1), x_ca(map, 1);
+
+    acc::Chebyshev<DeviceVector> chebyshev(map, 1, eig_range, *A);
+    acc::CAChebyshev<DeviceVector> ca(map, 1, eig_range, *A, level->marker(), num_layers);
+    for (bool zero_guess : {false, true})
+    {
+      for (int k = 1; k + (zero_guess ? 0 : 1) <= num_layers; ++k)
+      {
+        chebyshev.set_max_iterations(k);
+        ca.set_max_iterations(k);
+        x.copy_from_host(x_host);
+        x_ca.copy_from_host(x_host);
+        chebyshev.solve(*A, x, b, false, zero_guess);
+        ca.solve(*A, x_ca, b, false, zero_guess);
+
+        acc::axpy(x_ca, T(-1), x_ca, x);
+        T err = acc::norm(x_ca) / acc::norm(x);
+        if (rank == 0)
+        {
+          std::cout << k << " iterations" << (zero_guess ? " (zero guess)" : "")
+                    << ": difference " << err << "\n";
+        }
+        if (err > 1e-10)
+        {
+          std::cout << "Error: CA Chebyshev differs from Chebyshev with " << k << " iterations"
+                    << std::endl;
+          return 1;
+        }
+      }
+    }
+
+    // One iteration more than the ghost layers allow
+    ca.set_max_iterations(num_layers);
+    bool thrown = false;
+    try
+    {
+      ca.solve(*A, x_ca, b, false);
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    if (!thrown)
+    {
+      std::cout << "Error: CA Chebyshev ran with too few ghost layers" << std::endl;
+      return 1;
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
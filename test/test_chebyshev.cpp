@@ -0,0 +1,144 @@
+// Smoothing bound of the fourth kind Chebyshev smoother. With lmax an upper
+// bound of the spectrum of D^-1 A (D the diagonal of A), k iterations on
+// A x = 0 map an error e to e' = p(D^-1 A) e with
+//   |e'|_A^2 <= sigma_k lmax (|e|_D^2 - |e'|_D^2),
+// where sigma_k = max_{0 < t <= 1} t p(t lmax)^2 / (1 - p(t lmax)^2) is the
+// smoothing factor of Lottes (2022). It is 3 / (4k(k + 1)) for the plain
+// fourth kind recurrence and smaller for the optimised weights.
+// The residual returned by the smoother must be b - Ax of the returned x.
+
+#include "../src/chebyshev.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction")("degree", po::value<int>()->default_value(3),
+                                           "Finite element degree");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const int degree = vm["degree"].as<int>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+    auto level = test::create_level(mesh, degree, kappa);
+    acc::MatrixOperator<T> A(level->a, {level->bc});
+    auto map = A.column_index_map();
+
+    // Lanczos converges to the largest eigenvalue from below
+    const T lmax = 1.1 * test::estimate_eigenvalues(A, map)[1];
+
+    DeviceVector diag_inv(map, 1);
+    A.get_diag_inverse(diag_inv);
+    std::vector<T> dinv = diag_inv.data_copy();
+
+    // Initial error with distinct values on the free dofs
+    la::Vector<T> e_host(map, 1);
+    e_host.set(T(0));
+    std::span<T> values = e_host.mutable_array();
+    std::int64_t offset = map->local_range()[0];
+    for (std::int32_t i = 0; i < map->size_local(); ++i)
+      values[i] = std::sin(T(offset + i));
+    for (std::int32_t dof : level->bc->dof_indices().first)
+      values[dof] = 0;
+
+    // |e|_D^2
+    T enorm_D = 0;
+    for (std::int32_t i = 0; i < map->size_local(); ++i)
+      if (dinv[i] != 0)
+        enorm_D += values[i] * values[i] / dinv[i];
+    MPI_Allreduce(MPI_IN_PLACE, &enorm_D, 1, dolfinx::MPI::mpi_type<T>(), MPI_SUM, comm);
+
+    // Smoothing factors of the optimised weights, from the polynomials of
+    // degree 1 to 4 (the maximum is attained at t = 1)
+    const std::array<T, 4> sigma_opt = {1.0 / 3.0, 0.105572809, 0.052095084, 0.031091205};
+
+    DeviceVector x(map, 1), b(map, 1), y(map, 1), r(map, 1);
+    b.set(T{0.0});
+    for (int k = 1; k <= 4; ++k)
+    {
+      for (bool optimized : {false, true})
+      {
+        acc::Chebyshev<DeviceVector> smoother(map, 1, {T(0.1) * lmax, lmax}, A);
+        smoother.set_max_iterations(k);
+        smoother.set_optimized_weights(optimized);
+
+        x.copy_from_host(e_host);
+        smoother.solve(A, x, b, false);
+
+        // |e'|_A^2 and |e'|_D^2
+        A(x, y);
+        T xnorm_A = acc::inner_product(x, y);
+        std::vector<T> xh = x.data_copy();
+        T xnorm_D = 0;
+        for (std::int32_t i = 0; i < map->size_local(); ++i)
+          if (dinv[i] != 0)
+            xnorm_D += xh[i] * xh[i] / dinv[i];
+        MPI_Allreduce(MPI_IN_PLACE, &xnorm_D, 1, dolfinx::MPI::mpi_type<T>(), MPI_SUM, comm);
+
+        T sigma = optimized ? sigma_opt[k - 1] : T(3) / T(4 * k * (k + 1));
+        T ratio = xnorm_A / (sigma * lmax * (enorm_D - xnorm_D));
+        if (rank == 0)
+        {
+          std::cout << "Degree " << k << (optimized ? " (optimised)" : "")
+                    << ": |e'|_A^2 / bound = " << ratio << "\n";
+        }
+        if (ratio > 1 + 1e-6)
+        {
+          std::cout << "Error: Chebyshev smoothing bound violated at degree " << k << std::endl;
+          return 1;
+        }
+
+        // Returned residual, with b = A e
+        x.copy_from_host(e_host);
+        A(x, b);
+        y.set(T{0.0});
+        smoother.solve(A, y, b, false, true, &r);
+        A(y, x);
+        acc::axpy(x, T(-1), x, b);
+        acc::axpy(x, T(-1), x, r);
+        T rerr = acc::norm(x) / acc::norm(b);
+        if (rank == 0)
+          std::cout << "Degree " << k << ": returned residual difference " << rerr << "\n";
+        if (rerr > 1e-12)
+        {
+          std::cout << "Error: Chebyshev returned residual differs from b - Ax at degree " << k
+                    << std::endl;
+          return 1;
+        }
+        b.set(T{0.0});
+      }
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
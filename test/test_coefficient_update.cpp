@@ -0,0 +1,151 @@
+// Updating the coefficient of a p-multigrid hierarchy in place, by a uniform
+// scaling (scale_coefficients) or by new per-cell constants with a rebuilt
+// coarse solver, must give the solution of the scaled problem in the same
+// number of iterations as the original solve.
+
+#include "../src/amg.hpp"
+#include "../src/cg.hpp"
+#include "../src/chebyshev.hpp"
+#include "../src/pmg.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(12),
+      "number of cells in each direction")("alpha", po::value<T>()->default_value(10),
+                                           "scaling of kappa");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const T alpha = vm["alpha"].as<T>();
+
+  init_logging(argc, argv);
+  PetscInitialize(&argc, &argv, nullptr, nullptr);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+
+    // Hierarchy of degrees 1, 2, 3 with matrix-free operators and
+    // Chebyshev smoothers
+    std::vector<int> order = {1, 2, 3};
+    std::vector<std::shared_ptr<test::Level>> levels;
+    std::vector<std::shared_ptr<const common::IndexMap>> maps;
+    std::vector<std::shared_ptr<acc::MatFreeLaplacian<T>>> operators;
+    std::vector<std::shared_ptr<acc::Chebyshev<DeviceVector>>> smoothers;
+    for (int p : order)
+    {
+      levels.push_back(test::create_level(mesh, p, kappa));
+      maps.push_back(levels.back()->V->dofmap()->index_map);
+      operators.push_back(test::create_matfree_operator(*levels.back(), kappa->value[0]));
+      std::array<T, 2> eig = test::estimate_eigenvalues(*operators.back(), maps.back());
+      smoothers.push_back(std::make_shared<acc::Chebyshev<DeviceVector>>(
+          maps.back(), 1, std::array<T, 2>{0.1 * eig[1], 1.1 * eig[1]}, *operators.back()));
+      smoothers.back()->set_max_iterations(2);
+    }
+
+    std::vector<std::shared_ptr<acc::MatrixOperator<T>>> prolongation;
+    for (std::size_t i = 0; i + 1 < levels.size(); ++i)
+    {
+      prolongation.push_back(
+          std::make_shared<acc::MatrixOperator<T>>(*levels[i]->V, *levels[i + 1]->V));
+    }
+
+    using PMG = acc::MultigridPreconditioner<DeviceVector, acc::MatFreeLaplacian<T>,
+                                             acc::MatrixOperator<T>, acc::MatrixOperator<T>,
+                                             acc::Chebyshev<DeviceVector>, CoarseSolverType<T>>;
+    PMG pmg(maps, 1, levels[0]->marker());
+    pmg.set_solvers(smoothers);
+    pmg.set_operators(operators);
+    pmg.set_interpolators(prolongation);
+    pmg.set_coarse_solver(std::make_shared<CoarseSolverType<T>>(levels[0]->a, levels[0]->bc));
+    pmg.set_zero_initial_guess(true);
+
+    DeviceVector b(maps.back(), 1);
+    test::set_rhs(*levels.back(), b);
+
+    acc::CGSolver<DeviceVector> cg(maps.back(), 1);
+    cg.set_max_iterations(50);
+    cg.set_tolerance(1e-10);
+    cg.set_flexible(true);
+
+    // Solve with the current hierarchy, and compare with x0 / scale
+    DeviceVector x0(maps.back(), 1);
+    x0.set(T{0.0});
+    const int its0 = cg.solve(*operators.back(), pmg, x0, b);
+    const T x0norm = acc::norm(x0);
+    DeviceVector x(maps.back(), 1);
+    auto check = [&](const std::string& stage, T scale)
+    {
+      x.set(T{0.0});
+      int its = cg.solve(*operators.back(), pmg, x, b);
+      acc::axpy(x, -scale, x, x0);
+      T err = acc::norm(x) / x0norm;
+      if (rank == 0)
+      {
+        std::cout << stage << ": iterations " << its << " (" << its0 << "), error " << err
+                  << "\n";
+      }
+      return err < 1e-6 and std::abs(its - its0) <= 1;
+    };
+
+    // New per-cell constants, diagonals and coarse solver
+    kappa->value[0] *= alpha;
+    for (std::size_t i = 0; i < levels.size(); ++i)
+    {
+      thrust::fill(levels[i]->constants.begin(), levels[i]->constants.end(), kappa->value[0]);
+      operators[i]->update_coefficients(test::device_span(levels[i]->constants));
+    }
+    pmg.update_diagonals();
+    pmg.set_coarse_solver(std::make_shared<CoarseSolverType<T>>(levels[0]->a, levels[0]->bc));
+    if (!check("Updated coefficients", alpha))
+    {
+      std::cout << "Error: updated coefficients do not reproduce the scaled solution\n";
+      return 1;
+    }
+
+    // Uniform scaling, keeping the coarse solver set up for the previous kappa
+    kappa->value[0] *= alpha;
+    pmg.scale_coefficients(alpha);
+    if (!check("Scaled coefficients", alpha * alpha))
+    {
+      std::cout << "Error: scaled coefficients do not reproduce the scaled solution\n";
+      return 1;
+    }
+
+    // A coarse solver set up for the current kappa must not be rescaled
+    pmg.set_coarse_solver(std::make_shared<CoarseSolverType<T>>(levels[0]->a, levels[0]->bc));
+    if (!check("New coarse solver", alpha * alpha))
+    {
+      std::cout << "Error: new coarse solver after scaling does not reproduce the solution\n";
+      return 1;
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  PetscFinalize();
+  return 0;
+}
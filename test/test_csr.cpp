@@ -1,6 +1,6 @@
-#include "../../src/csr.hpp"
-#include "../../src/vector.hpp"
-#include "../../src/mesh.hpp"
+#include "../src/csr.hpp"
+#include "../src/vector.hpp"
+#include "../src/mesh.hpp"
 #include <thrust/device_vector.h>
 
 #include <array>
@@ -25,7 +25,7 @@ int main(int argc, char* argv[])
 
   po::options_description desc("Allowed options");
   desc.add_options()("help,h", "print usage message")(
-      "ncells", po::value<std::size_t>()->default_value(100), "number of cells in each direction per rank")(
+      "ncells", po::value<std::int64_t>()->default_value(100), "number of cells in each direction per rank")(
       "degree", po::value<int>()->default_value(1), "Finite element degree");
 
   po::variables_map vm;
@@ -37,7 +37,7 @@ int main(int argc, char* argv[])
     std::cout << desc << std::endl;
     return 0;
   }
-  const std::size_t nc = vm["ncells"].as<std::size_t>();
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
   int degree = vm["degree"].as<int>();
 
   init_logging(argc, argv);
@@ -53,7 +53,11 @@ int main(int argc, char* argv[])
     {
       mesh::Mesh<T> base_mesh = mesh::create_box<T>(
           comm, {{{0, 0, 0}, {1, 1, 1}}}, {nc, nc, nc}, mesh::CellType::hexahedron);
-      mesh = std::make_shared<mesh::Mesh<T>>(ghost_layer_mesh(base_mesh));
+      auto element_1 = std::make_shared<basix::FiniteElement<T>>(basix::create_tp_element<T>(
+          basix::element::family::P, basix::cell::type::hexahedron, 1,
+          basix::element::lagrange_variant::gll_warped, basix::element::dpc_variant::unset, false));
+      fem::CoordinateElement<T> coord_element(element_1);
+      mesh = std::make_shared<mesh::Mesh<T>>(ghost_layer_mesh(base_mesh, coord_element));
     }
 
     int tdim = mesh->topology()->dim();
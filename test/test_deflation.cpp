@@ -0,0 +1,97 @@
+// Deflated CG: after a first solve harvests Ritz vectors of the smallest
+// eigenvalues of D^-1 A, a solve with another right-hand side must reach
+// the solution of plain Jacobi-preconditioned CG in fewer iterations.
+
+#include "../src/cg.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction")("degree", po::value<int>()->default_value(3),
+                                           "Finite element degree");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const int degree = vm["degree"].as<int>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+    auto level = test::create_level(mesh, degree, kappa);
+    auto A = test::create_matfree_operator(*level, kappa->value[0]);
+    auto map = level->V->dofmap()->index_map;
+
+    // Right-hand sides b = 1 and b2 = 1 + sin(g) / 2 on the free dofs g
+    DeviceVector b(map, 1), b2(map, 1);
+    test::set_rhs(*level, b);
+    la::Vector<T> b2_host(map, 1);
+    b2_host.set(T(0.0));
+    std::vector<T> b_host = b.data_copy();
+    std::span<T> b2_values = b2_host.mutable_array();
+    const std::int64_t offset = map->local_range()[0];
+    for (std::int32_t i = 0; i < map->size_local(); ++i)
+      b2_values[i] = b_host[i] * (1 + std::sin(T(offset + i)) / 2);
+    b2.copy_from_host(b2_host);
+
+    const T rtol = 1e-10;
+    acc::CGSolver<DeviceVector> cg(map, 1);
+    cg.set_max_iterations(1000);
+    cg.set_tolerance(rtol);
+    DeviceVector x_cg(map, 1), x(map, 1);
+    x_cg.set(T{0.0});
+    const int its_cg = cg.solve(*A, x_cg, b2);
+
+    acc::CGSolver<DeviceVector> dcg(map, 1);
+    dcg.set_max_iterations(1000);
+    dcg.set_tolerance(rtol);
+    dcg.set_deflation(8, 40);
+    x.set(T{0.0});
+    dcg.solve(*A, x, b);
+    const int nw = dcg.num_deflation_vectors();
+    x.set(T{0.0});
+    const int its = dcg.solve(*A, x, b2);
+
+    acc::axpy(x, T(-1), x, x_cg);
+    T err = acc::norm(x) / acc::norm(x_cg);
+    if (rank == 0)
+    {
+      std::cout << "CG " << its_cg << " iterations, deflated CG (" << nw << " vectors) " << its
+                << " iterations, difference " << err << "\n";
+    }
+    if (nw == 0 or its >= its_cg or err > 1e-6)
+    {
+      std::cout << "Error: deflation does not reduce the number of iterations" << std::endl;
+      return 1;
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
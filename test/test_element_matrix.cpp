@@ -0,0 +1,106 @@
+// The element-matrix operator must match the assembled CSR matrix of the same
+// form (action and inverse diagonal) on each degree, with Dirichlet rows and
+// columns replaced by the identity in both.
+
+#include "../src/element_matrix.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+/// Largest relative difference of the owned entries of two vectors
+T max_difference(DeviceVector& x, DeviceVector& y)
+{
+  const std::int32_t size_local = x.map()->size_local();
+  std::vector<T> xh = x.data_copy();
+  std::vector<T> yh = y.data_copy();
+  std::array<T, 2> diff = {0, 0};
+  for (std::int32_t i = 0; i < size_local; ++i)
+  {
+    diff[0] = std::max(diff[0], std::abs(xh[i] - yh[i]));
+    diff[1] = std::max(diff[1], std::abs(yh[i]));
+  }
+  MPI_Allreduce(MPI_IN_PLACE, diff.data(), 2, dolfinx::MPI::mpi_type<T>(), MPI_MAX,
+                x.map()->comm());
+  return diff[0] / diff[1];
+}
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+
+    for (int degree : {1, 2, 3})
+    {
+      auto level = test::create_level(mesh, degree, kappa);
+      auto map = level->V->dofmap()->index_map;
+
+      acc::ElementMatrixOperator<T> E(level->a, {level->bc}, level->lcells, level->bcells);
+      acc::MatrixOperator<T> A(level->a, {level->bc});
+
+      // Input with distinct values on the owned dofs
+      la::Vector<T> x_host(map, 1);
+      std::span<T> values = x_host.mutable_array();
+      std::int64_t offset = map->local_range()[0];
+      for (std::int32_t i = 0; i < map->size_local(); ++i)
+        values[i] = std::sin(T(offset + i));
+
+      DeviceVector xe(map, 1), ye(map, 1);
+      DeviceVector xc(A.column_index_map(), 1), yc(A.column_index_map(), 1);
+      xe.copy_from_host(x_host);
+      xc.copy_from_host(x_host);
+      E(xe, ye);
+      A(xc, yc);
+      T err_apply = max_difference(ye, yc);
+
+      E.get_diag_inverse(ye);
+      A.get_diag_inverse(yc);
+      T err_diag = max_difference(ye, yc);
+
+      if (rank == 0)
+      {
+        std::cout << "Degree " << degree << ": action error " << err_apply
+                  << ", diagonal error " << err_diag << "\n";
+      }
+      if (err_apply > 1e-12 or err_diag > 1e-12)
+      {
+        std::cout << "Error: element matrices differ from the CSR matrix at degree " << degree
+                  << std::endl;
+        return 1;
+      }
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
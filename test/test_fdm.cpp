@@ -0,0 +1,63 @@
+// Convergence of the fast diagonalisation cell smoother. On each degree, each
+// step on A x = 0 (undamped, as in the example) must reduce the energy norm
+// |x|_A of the error, and a solve with zero_guess must match a solve from
+// x = 0.
+
+#include "../src/fdm.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+    for (int degree : {1, 2, 3})
+    {
+      auto level = test::create_level(mesh, degree, kappa);
+      auto A = test::create_matfree_operator(*level, kappa->value[0]);
+      auto map = level->V->dofmap()->index_map;
+
+      acc::FDMSmoother<DeviceVector> smoother(level->V, test::device_span(level->constants),
+                                              level->marker());
+      la::Vector<T> e_host = test::initial_error(*level, map);
+      if (!test::check_smoother("FDM degree " + std::to_string(degree), smoother, *A, map,
+                                e_host))
+      {
+        return 1;
+      }
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
@@ -0,0 +1,109 @@
+// Ghost cells of ghost_layer_mesh. With one layer, a process ghosts exactly
+// the cells of each other process that touch a vertex owned by that process
+// and shared with it, counted here on the mesh without ghost cells. Each
+// additional layer must add ghost cells.
+
+#include "problem.hpp"
+
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+#include <numeric>
+#include <vector>
+
+using namespace dolfinx;
+using T = double;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0, size = 0;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    mesh::Mesh<T> base_mesh = test::create_base_mesh(comm, nc);
+    fem::CoordinateElement<T> coord_element = test::create_coordinate_element();
+
+    // Number of cells sent to each process: the owned cells with an owned
+    // vertex ghosted there
+    auto vertex_map = base_mesh.topology()->index_map(0);
+    auto vertex_destinations = vertex_map->index_to_dest_ranks();
+    auto c_to_v = base_mesh.topology()->connectivity(3, 0);
+    std::vector<std::int32_t> num_sent(size, 0);
+    std::vector<int> cdests;
+    for (std::int32_t c = 0; c < base_mesh.topology()->index_map(3)->size_local(); ++c)
+    {
+      cdests.clear();
+      for (std::int32_t v : c_to_v->links(c))
+      {
+        if (v < vertex_map->size_local())
+        {
+          auto vdest = vertex_destinations.links(v);
+          cdests.insert(cdests.end(), vdest.begin(), vdest.end());
+        }
+      }
+      std::sort(cdests.begin(), cdests.end());
+      cdests.erase(std::unique(cdests.begin(), cdests.end()), cdests.end());
+      for (int dest : cdests)
+        ++num_sent[dest];
+    }
+    std::vector<std::int32_t> num_expected(size);
+    MPI_Alltoall(num_sent.data(), 1, MPI_INT32_T, num_expected.data(), 1, MPI_INT32_T, comm);
+
+    std::int64_t num_ghosts_prev = 0;
+    for (int num_layers : {1, 2, 3})
+    {
+      mesh::Mesh<T> mesh = ghost_layer_mesh(base_mesh, coord_element, num_layers);
+      auto cell_map = mesh.topology()->index_map(3);
+      std::int64_t num_ghosts = cell_map->num_ghosts();
+      MPI_Allreduce(MPI_IN_PLACE, &num_ghosts, 1, MPI_INT64_T, MPI_SUM, comm);
+      if (rank == 0)
+        std::cout << num_layers << " layers: " << num_ghosts << " ghost cells\n";
+
+      if (num_layers == 1)
+      {
+        // Ghost cells by owner
+        std::vector<std::int32_t> num_received(size, 0);
+        for (int owner : cell_map->owners())
+          ++num_received[owner];
+        if (num_received != num_expected)
+        {
+          std::cout << "Error: one ghost layer does not match the owned vertex destinations"
+                    << std::endl;
+          return 1;
+        }
+      }
+      else if (num_ghosts <= num_ghosts_prev)
+      {
+        std::cout << "Error: ghost layer " << num_layers << " adds no ghost cells" << std::endl;
+        return 1;
+      }
+      num_ghosts_prev = num_ghosts;
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
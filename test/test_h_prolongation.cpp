@@ -0,0 +1,101 @@
+// The assembled h-prolongation between P1 spaces on a coarse mesh and its
+// factor-2 refinement (with nested partitions) must reproduce interpolation:
+// applied to the coarse interpolant of a trilinear function, which is exact
+// on both meshes, it must give the fine interpolant of the same function.
+
+#include "../src/hmg.hpp"
+#include "problem.hpp"
+
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(8),
+      "number of cells in each direction of the fine mesh (even)");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    // Coarse and fine meshes, partitioned in blocks of the coarse grid
+    fem::CoordinateElement<T> coord_element = test::create_coordinate_element();
+    std::vector<std::shared_ptr<mesh::Mesh<T>>> meshes;
+    for (int k : {1, 0})
+    {
+      std::array<std::int64_t, 3> n = {nc >> k, nc >> k, nc >> k};
+      mesh::Mesh<T> base_mesh
+          = build_hex<T>(comm, comm, {{{0, 0, 0}, {1, 1, 1}}}, n,
+                         fem::CoordinateElement<T>(mesh::CellType::hexahedron, 1),
+                         create_structured_partitioner(n, 1 - k));
+      meshes.push_back(
+          std::make_shared<mesh::Mesh<T>>(ghost_layer_mesh(base_mesh, coord_element)));
+    }
+    auto Vc = test::create_space(meshes[0], 1);
+    auto Vf = test::create_space(meshes[1], 1);
+
+    acc::MatrixOperator<T> P(acc::create_h_prolongation(*Vc, *Vf), comm);
+
+    // Trilinear function, interpolated on both meshes
+    auto f = [](auto x) -> std::pair<std::vector<T>, std::vector<std::size_t>>
+    {
+      std::vector<T> out(x.extent(1));
+      for (std::size_t p = 0; p < x.extent(1); ++p)
+        out[p] = 1 + x(0, p) + 2 * x(1, p) + 3 * x(2, p) + x(0, p) * x(1, p) * x(2, p);
+      return {out, {out.size()}};
+    };
+    fem::Function<T> uc(Vc), uf(Vf);
+    uc.interpolate(f);
+    uf.interpolate(f);
+
+    // The ghosts of the column map of P may differ from those of Vc: copy
+    // the owned values only
+    la::Vector<T> xc_host(P.column_index_map(), 1);
+    std::span<const T> uc_values = uc.x()->array();
+    std::copy_n(uc_values.begin(), Vc->dofmap()->index_map->size_local(),
+                xc_host.mutable_array().begin());
+    DeviceVector xc(P.column_index_map(), 1);
+    xc.copy_from_host(xc_host);
+
+    DeviceVector yf(P.row_index_map(), 1), uf_d(P.row_index_map(), 1);
+    uf_d.copy_from_host(*uf.x());
+    P(xc, yf);
+
+    acc::axpy(yf, T(-1), yf, uf_d);
+    T err = acc::norm(yf) / acc::norm(uf_d);
+    if (rank == 0)
+      std::cout << "h-prolongation vs interpolation: difference " << err << "\n";
+    if (err > 1e-12)
+    {
+      std::cout << "Error: h-prolongation differs from interpolation" << std::endl;
+      return 1;
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
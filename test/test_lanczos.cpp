@@ -0,0 +1,156 @@
+// Bounds of the Lanczos eigenvalue estimates of D^-1 A. After m iterations
+// from the starting vector v = D^-1 x0, the Ritz values are bounded by the
+// Rayleigh quotients of vectors in the Krylov space, in particular
+//   lambda_min <= R(v) and R((D^-1 A)^(m-1) v) <= lambda_max,
+// and lambda_max is bounded by the Gershgorin bound max_i sum_j |a_ij| / a_ii.
+// The on-disk cache must return the stored estimates for the same key only.
+
+#include "../src/lanczos.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction")("degree", po::value<int>()->default_value(3),
+                                           "Finite element degree");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const int degree = vm["degree"].as<int>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+    auto level = test::create_level(mesh, degree, kappa);
+    acc::MatrixOperator<T> A(level->a, {level->bc});
+    auto map = A.column_index_map();
+    const std::int32_t size_local = map->size_local();
+
+    DeviceVector diag_inv(map, 1);
+    A.get_diag_inverse(diag_inv);
+    std::vector<T> dinv = diag_inv.data_copy();
+
+    // Starting vector with distinct values
+    la::Vector<T> x_host(map, 1);
+    std::span<T> values = x_host.mutable_array();
+    std::int64_t offset = map->local_range()[0];
+    for (std::int32_t i = 0; i < size_local; ++i)
+      values[i] = 1 + std::sin(T(offset + i));
+    DeviceVector x0(map, 1);
+    x0.copy_from_host(x_host);
+
+    acc::LanczosEstimator<DeviceVector> lanczos(map, 1);
+    lanczos.set_max_iterations(20);
+    lanczos.set_tolerance(1e-3);
+    std::array<T, 2> eig = lanczos.estimate(A, x0);
+    const int m = lanczos.iterations();
+
+    // Rayleigh quotient v.Av / v.Dv
+    DeviceVector v(map, 1), w(map, 1);
+    auto rayleigh_quotient = [&]()
+    {
+      A(v, w);
+      T vAv = acc::inner_product(v, w);
+      std::vector<T> vh = v.data_copy();
+      T vDv = 0;
+      for (std::int32_t i = 0; i < size_local; ++i)
+        vDv += vh[i] * vh[i] / dinv[i];
+      MPI_Allreduce(MPI_IN_PLACE, &vDv, 1, dolfinx::MPI::mpi_type<T>(), MPI_SUM, comm);
+      return vAv / vDv;
+    };
+
+    // v = D^-1 x0, and m - 1 power iterations
+    acc::pointwise_mult(v, x0, diag_inv);
+    const T rq_start = rayleigh_quotient();
+    for (int k = 1; k < m; ++k)
+    {
+      A(v, w);
+      acc::pointwise_mult(v, w, diag_inv);
+      acc::scale(v, T(1) / acc::norm(v));
+    }
+    const T rq_power = rayleigh_quotient();
+
+    // Gershgorin bound of D^-1 A from the owned rows
+    std::vector<T> a(A.values().size());
+    std::vector<std::int32_t> row_ptr(A.row_ptr().size());
+    thrust::copy(A.values().begin(), A.values().end(), a.begin());
+    thrust::copy(A.row_ptr().begin(), A.row_ptr().end(), row_ptr.begin());
+    T gershgorin = 0;
+    for (std::int32_t i = 0; i < A.row_index_map()->size_local(); ++i)
+    {
+      T row_sum = 0;
+      for (std::int32_t j = row_ptr[i]; j < row_ptr[i + 1]; ++j)
+        row_sum += std::abs(a[j]);
+      gershgorin = std::max(gershgorin, row_sum * dinv[i]);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &gershgorin, 1, dolfinx::MPI::mpi_type<T>(), MPI_MAX, comm);
+
+    if (rank == 0)
+    {
+      std::cout << "Lanczos (" << m << " iterations): " << eig[0] << " - " << eig[1] << "\n";
+      std::cout << "Rayleigh quotients: " << rq_start << ", " << rq_power << "\n";
+      std::cout << "Gershgorin bound: " << gershgorin << "\n";
+    }
+
+    const T eps = 1e-8;
+    if (eig[0] <= 0 or eig[0] > rq_start * (1 + eps))
+    {
+      std::cout << "Error: smallest eigenvalue estimate out of bounds" << std::endl;
+      return 1;
+    }
+    if (eig[1] < rq_power * (1 - eps) or eig[1] > gershgorin * (1 + eps))
+    {
+      std::cout << "Error: largest eigenvalue estimate out of bounds" << std::endl;
+      return 1;
+    }
+
+    // Cache round trip through the file
+    const std::string filename = "test_lanczos.cache";
+    std::vector<T> constants(10, 2.0);
+    {
+      acc::EigenvalueCache<T> cache(comm, filename);
+      cache.clear();
+      cache.insert(cache.key(1000, degree, 0, constants, 20, 1e-3), eig);
+    }
+    acc::EigenvalueCache<T> cache(comm, filename);
+    std::array<T, 2> cached = {0, 0};
+    bool found = cache.find(cache.key(1000, degree, 0, constants, 20, 1e-3), cached);
+    constants[0] = 3.0;
+    std::array<T, 2> other;
+    bool found_other = cache.find(cache.key(1000, degree, 0, constants, 20, 1e-3), other);
+    if (!found or found_other or cached != eig)
+    {
+      std::cout << "Error: eigenvalue cache lookup failed" << std::endl;
+      return 1;
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+// Pipelined CG must reproduce CGSolver: the same solution and, up to the
+// different residual norm in the convergence test, the same number of
+// iterations, with Jacobi and with a Chebyshev preconditioner. Testing the
+// convergence every few iterations only may add up to interval - 1
+// iterations.
+
+#include "../src/cg.hpp"
+#include "../src/chebyshev.hpp"
+#include "../src/pipelined_cg.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+/// Chebyshev smoother from a zero initial guess, as a CG preconditioner
+template <typename Operator>
+struct ChebyshevPreconditioner
+{
+  acc::Chebyshev<DeviceVector>& smoother;
+  Operator& A;
+  void apply(const DeviceVector& r, DeviceVector& z) { smoother.solve(A, z, r, false, true); }
+};
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction")("degree", po::value<int>()->default_value(3),
+                                           "Finite element degree");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const int degree = vm["degree"].as<int>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+    auto level = test::create_level(mesh, degree, kappa);
+    auto A = test::create_matfree_operator(*level, kappa->value[0]);
+    auto map = level->V->dofmap()->index_map;
+
+    DeviceVector b(map, 1);
+    test::set_rhs(*level, b);
+
+    const T lmax = 1.1 * test::estimate_eigenvalues(*A, map)[1];
+    acc::Chebyshev<DeviceVector> chebyshev(map, 1, {T(0.1) * lmax, lmax}, *A);
+    chebyshev.set_max_iterations(2);
+    ChebyshevPreconditioner<acc::MatFreeLaplacian<T>> M{chebyshev, *A};
+
+    const T rtol = 1e-10;
+    acc::CGSolver<DeviceVector> cg(map, 1);
+    cg.set_max_iterations(1000);
+    cg.set_tolerance(rtol);
+    acc::PipelinedCGSolver<DeviceVector> pcg(map, 1);
+    pcg.set_max_iterations(1000);
+    pcg.set_tolerance(rtol);
+
+    DeviceVector x_cg(map, 1), x(map, 1);
+    for (bool jacobi : {true, false})
+    {
+      x_cg.set(T{0.0});
+      const int its_cg = jacobi ? cg.solve(*A, x_cg, b) : cg.solve(*A, M, x_cg, b);
+      const T xnorm = acc::norm(x_cg);
+
+      int its1 = 0;
+      for (int interval : {1, 5})
+      {
+        pcg.set_check_interval(interval);
+        x.set(T{0.0});
+        const int its = jacobi ? pcg.solve(*A, x, b) : pcg.solve(*A, M, x, b);
+        if (interval == 1)
+          its1 = its;
+
+        acc::axpy(x, T(-1), x, x_cg);
+        T err = acc::norm(x) / xnorm;
+        if (rank == 0)
+        {
+          std::cout << (jacobi ? "Jacobi" : "Chebyshev") << ", check interval " << interval
+                    << ": CG " << its_cg << " iterations, pipelined CG " << its
+                    << " iterations, difference " << err << "\n";
+        }
+        const bool its_ok = (interval == 1) ? std::abs(its - its_cg) <= its_cg / 10 + 2
+                                            : its >= its1 and its < its1 + interval;
+        if (!its_ok or err > 1e-6)
+        {
+          std::cout << "Error: pipelined CG does not reproduce CG" << std::endl;
+          return 1;
+        }
+      }
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
@@ -0,0 +1,66 @@
+// Convergence of the relaxation smoothers on an assembled operator. Each
+// sweep of l1-Jacobi and of the symmetric hybrid Gauss-Seidel smoother on
+// A x = 0 must reduce the energy norm |x|_A of the error, and a solve with
+// zero_guess must match a solve from x = 0 (which also exercises the ghost
+// exchange overlapped with the interior rows).
+
+#include "../src/relaxation.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction")("degree", po::value<int>()->default_value(2),
+                                           "Finite element degree");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const int degree = vm["degree"].as<int>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+    auto level = test::create_level(mesh, degree, kappa);
+    acc::MatrixOperator<T> A(level->a, {level->bc});
+    auto map = A.column_index_map();
+
+    la::Vector<T> e_host = test::initial_error(*level, map);
+
+    acc::L1Jacobi<DeviceVector> jacobi(map, 1, A);
+    if (!test::check_smoother("l1-Jacobi", jacobi, A, map, e_host))
+      return 1;
+
+    acc::MulticolorGaussSeidel<DeviceVector> gs(map, 1, A);
+    if (!test::check_smoother("Gauss-Seidel", gs, A, map, e_host))
+      return 1;
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
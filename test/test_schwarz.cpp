@@ -0,0 +1,73 @@
+// Convergence of the restricted additive Schwarz smoother. Each application
+// to A x = 0 must reduce the energy norm |x|_A of the error, for one and for
+// several local Chebyshev iterations, and a solve with zero_guess must match
+// a solve from x = 0.
+
+#include "../src/schwarz.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction")("degree", po::value<int>()->default_value(3),
+                                           "Finite element degree");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const int degree = vm["degree"].as<int>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+    auto level = test::create_level(mesh, degree, kappa);
+    auto A = test::create_matfree_operator(*level, kappa->value[0]);
+    auto map = level->V->dofmap()->index_map;
+    const T lmax = 1.1 * test::estimate_eigenvalues(*A, map)[1];
+
+    // Dirichlet and subdomain interface dofs
+    std::vector<std::int8_t> marker = compute_subdomain_interface(level->V);
+    for (std::int32_t dof : level->bc->dof_indices().first)
+      marker[dof] = 1;
+    thrust::device_vector<std::int8_t> marker_d(marker.begin(), marker.end());
+
+    la::Vector<T> e_host = test::initial_error(*level, map);
+    for (int k : {1, 3})
+    {
+      acc::SchwarzSmoother<DeviceVector> smoother(map, 1, {T(0.1) * lmax, lmax}, *A,
+                                                  test::device_span(marker_d));
+      smoother.set_max_iterations(k);
+      if (!test::check_smoother("Schwarz (" + std::to_string(k) + " local iterations)", smoother,
+                                *A, map, e_host))
+      {
+        return 1;
+      }
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
@@ -0,0 +1,111 @@
+// s-step CG must be stable for every supported block size s and reproduce
+// Jacobi-preconditioned CGSolver: the same solution, with the number of
+// operator applications rounded up to a multiple of s (in exact arithmetic,
+// s-step CG after k outer iterations is CG after k s iterations, and both
+// test (r, D^-1 r)). Block sizes outside the supported range must throw.
+
+#include "../src/cg.hpp"
+#include "../src/sstep_cg.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction")("degree", po::value<int>()->default_value(3),
+                                           "Finite element degree");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const int degree = vm["degree"].as<int>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto kappa = std::make_shared<fem::Constant<T>>(2.0);
+    auto level = test::create_level(mesh, degree, kappa);
+    auto A = test::create_matfree_operator(*level, kappa->value[0]);
+    auto map = level->V->dofmap()->index_map;
+
+    DeviceVector b(map, 1);
+    test::set_rhs(*level, b);
+    std::array<T, 2> eig = test::estimate_eigenvalues(*A, map);
+    const std::array<T, 2> eig_range = {T(0), T(1.1) * eig[1]};
+
+    const T rtol = 1e-8;
+    acc::CGSolver<DeviceVector> cg(map, 1);
+    cg.set_max_iterations(1000);
+    cg.set_tolerance(rtol);
+    DeviceVector x_cg(map, 1), x(map, 1);
+    x_cg.set(T{0.0});
+    const int its_cg = cg.solve(*A, x_cg, b);
+    const T xnorm = acc::norm(x_cg);
+
+    for (int s = 1; s <= acc::max_sstep_size; ++s)
+    {
+      acc::SStepCGSolver<DeviceVector> scg(map, 1, s, eig_range);
+      scg.set_max_iterations(1000 / s);
+      scg.set_tolerance(rtol);
+      x.set(T{0.0});
+      const int its = scg.solve(*A, x, b);
+
+      acc::axpy(x, T(-1), x, x_cg);
+      T err = acc::norm(x) / xnorm;
+      if (rank == 0)
+      {
+        std::cout << "s = " << s << ": CG " << its_cg << " iterations, s-step CG " << its
+                  << " operator applications, difference " << err << "\n";
+      }
+      if (its < its_cg - s or its > its_cg + 2 * s or err > 1e-6)
+      {
+        std::cout << "Error: s-step CG with s = " << s << " does not reproduce CG" << std::endl;
+        return 1;
+      }
+    }
+
+    for (int s : {0, acc::max_sstep_size + 1})
+    {
+      bool thrown = false;
+      try
+      {
+        acc::SStepCGSolver<DeviceVector> scg(map, 1, s, eig_range);
+      }
+      catch (const std::runtime_error&)
+      {
+        thrown = true;
+      }
+      if (!thrown)
+      {
+        std::cout << "Error: s-step CG accepted s = " << s << std::endl;
+        return 1;
+      }
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}
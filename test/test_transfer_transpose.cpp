@@ -0,0 +1,113 @@
+// Transposed transfers in parallel. The transpose product of the assembled
+// p-prolongation P must satisfy (P x, y) = (x, P^T y), which fails if the
+// contributions to ghost columns are not sent to their owners, and the
+// matrix-free transpose of Interpolator must match P^T y.
+
+#include "../src/interpolate.hpp"
+#include "problem.hpp"
+
+#include <boost/program_options.hpp>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <mpi.h>
+
+using namespace dolfinx;
+using T = double;
+using DeviceVector = dolfinx::acc::Vector<T, acc::Device::HIP>;
+namespace po = boost::program_options;
+
+/// Set the owned values of x to g(global index)
+template <typename Function>
+void set_values(DeviceVector& x, Function g)
+{
+  la::Vector<T> x_host(x.map(), 1);
+  x_host.set(T(0));
+  std::span<T> values = x_host.mutable_array();
+  std::int64_t offset = x.map()->local_range()[0];
+  for (std::int32_t i = 0; i < x.map()->size_local(); ++i)
+    values[i] = g(offset + i);
+  x.copy_from_host(x_host);
+}
+
+int main(int argc, char* argv[])
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()("help,h", "print usage message")(
+      "ncells", po::value<std::int64_t>()->default_value(10),
+      "number of cells in each direction")("degree", po::value<int>()->default_value(1),
+                                           "Finite element degree of the coarse space");
+
+  po::variables_map vm;
+  po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+  po::notify(vm);
+
+  if (vm.count("help"))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  const std::int64_t nc = vm["ncells"].as<std::int64_t>();
+  const int degree = vm["degree"].as<int>();
+
+  init_logging(argc, argv);
+  MPI_Init(&argc, &argv);
+  {
+    MPI_Comm comm{MPI_COMM_WORLD};
+    int rank = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    auto mesh = test::create_mesh(comm, nc);
+    auto V0 = test::create_space(mesh, degree);
+    auto V1 = test::create_space(mesh, degree + 1);
+
+    acc::MatrixOperator<T> P(*V0, *V1);
+    auto cmap = P.column_index_map();
+    auto rmap = P.row_index_map();
+
+    DeviceVector x(cmap, 1), y(rmap, 1), Px(rmap, 1), PTy(cmap, 1);
+    set_values(x, [](std::int64_t i) { return std::sin(T(i)); });
+    set_values(y, [](std::int64_t i) { return std::cos(T(i)); });
+    P(x, Px);
+    P(y, PTy, true);
+
+    T Px_y = acc::inner_product(Px, y);
+    T x_PTy = acc::inner_product(x, PTy);
+    T err = std::abs(Px_y - x_PTy) / std::abs(Px_y);
+    if (rank == 0)
+      std::cout << "(Px, y) = " << Px_y << ", (x, P^T y) = " << x_PTy << "\n";
+    if (err > 1e-12)
+    {
+      std::cout << "Error: the transpose product of P is not P^T" << std::endl;
+      return 1;
+    }
+
+    // Matrix-free transpose, on the layouts of the spaces
+    auto [lcells, bcells] = compute_boundary_cells(V1);
+    Interpolator<T> interpolator(*V0, *V1, lcells, bcells);
+    DeviceVector y1(V1->dofmap()->index_map, 1), z0(V0->dofmap()->index_map, 1);
+    set_values(y1, [](std::int64_t i) { return std::cos(T(i)); });
+    interpolator(y1, z0, true);
+
+    std::vector<T> a = PTy.data_copy();
+    std::vector<T> b = z0.data_copy();
+    std::array<T, 2> sums = {0, 0};
+    for (std::int32_t i = 0; i < cmap->size_local(); ++i)
+    {
+      sums[0] += (a[i] - b[i]) * (a[i] - b[i]);
+      sums[1] += a[i] * a[i];
+    }
+    MPI_Allreduce(MPI_IN_PLACE, sums.data(), 2, dolfinx::MPI::mpi_type<T>(), MPI_SUM, comm);
+    err = std::sqrt(sums[0] / sums[1]);
+    if (rank == 0)
+      std::cout << "Interpolator transpose vs P^T: difference " << err << "\n";
+    if (err > 1e-12)
+    {
+      std::cout << "Error: the Interpolator transpose differs from P^T" << std::endl;
+      return 1;
+    }
+
+    dolfinx::list_timings(MPI_COMM_WORLD, {dolfinx::TimingType::wall});
+  }
+  return 0;
+}